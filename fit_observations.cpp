@@ -0,0 +1,49 @@
+//fit_observations.cpp -- program to evaluate the forward model for a
+//grid of parameters against many observation sets in parallel
+
+#include "Real.hpp"
+#include "observation_fit_driver.hpp"
+#include <iostream>
+#include <cstdlib>
+
+int main(int argc, char* argv[]) {
+  if (argc < 4) {
+    std::cerr << "usage: " << argv[0]
+	      << " parameter_file observation_list_file output_file"
+	      << " [n_workers] [threads_per_worker] [iph_sourcefn_file]\n"
+	      << "  parameter_file: one 'nHexo Texo' pair per line\n"
+	      << "  observation_list_file: one observation set file per line\n";
+    return 1;
+  }
+
+  const std::string parameter_fname = argv[1];
+  const std::string observation_list_fname = argv[2];
+  const std::string output_fname = argv[3];
+  const int n_workers = argc > 4 ? atoi(argv[4]) : 1;
+  const int threads_per_worker = argc > 5 ? atoi(argv[5]) : 1;
+  const std::string iph_sfn_fname = argc > 6 ? argv[6] : "src/quemerais_IPH_model/fsm99td12v20t80";
+
+  std::vector<model_parameters> parameters;
+  if (!observation_fit_driver::load_parameters(parameter_fname, parameters)) {
+    std::cerr << "could not read parameter file " << parameter_fname << std::endl;
+    return 1;
+  }
+
+  std::vector<observation_set> sets;
+  if (!observation_fit_driver::load_observation_sets(observation_list_fname, sets)) {
+    std::cerr << "could not read observation list " << observation_list_fname << std::endl;
+    return 1;
+  }
+
+  std::cout << "evaluating " << parameters.size() << " parameter points against "
+	    << sets.size() << " observation sets on "
+	    << n_workers << " workers." << std::endl;
+
+  observation_fit_driver driver(iph_sfn_fname, n_workers, threads_per_worker);
+  if (!driver.run(parameters, sets, output_fname)) {
+    std::cerr << "could not write output file " << output_fname << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
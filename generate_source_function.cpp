@@ -7,6 +7,7 @@
 #include "atm/chamb_diff_1d.hpp"
 #include "grid_plane_parallel.hpp"
 #include "grid_spherical_azimuthally_symmetric.hpp"
+#include "grid_spherical_3d.hpp"
 #include "RT_grid.hpp"
 #include "emission/singlet_CFR.hpp"
 #include "emission/O_1026.hpp"
@@ -17,6 +18,74 @@
 //#define H_LYMAN_MULTIPLET_TEST
 //#define H_LYMAN_SINGLET_TEST
 //#define NO_SIM_BRIGHTNESS
+//#define COMPARE_MIXED_PRECISION
+//#define COUNT_ALLOCATIONS
+
+#if defined(COUNT_ALLOCATIONS) && !defined(__CUDACC__)
+// Count the heap allocations made while a model is evaluated. Eigen
+// allocates with malloc and realloc rather than operator new, and has
+// no allocation hook beyond the EIGEN_RUNTIME_NO_MALLOC check, so the
+// C allocation functions themselves are replaced, passing through to
+// the glibc allocator. libstdc++'s operator new calls malloc, so
+// standard containers are counted too. A realloc counts as one
+// allocation of its new size. Only glibc exports the __libc_*
+// functions used here.
+#ifndef __GLIBC__
+#error "COUNT_ALLOCATIONS requires glibc"
+#endif
+#include <atomic>
+#include <cerrno>
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t n, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void *__libc_memalign(size_t alignment, size_t size);
+}
+namespace allocation_count {
+  std::atomic<bool> counting(false);
+  std::atomic<long> n_allocations(0), n_bytes(0), largest(0);
+
+  void count(const size_t size) {
+    if (counting) {
+      n_allocations++;
+      n_bytes += size;
+      long previous = largest;
+      while (long(size) > previous && !largest.compare_exchange_weak(previous, size))
+	;
+    }
+  }
+}
+extern "C" void *malloc(size_t size) {
+  allocation_count::count(size);
+  return __libc_malloc(size);
+}
+extern "C" void *calloc(size_t n, size_t size) {
+  allocation_count::count(n*size);
+  return __libc_calloc(n, size);
+}
+extern "C" void *realloc(void *ptr, size_t size) {
+  allocation_count::count(size);
+  return __libc_realloc(ptr, size);
+}
+extern "C" void *memalign(size_t alignment, size_t size) {
+  allocation_count::count(size);
+  return __libc_memalign(alignment, size);
+}
+extern "C" void *aligned_alloc(size_t alignment, size_t size) {
+  allocation_count::count(size);
+  return __libc_memalign(alignment, size);
+}
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  if (alignment % sizeof(void*) != 0 || (alignment & (alignment-1)) != 0)
+    return EINVAL;
+  allocation_count::count(size);
+  void *result = __libc_memalign(alignment, size);
+  if (result == NULL && size != 0)
+    return ENOMEM;
+  *ptr = result;
+  return 0;
+}
+#endif
 
 int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[]) {
 
@@ -82,7 +151,8 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
 
   // define the geometry of the grid
   //#define PLANE_PARALLEL
-#ifdef PLANE_PARALLEL
+  //#define SPHERICAL_3D
+#if defined(PLANE_PARALLEL)
   static const int n_radial_boundaries = 40;
   static const int n_rays_theta = 6;
   typedef plane_parallel_grid<n_radial_boundaries,
@@ -91,6 +161,28 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
   
   grid_type grid;
   grid.rmethod = grid.rmethod_log_n_species;
+#elif defined(SPHERICAL_3D)
+  // the influence matrices of this grid are stored sparsely and
+  // solved iteratively (see emission_voxels::sparse_influence)
+  static const int n_radial_boundaries = 40;
+  static const int n_sza_boundaries = 12;/*must give an odd number of SZA voxels*/
+  static const int n_phi_voxels = 20;
+  static const int n_rays_theta = 6;
+  static const int n_rays_phi = 12;
+  typedef spherical_3d_grid<n_radial_boundaries,
+			    n_sza_boundaries,
+			    n_phi_voxels,
+			    n_rays_theta,
+			    n_rays_phi> grid_type;
+
+  grid_type grid;
+
+  grid.rmethod = grid.rmethod_log_n_species;
+  grid.szamethod = grid.szamethod_uniform_cos;
+  grid.raymethod_theta = grid.raymethod_theta_uniform;
+#ifdef __CUDACC__
+#error "sparse influence matrices are only solved on the CPU"
+#endif
 #else
   static const int n_radial_boundaries = 40;
   static const int n_sza_boundaries = 20;/*20 for 10 deg increments with szamethod_uniform*/
@@ -123,12 +215,15 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
   //solve for O 1026
   typedef O_1026_emission<grid_type::n_voxels> emission_type;
   emission_type oxygen_1026;
-  oxygen_1026.define("O_1026",
-		     atm,
-		     &chamb_diff_1d::n_species_voxel_avg,   
-		     &chamb_diff_1d::Temp_voxel_avg,
-		     &chamb_diff_1d::n_absorber_voxel_avg,
-		     grid.voxels);
+  auto define_emissions = [&]() {
+    oxygen_1026.define("O_1026",
+		       atm,
+		       &chamb_diff_1d::n_species_voxel_avg,   
+		       &chamb_diff_1d::Temp_voxel_avg,
+		       &chamb_diff_1d::n_absorber_voxel_avg,
+		       grid.voxels);
+  };
+  define_emissions();
   oxygen_1026.set_solar_brightness(1.69e-3); /* ph/cm2/s/Hz, 
 						solar line center brightness at Lyman beta, 
 						solar minimum */
@@ -145,12 +240,15 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
     lyman_emission.set_CO2_absorption_off();
   if (not atm.temp_dependent_sH)
     lyman_emission.set_constant_temp_RT(exobase_temp);
-  lyman_emission.define("H Lyman alpha and beta",
-			atm,
-			&chamb_diff_1d::n_species_voxel_avg,
-			&chamb_diff_1d::Temp_voxel_avg,
-			&chamb_diff_1d::n_absorber_voxel_avg,
-			grid.voxels);
+  auto define_emissions = [&]() {
+    lyman_emission.define("H Lyman alpha and beta",
+			  atm,
+			  &chamb_diff_1d::n_species_voxel_avg,
+			  &chamb_diff_1d::Temp_voxel_avg,
+			  &chamb_diff_1d::n_absorber_voxel_avg,
+			  grid.voxels);
+  };
+  define_emissions();
   lyman_emission.set_solar_brightness(lyman_alpha_flux_Mars_typical, /* ph/cm2/s/Hz, solar brightness */
 				      lyman_beta_flux_Mars_typical); 
 
@@ -167,12 +265,15 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
     lyman_emission.set_CO2_absorption_off();
   if (not atm.temp_dependent_sH)
     lyman_emission.set_constant_temp_RT(exobase_temp);
-  lyman_emission.define("H Lyman alpha and beta",
-			atm,
-			&chamb_diff_1d::n_species_voxel_avg,
-			&chamb_diff_1d::Temp_voxel_avg,
-			&chamb_diff_1d::n_absorber_voxel_avg,
-			grid.voxels);
+  auto define_emissions = [&]() {
+    lyman_emission.define("H Lyman alpha and beta",
+			  atm,
+			  &chamb_diff_1d::n_species_voxel_avg,
+			  &chamb_diff_1d::Temp_voxel_avg,
+			  &chamb_diff_1d::n_absorber_voxel_avg,
+			  grid.voxels);
+  };
+  define_emissions();
   lyman_emission.set_solar_brightness(lyman_alpha_flux_Mars_typical, /* ph/cm2/s/Hz, solar brightness */
 				      lyman_beta_flux_Mars_typical); 
 
@@ -188,22 +289,25 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
   //solve for H lyman alpha
   typedef singlet_CFR<grid_type::n_voxels> emission_type;
   emission_type lyman_alpha;
-  lyman_alpha.define("H Lyman alpha",
-		     /*emission branching ratio = */1.0,
-		     exobase_temp, atm.sH_lya(exobase_temp),
-		     atm,
-		     &chamb_diff_1d::n_species_voxel_avg,   &chamb_diff_1d::Temp_voxel_avg,
-		     &chamb_diff_1d::n_absorber_voxel_avg,  &chamb_diff_1d::sCO2_lya,
-		     grid.voxels);
   //solve for H lyman beta
   emission_type lyman_beta;
-  lyman_beta.define("H Lyman beta",
-  		    /*emission branching ratio = */lyman_beta_branching_ratio,
-  		    exobase_temp, atm.sH_lyb(exobase_temp),
-  		    atm,
-  		    &chamb_diff_1d::n_species_voxel_avg,   &chamb_diff_1d::Temp_voxel_avg,
-  		    &chamb_diff_1d::n_absorber_voxel_avg,  &chamb_diff_1d::sCO2_lyb,
-		    grid.voxels);
+  auto define_emissions = [&]() {
+    lyman_alpha.define("H Lyman alpha",
+		       /*emission branching ratio = */1.0,
+		       exobase_temp, atm.sH_lya(exobase_temp),
+		       atm,
+		       &chamb_diff_1d::n_species_voxel_avg,   &chamb_diff_1d::Temp_voxel_avg,
+		       &chamb_diff_1d::n_absorber_voxel_avg,  &chamb_diff_1d::sCO2_lya,
+		       grid.voxels);
+    lyman_beta.define("H Lyman beta",
+		      /*emission branching ratio = */lyman_beta_branching_ratio,
+		      exobase_temp, atm.sH_lyb(exobase_temp),
+		      atm,
+		      &chamb_diff_1d::n_species_voxel_avg,   &chamb_diff_1d::Temp_voxel_avg,
+		      &chamb_diff_1d::n_absorber_voxel_avg,  &chamb_diff_1d::sCO2_lyb,
+		      grid.voxels);
+  };
+  define_emissions();
 
   //emission_type *emissions[n_emissions] = {&lyman_alpha};
   emission_type *emissions[n_emissions] = {&lyman_alpha, &lyman_beta};
@@ -221,6 +325,69 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
   RT.generate_S_gpu();
   RT.generate_S_gpu();
 #endif
+
+#if defined(COMPARE_MIXED_PRECISION) && !defined(__CUDACC__) && !defined(SPHERICAL_3D)
+  // time the solve with double and single precision factors, the
+  // latter refined to double precision (see
+  // emission_voxels::set_mixed_precision)
+  {
+    VectorX sourcefn_double[n_emissions];
+    Real solve_time[2];
+    for (int mixed=0;mixed<2;mixed++) {
+      for (int i_emission=0;i_emission<n_emissions;i_emission++) {
+	emissions[i_emission]->set_mixed_precision(mixed);
+	emissions[i_emission]->reset_solution();
+      }
+      RT.compute_influence();
+
+      my_clock solve_clk;
+      solve_clk.start();
+      RT.solve();
+      solve_clk.stop();
+      solve_time[mixed] = solve_clk.elapsed();
+
+      solve_clk.print_elapsed(mixed ? "mixed precision solve takes " : "double precision solve takes ");
+      for (int i_emission=0;i_emission<n_emissions;i_emission++) {
+	std::cout << "  " << emissions[i_emission]->name()
+		  << " relative residual: " << emissions[i_emission]->relative_residual();
+	if (mixed) {
+	  VectorX diff = emissions[i_emission]->source_function() - sourcefn_double[i_emission];
+	  std::cout << ", relative difference from double: "
+		    << diff.norm()/sourcefn_double[i_emission].norm();
+	} else
+	  sourcefn_double[i_emission] = emissions[i_emission]->source_function();
+	std::cout << "\n";
+      }
+    }
+    std::cout << "mixed precision speedup: " << solve_time[0]/solve_time[1] << "\n\n";
+  }
+#endif
+
+#if defined(COUNT_ALLOCATIONS) && !defined(__CUDACC__)
+  // evaluate the model again, as a retrieval does for each new set of
+  // parameters. The emission and influence storage is allocated once,
+  // so defining the emissions and computing the influence should
+  // allocate nothing beyond the small team structure libgomp may
+  // memalign for a parallel region; the solve allocates the LU
+  // factors and Eigen's product workspace.
+  {
+    auto count_allocations = [](const string &step, auto evaluate) {
+      using namespace allocation_count;
+      n_allocations = 0;
+      n_bytes = 0;
+      largest = 0;
+      counting = true;
+      evaluate();
+      counting = false;
+      std::cout << step << ": " << n_allocations << " allocations, "
+		<< n_bytes << " bytes, largest " << largest << " bytes\n";
+    };
+    count_allocations("define emissions", define_emissions);
+    count_allocations("compute influence", [&]() { RT.compute_influence(); });
+    count_allocations("solve", [&]() { RT.solve(); });
+    std::cout << "\n";
+  }
+#endif
   //now print out the output
 
 #if defined(GENERATE_O_1026)
@@ -232,6 +399,9 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
 #else
   string sfn_name_tag = "";
 #endif
+#ifdef SPHERICAL_3D
+  sfn_name_tag += "_3D";
+#endif
   
   RT.save_S("test/test_source_function"+sfn_name_tag+".dat");
 
@@ -239,6 +409,9 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
   sfn_name_tag_dims += std::to_string(n_radial_boundaries) + "x";
 #ifndef PLANE_PARALLEL
   sfn_name_tag_dims += std::to_string(n_sza_boundaries) + "x";
+#endif
+#ifdef SPHERICAL_3D
+  sfn_name_tag_dims += std::to_string(n_phi_voxels) + "x";
 #endif
   sfn_name_tag_dims += std::to_string(n_rays_theta);
 #ifndef PLANE_PARALLEL
@@ -247,8 +420,11 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char* argv[])
 #endif
   RT.save_S("test/test_source_function"+sfn_name_tag_dims+".dat");
 
+#ifndef SPHERICAL_3D
+  // too large to write out as text on the 3D grid
   RT.save_influence("test/influence_matrix"+sfn_name_tag+".dat");
   RT.save_influence("test/influence_matrix"+sfn_name_tag_dims+".dat");
+#endif
 
 #if !defined(NO_SIM_BRIGHTNESS) && !defined(PLANE_PARALLEL)
   //simulate a fake observation
@@ -25,12 +25,30 @@ cdef extern from "chamberlain_exosphere.hpp":
     cdef cppclass Temp_converter:
         Real lc_from_T(Real T)
         Real eff_from_T(Real T)
+        @staticmethod
+        void set_table_cache_dir(string dirname)
+
+cdef extern from "forward_model_cache.hpp":
+    cdef struct forward_model_cache_stats:
+        long source_function_hits
+        long source_function_disk_hits
+        long source_function_misses
+        long source_function_entries
+        long brightness_hits
+        long brightness_misses
+        long brightness_entries
+
+cdef extern from "iph_model_interface.hpp":
+    void set_quemerais_iph_cache_size(size_t n_los)
 
 # name of Quemerais IPH source function, packaged along with *.so file
 iph_sfn_basename = 'quemerais_IPH_sourcefn_fsm99td12v20t80.dat' # basename of source file
 # fully qualified name determined when class Pyobservation_fit is created
 
-cdef extern from "observation_fit.hpp":
+# observation_fit methods are declared nogil so that the heavy ones
+# can run without holding the GIL (see the note in observation_fit.hpp
+# on which concurrent uses are safe)
+cdef extern from "observation_fit.hpp" nogil:
     cdef cppclass observation_fit:
         observation_fit(string sfn_fname)
 
@@ -114,6 +132,13 @@ cdef extern from "observation_fit.hpp":
 
         void set_sza_method_uniform()
         void set_sza_method_uniform_cos()
+
+        void set_high_resolution(bool high_resolution)
+        bool get_high_resolution()
+        void set_coarse_to_fine(bool coarse_to_fine)
+        void set_mixed_precision(bool mixed_precision)
+        void set_adaptive_radial_grid(int n_passes)
+        int n_voxels()
                                            
         void reset_H_lya_xsec_coef(Real xsec_coef)
         void reset_H_lya_xsec_coef() # uses C++ default
@@ -130,11 +155,25 @@ cdef extern from "observation_fit.hpp":
 
         void save_influence_matrix(string fname)
         void save_influence_matrix_O_1026(string fname)
+        bool save_source_function_binary(string fname, bool deuterium, string git_hash)
+        bool save_influence_matrix_binary(string fname, bool deuterium, string git_hash)
+        bool load_source_function_binary(string fname, bool deuterium)
 
         void set_H_density_tweak(bool tweak_H_densityy);
         void set_H_density_tweak_values(vector[int] voxels_to_tweak, Real tweak_factor);
         void set_H_temp_tweak(bool tweak_H_tempp);
         void set_H_temp_tweak_values(vector[int] voxel_to_tweak, Real tweak_factor);
+        vector[vector[vector[Real]]] brightness_jacobian(Real nHexo, Real Texo,
+                                                         vector[vector[int]] density_tweak_voxels,
+                                                         vector[vector[int]] temp_tweak_voxels,
+                                                         Real relative_step)
+
+        void set_density_rescale_shortcut(bool use_shortcut)
+
+        void set_forward_model_cache_size(int n_source_functions, int n_brightnesses)
+        void set_forward_model_cache_dir(string dirname, string git_hash)
+        void clear_forward_model_cache()
+        forward_model_cache_stats get_forward_model_cache_stats()
         
         vector[vector[Real]] brightness()
         vector[vector[Real]] species_col_dens()
@@ -148,6 +187,17 @@ cdef extern from "observation_fit.hpp":
         vector[vector[Real]] D_col_dens()
         vector[vector[Real]] tau_D_final()
 
+        int n_observations()
+        @staticmethod
+        int get_n_hydrogen_emissions()
+        void brightness(Real *buffer)
+        void species_col_dens(Real *buffer)
+        void tau_species_final(Real *buffer)
+        void tau_absorber_final(Real *buffer)
+        void D_brightness(Real *buffer)
+        void D_col_dens(Real *buffer)
+        void tau_D_final(Real *buffer)
+
         void O_1026_generate_source_function(Real nOexo,
                                              Real Texo,
                                              Real solar_brightness_lyman_beta, # 1.69e-3 is a good number for solar minimum
@@ -174,7 +224,14 @@ cdef extern from "observation_fit.hpp":
 
         
 cdef class Pyobservation_fit:
+    # Source function solves, brightness calculations, and IPH setup
+    # release the GIL, so separate Pyobservation_fit objects can run
+    # in parallel from Python threads. A single object must not be
+    # used from more than one thread at a time. Each object also uses
+    # OpenMP internally, so set OMP_NUM_THREADS to about
+    # (number of cores)/(number of threads) to avoid oversubscription.
     cdef observation_fit *thisptr #holds the reference to the cpp class
+    cdef dict result_buffers # arrays returned by the *_view methods
     def __cinit__(self):
         # if we've gotten here, the module must be known to python,
         # find its origin file
@@ -199,6 +256,7 @@ cdef class Pyobservation_fit:
 
         print("loading IPH source function from file " + iph_sfn_fname)
         self.thisptr = new observation_fit(iph_sfn_fname.encode('utf-8'))
+        self.result_buffers = {}
     def __dealloc__(self):
         del self.thisptr
 
@@ -217,7 +275,8 @@ cdef class Pyobservation_fit:
             for j in range(3):
                 loc_vec[i][j] = realconvert(loc_arr[i,j])
                 dir_vec[i][j] = realconvert(dir_arr[i,j])
-        self.thisptr.add_observation(loc_vec,dir_vec)
+        with nogil:
+            self.thisptr.add_observation(loc_vec,dir_vec)
 
     def set_g_factor(self, vector[Real] g):
         self.thisptr.set_g_factor(g)
@@ -244,10 +303,24 @@ cdef class Pyobservation_fit:
             RA[i]  = realconvert(RA_arr[i])
             Dec[i] = realconvert(Dec_arr[i])
         
-        self.thisptr.add_observation_ra_dec(marspos,
-                                            RA,
-                                            Dec)
+        with nogil:
+            self.thisptr.add_observation_ra_dec(marspos,
+                                                RA,
+                                                Dec)
         
+    @staticmethod
+    def set_Temp_converter_cache_dir(dirname):
+        # conversion tables are written to / read from this directory
+        # so that later sessions and worker processes can skip building them
+        Temp_converter.set_table_cache_dir(dirname.encode('utf-8'))
+
+    @staticmethod
+    def set_iph_cache_size(n_los):
+        # IPH brightnesses are remembered per line of sight across all
+        # objects; this sets how many are kept (default 10000, about
+        # 4 MB; 0 disables the cache)
+        set_quemerais_iph_cache_size(n_los)
+
     def lc_from_T(self, T):
         return self.thisptr.Tconv.lc_from_T(realconvert(T))
     def eff_from_T(self, T):
@@ -258,31 +331,43 @@ cdef class Pyobservation_fit:
                                  sourcefn_fname = "",
                                  plane_parallel = False,
                                  deuterium = False):
-        self.thisptr.generate_source_function(nH,T,
-                                              atmosphere_fname.encode('utf-8'),
-                                              sourcefn_fname.encode('utf-8'),
-                                              plane_parallel,
-                                              deuterium)
+        cdef string atm_fname = atmosphere_fname.encode('utf-8')
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        cdef bool pp = plane_parallel, D = deuterium
+        with nogil:
+            self.thisptr.generate_source_function(nH,T,
+                                                  atm_fname,
+                                                  sfn_fname,
+                                                  pp,
+                                                  D)
     def generate_source_function_lc(self, Real nH, Real lc,
                                     atmosphere_fname = "",
                                     sourcefn_fname = "",
                                     plane_parallel = False,
                                     deuterium = False):
-        self.thisptr.generate_source_function_lc(nH,lc,
-                                                 atmosphere_fname.encode('utf-8'),
-                                                 sourcefn_fname.encode('utf-8'),
-                                                 plane_parallel,
-                                                 deuterium)
+        cdef string atm_fname = atmosphere_fname.encode('utf-8')
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        cdef bool pp = plane_parallel, D = deuterium
+        with nogil:
+            self.thisptr.generate_source_function_lc(nH,lc,
+                                                     atm_fname,
+                                                     sfn_fname,
+                                                     pp,
+                                                     D)
     def generate_source_function_effv(self, Real nH, Real effv,
                                       atmosphere_fname = "",
                                       sourcefn_fname = "",
                                       plane_parallel = False,
                                       deuterium = False):
-        self.thisptr.generate_source_function_effv(nH,effv,
-                                                   atmosphere_fname.encode('utf-8'),
-                                                   sourcefn_fname.encode('utf-8'),
-                                                   plane_parallel,
-                                                   deuterium)
+        cdef string atm_fname = atmosphere_fname.encode('utf-8')
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        cdef bool pp = plane_parallel, D = deuterium
+        with nogil:
+            self.thisptr.generate_source_function_effv(nH,effv,
+                                                       atm_fname,
+                                                       sfn_fname,
+                                                       pp,
+                                                       D)
     def generate_source_function_variable_thermosphere(self,
                                                        Real nHexo, Real Texo,
                                                        Real nCO2rminn,
@@ -298,38 +383,48 @@ cdef class Pyobservation_fit:
                                                        sourcefn_fname = "",
                                                        plane_parallel = False,
                                                        deuterium = False):
-        self.thisptr.generate_source_function_variable_thermosphere(nHexo, Texo,
-                                                                    nCO2rminn,
-						                    rexoo,
-						                    rminn,
-						                    rmaxx,
-						                    rmindiffusionn,
-						                    #extra args for krasnopolsky_temp					  
-						                    T_tropo,
-						                    r_tropo,
-						                    shape_parameter,
-				                                    atmosphere_fname.encode('utf-8'),
-                                                                    sourcefn_fname.encode('utf-8'),
-                                                                    plane_parallel,
-                                                                    deuterium)
+        cdef string atm_fname = atmosphere_fname.encode('utf-8')
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        cdef bool pp = plane_parallel, D = deuterium
+        with nogil:
+            self.thisptr.generate_source_function_variable_thermosphere(nHexo, Texo,
+                                                                        nCO2rminn,
+                                                                        rexoo,
+                                                                        rminn,
+                                                                        rmaxx,
+                                                                        rmindiffusionn,
+                                                                        #extra args for krasnopolsky_temp
+                                                                        T_tropo,
+                                                                        r_tropo,
+                                                                        shape_parameter,
+                                                                        atm_fname,
+                                                                        sfn_fname,
+                                                                        pp,
+                                                                        D)
         
     def generate_source_function_nH_asym(self, Real nH, Real Texo,
                                          Real asym,
                                          sourcefn_fname = "",
                                          deuterium = False):
-        self.thisptr.generate_source_function_nH_asym(nH,Texo,
-                                                      asym,
-                                                      sourcefn_fname.encode('utf-8'),
-                                                      deuterium)
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        cdef bool D = deuterium
+        with nogil:
+            self.thisptr.generate_source_function_nH_asym(nH,Texo,
+                                                          asym,
+                                                          sfn_fname,
+                                                          D)
 
     def generate_source_function_temp_asym(self, Real nHavg,
                                            Real Tnoon, Real Tmidnight,
                                            sourcefn_fname = "",
                                            deuterium = False):
-        self.thisptr.generate_source_function_temp_asym(nHavg,
-                                                        Tnoon,Tmidnight,
-                                                        sourcefn_fname.encode('utf-8'),
-                                                        deuterium)
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        cdef bool D = deuterium
+        with nogil:
+            self.thisptr.generate_source_function_temp_asym(nHavg,
+                                                            Tnoon,Tmidnight,
+                                                            sfn_fname,
+                                                            D)
 
     def generate_source_function_temp_asym_full(self, Real nHavg,
                                                 Real Tnoon, Real Tmidnight,
@@ -346,21 +441,24 @@ cdef class Pyobservation_fit:
                                                 Real Tpower,
                                                 sourcefn_fname = "",
                                                 deuterium = False):
-        self.thisptr.generate_source_function_temp_asym(nHavg,
-                                                        Tnoon,Tmidnight,
-                                                        nCO2rminn,
-					                rexoo,
-					                rminn,
-					                rmaxx,
-					                rmindiffusionn,
-					                #extra args for krasnopolsky_temp					  
-					                T_tropo,
-					                r_tropo,
-                                                        shape_parameter,
-						        #power for temperature in the expression n*T^p = const.
-                                                        Tpower,
-                                                        sourcefn_fname.encode('utf-8'),
-                                                        deuterium)
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        cdef bool D = deuterium
+        with nogil:
+            self.thisptr.generate_source_function_temp_asym(nHavg,
+                                                            Tnoon,Tmidnight,
+                                                            nCO2rminn,
+                                                            rexoo,
+                                                            rminn,
+                                                            rmaxx,
+                                                            rmindiffusionn,
+                                                            #extra args for krasnopolsky_temp
+                                                            T_tropo,
+                                                            r_tropo,
+                                                            shape_parameter,
+                                                            #power for temperature in the expression n*T^p = const.
+                                                            Tpower,
+                                                            sfn_fname,
+                                                            D)
 
     def get_example_tabular_atmosphere(self):
         rmin = 3395e5 +    80e5
@@ -400,16 +498,20 @@ cdef class Pyobservation_fit:
             alt_Temp[i] =  np.float64(atm_dict['alt_Temp'][i])
             Temp[i] =  np.float64(atm_dict['Temp'][i])
         
-        self.thisptr.generate_source_function_tabular_atmosphere(atm_dict['rmin'],
-                                                                 atm_dict['rexo'],
-                                                                 atm_dict['rmax'],
-                                                                 alt_nH,   log_nH,
-                                                                 alt_nCO2, log_nCO2,
-                                                                 alt_Temp, Temp,
-                                                                 compute_exosphere,
-                                                                 plane_parallel,
-                                                                 deuterium,
-                                                                 sourcefn_fname.encode('utf-8'))
+        cdef Real rmin = atm_dict['rmin'], rexo = atm_dict['rexo'], rmax = atm_dict['rmax']
+        cdef bool exosphere = compute_exosphere, pp = plane_parallel, D = deuterium
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        with nogil:
+            self.thisptr.generate_source_function_tabular_atmosphere(rmin,
+                                                                     rexo,
+                                                                     rmax,
+                                                                     alt_nH,   log_nH,
+                                                                     alt_nCO2, log_nCO2,
+                                                                     alt_Temp, Temp,
+                                                                     exosphere,
+                                                                     pp,
+                                                                     D,
+                                                                     sfn_fname)
 
     def set_use_CO2_absorption(self, use_CO2_absorption = True):
         self.thisptr.set_use_CO2_absorption(use_CO2_absorption)
@@ -422,6 +524,36 @@ cdef class Pyobservation_fit:
 
     def set_sza_method_uniform_cos(self):
         self.thisptr.set_sza_method_uniform_cos()
+
+    def set_high_resolution(self, high_resolution = True):
+        # run the H and D spherical models on the 90x32 boundary,
+        # 24x16 ray grid instead of the standard 40x20, 7x12 grid.
+        # Solutions at each resolution are kept separately.
+        self.thisptr.set_high_resolution(high_resolution)
+
+    def get_high_resolution(self):
+        return self.thisptr.get_high_resolution()
+
+    def set_coarse_to_fine(self, coarse_to_fine = True):
+        # solve the high resolution models iteratively, starting from
+        # and preconditioned by the standard grid, instead of
+        # factoring the kernel
+        self.thisptr.set_coarse_to_fine(coarse_to_fine)
+
+    def set_mixed_precision(self, mixed_precision = True):
+        # factor the hydrogen kernels in single precision and refine
+        # the source functions to double precision accuracy
+        self.thisptr.set_mixed_precision(mixed_precision)
+
+    def set_adaptive_radial_grid(self, n_passes = 2):
+        # move the H and D radial boundaries toward the layers with the
+        # largest error estimate, solving n_passes extra times. 0
+        # returns to the fixed radial boundaries.
+        self.thisptr.set_adaptive_radial_grid(n_passes)
+
+    def n_voxels(self):
+        # voxels in the H grid at the current resolution
+        return self.thisptr.n_voxels()
         
     def reset_H_lya_xsec_coef(self, xsec_coef = None):
         if xsec_coef==None:
@@ -458,16 +590,28 @@ cdef class Pyobservation_fit:
         self.thisptr.set_CO2_exobase_density(nCO2);
             
     def brightness(self):
-        return np.asarray(self.thisptr.brightness())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.brightness()
+        return np.asarray(result)
 
     def species_col_dens(self):
-        return np.asarray(self.thisptr.species_col_dens())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.species_col_dens()
+        return np.asarray(result)
 
     def tau_species_final(self):
-        return np.asarray(self.thisptr.tau_species_final())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.tau_species_final()
+        return np.asarray(result)
 
     def tau_absorber_final(self):
-        return np.asarray(self.thisptr.tau_absorber_final())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.tau_absorber_final()
+        return np.asarray(result)
 
     def iph_brightness_observed(self):
         return np.asarray(self.thisptr.iph_brightness_observed())
@@ -476,13 +620,89 @@ cdef class Pyobservation_fit:
         return np.asarray(self.thisptr.iph_brightness_unextincted())
 
     def D_brightness(self):
-        return np.asarray(self.thisptr.D_brightness())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.D_brightness()
+        return np.asarray(result)
 
     def D_col_dens(self):
-        return np.asarray(self.thisptr.D_col_dens())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.D_col_dens()
+        return np.asarray(result)
 
     def tau_D_final(self):
-        return np.asarray(self.thisptr.tau_D_final())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.tau_D_final()
+        return np.asarray(result)
+
+    # The *_view methods return the same results as the methods above,
+    # written by the C++ code directly into a read-only array held by
+    # this object, without intermediate copies. The array is reused and
+    # overwritten by the next call to the same method, so copy it if
+    # the values must be kept.
+    cdef Real* result_buffer(self, name):
+        cdef int n_rows = observation_fit.get_n_hydrogen_emissions()
+        cdef int n_obs = self.thisptr.n_observations()
+        buf = self.result_buffers.get(name)
+        if buf is None or buf.shape != (n_rows, n_obs):
+            buf = np.empty((n_rows, n_obs), dtype=realconvert)
+            buf.flags.writeable = False
+            self.result_buffers[name] = buf
+        if n_obs == 0:
+            return NULL # nothing for the C++ routines to fill
+        cdef const Real[:, ::1] mv = buf
+        return <Real*> &mv[0, 0]
+
+    def brightness_view(self):
+        cdef Real *buf = self.result_buffer('brightness')
+        if buf != NULL:
+            with nogil:
+                self.thisptr.brightness(buf)
+        return self.result_buffers['brightness']
+
+    def species_col_dens_view(self):
+        cdef Real *buf = self.result_buffer('species_col_dens')
+        if buf != NULL:
+            with nogil:
+                self.thisptr.species_col_dens(buf)
+        return self.result_buffers['species_col_dens']
+
+    def tau_species_final_view(self):
+        cdef Real *buf = self.result_buffer('tau_species_final')
+        if buf != NULL:
+            with nogil:
+                self.thisptr.tau_species_final(buf)
+        return self.result_buffers['tau_species_final']
+
+    def tau_absorber_final_view(self):
+        cdef Real *buf = self.result_buffer('tau_absorber_final')
+        if buf != NULL:
+            with nogil:
+                self.thisptr.tau_absorber_final(buf)
+        return self.result_buffers['tau_absorber_final']
+
+    def D_brightness_view(self):
+        cdef Real *buf = self.result_buffer('D_brightness')
+        if buf != NULL:
+            with nogil:
+                self.thisptr.D_brightness(buf)
+        return self.result_buffers['D_brightness']
+
+    def D_col_dens_view(self):
+        cdef Real *buf = self.result_buffer('D_col_dens')
+        if buf != NULL:
+            with nogil:
+                self.thisptr.D_col_dens(buf)
+        return self.result_buffers['D_col_dens']
+
+    def tau_D_final_view(self):
+        cdef Real *buf = self.result_buffer('tau_D_final')
+        if buf != NULL:
+            with nogil:
+                self.thisptr.tau_D_final(buf)
+        return self.result_buffers['tau_D_final']
 
     def save_influence_matrix(self, fname):
         self.thisptr.save_influence_matrix(fname.encode('utf-8'))
@@ -490,6 +710,39 @@ cdef class Pyobservation_fit:
     def save_influence_matrix_O_1026(self, fname):
         self.thisptr.save_influence_matrix_O_1026(fname.encode('utf-8'))
 
+    def save_source_function_binary(self, fname, deuterium=False):
+        # write the H (or D) source function in the binary format read
+        # by load_RT_binary
+        cdef string c_fname = fname.encode('utf-8')
+        cdef bool c_deuterium = deuterium
+        cdef string c_git_hash = str(CPP_GIT_HASH).encode('utf-8')
+        cdef bool success
+        with nogil:
+            success = self.thisptr.save_source_function_binary(c_fname, c_deuterium, c_git_hash)
+        if not success:
+            raise IOError("could not write " + fname)
+
+    def save_influence_matrix_binary(self, fname, deuterium=False):
+        cdef string c_fname = fname.encode('utf-8')
+        cdef bool c_deuterium = deuterium
+        cdef string c_git_hash = str(CPP_GIT_HASH).encode('utf-8')
+        cdef bool success
+        with nogil:
+            success = self.thisptr.save_influence_matrix_binary(c_fname, c_deuterium, c_git_hash)
+        if not success:
+            raise IOError("could not write " + fname)
+
+    def load_source_function_binary(self, fname, deuterium=False):
+        # use a source function saved by save_source_function_binary
+        # instead of calling generate_source_function
+        cdef string c_fname = fname.encode('utf-8')
+        cdef bool c_deuterium = deuterium
+        cdef bool success
+        with nogil:
+            success = self.thisptr.load_source_function_binary(c_fname, c_deuterium)
+        if not success:
+            raise IOError("could not load a matching source function from " + fname)
+
     def set_H_density_tweak(self, tweak_H_densityy):
         self.thisptr.set_H_density_tweak(tweak_H_densityy)
 
@@ -511,6 +764,52 @@ cdef class Pyobservation_fit:
             vox_nums[i] = voxels_to_tweak[i]
 
         self.thisptr.set_H_temp_tweak_values(vox_nums, tweak_factor)
+
+    def brightness_jacobian(self, nHexo, Texo,
+                            density_tweak_voxels=[], temp_tweak_voxels=[],
+                            relative_step=1e-3):
+        # derivatives of the H brightness with respect to nHexo, Texo,
+        # and the density and temperature tweak factors of each listed
+        # voxel group, with shape (n_parameters, n_emissions, n_obs).
+        # The base model is factored once and perturbed models reuse the
+        # factorization.
+        cdef Real c_nHexo = nHexo
+        cdef Real c_Texo = Texo
+        cdef Real c_relative_step = relative_step
+        cdef vector[vector[int]] c_density_voxels = [list(v) for v in density_tweak_voxels]
+        cdef vector[vector[int]] c_temp_voxels = [list(v) for v in temp_tweak_voxels]
+        cdef vector[vector[vector[Real]]] result
+        with nogil:
+            result = self.thisptr.brightness_jacobian(c_nHexo, c_Texo,
+                                                      c_density_voxels, c_temp_voxels,
+                                                      c_relative_step)
+        return np.asarray(result)
+
+    def set_density_rescale_shortcut(self, use_shortcut = True):
+        # when only nHexo changes between calls to
+        # generate_source_function_variable_thermosphere, rescale the
+        # previous densities instead of rebuilding the atmosphere
+        self.thisptr.set_density_rescale_shortcut(use_shortcut)
+
+    def set_forward_model_cache_size(self, n_source_functions, n_brightnesses = 0):
+        # keep up to this many solved source functions and H/D
+        # brightness results in memory, so repeated parameter points
+        # cost a lookup instead of an RT solve. Zero disables a cache.
+        self.thisptr.set_forward_model_cache_size(n_source_functions, n_brightnesses)
+
+    def set_forward_model_cache_dir(self, dirname):
+        # also keep solved source functions as files in this directory
+        # ("" to turn off). Files record the git hash of this build and
+        # are ignored by other versions of the code.
+        cdef string c_git_hash = str(CPP_GIT_HASH).encode('utf-8')
+        self.thisptr.set_forward_model_cache_dir(dirname.encode('utf-8'), c_git_hash)
+
+    def clear_forward_model_cache(self):
+        self.thisptr.clear_forward_model_cache()
+
+    def get_forward_model_cache_stats(self):
+        # returns a dict of hit/miss counts and current cache sizes
+        return self.thisptr.get_forward_model_cache_stats()
     
     def O_1026_generate_source_function(self,
                                         Real nO,
@@ -518,13 +817,19 @@ cdef class Pyobservation_fit:
                                         Real solar_brightness_lyman_beta,
                                         atmosphere_fname = "",
                                         sourcefn_fname = ""):
-        self.thisptr.O_1026_generate_source_function(nO,
-                                                     T,
-                                                     solar_brightness_lyman_beta,
-                                                     atmosphere_fname.encode('utf-8'),
-                                                     sourcefn_fname.encode('utf-8'))
+        cdef string atm_fname = atmosphere_fname.encode('utf-8')
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        with nogil:
+            self.thisptr.O_1026_generate_source_function(nO,
+                                                         T,
+                                                         solar_brightness_lyman_beta,
+                                                         atm_fname,
+                                                         sfn_fname)
     def O_1026_brightness(self):
-        return np.asarray(self.thisptr.O_1026_brightness())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.O_1026_brightness()
+        return np.asarray(result)
 
     def lyman_multiplet_generate_source_function(self,
                                                  Real nH,
@@ -533,15 +838,21 @@ cdef class Pyobservation_fit:
                                                  # Real solar_brightness_lyman_beta,
                                                  atmosphere_fname = "",
                                                  sourcefn_fname = ""):
-        self.thisptr.lyman_multiplet_generate_source_function(nH,
-                                                              T,
-                                                              # solar_brightness_lyman_alpha,
-                                                              # solar_brightness_lyman_beta,
-                                                              atmosphere_fname.encode('utf-8'),
-                                                              sourcefn_fname.encode('utf-8'))
+        cdef string atm_fname = atmosphere_fname.encode('utf-8')
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        with nogil:
+            self.thisptr.lyman_multiplet_generate_source_function(nH,
+                                                                  T,
+                                                                  # solar_brightness_lyman_alpha,
+                                                                  # solar_brightness_lyman_beta,
+                                                                  atm_fname,
+                                                                  sfn_fname)
 
     def lyman_multiplet_brightness(self):
-        return np.asarray(self.thisptr.lyman_multiplet_brightness())
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.lyman_multiplet_brightness()
+        return np.asarray(result)
 
     def lyman_singlet_generate_source_function(self,
                                                  Real nH,
@@ -550,13 +861,91 @@ cdef class Pyobservation_fit:
                                                  # Real solar_brightness_lyman_beta,
                                                  atmosphere_fname = "",
                                                  sourcefn_fname = ""):
-        self.thisptr.lyman_singlet_generate_source_function(nH,
-                                                            T,
-                                                            # solar_brightness_lyman_alpha,
-                                                            # solar_brightness_lyman_beta,
-                                                            atmosphere_fname.encode('utf-8'),
-                                                            sourcefn_fname.encode('utf-8'))
+        cdef string atm_fname = atmosphere_fname.encode('utf-8')
+        cdef string sfn_fname = sourcefn_fname.encode('utf-8')
+        with nogil:
+            self.thisptr.lyman_singlet_generate_source_function(nH,
+                                                                T,
+                                                                # solar_brightness_lyman_alpha,
+                                                                # solar_brightness_lyman_beta,
+                                                                atm_fname,
+                                                                sfn_fname)
 
     def lyman_singlet_brightness(self):
-        return np.asarray(self.thisptr.lyman_singlet_brightness())
-
+        cdef vector[vector[Real]] result
+        with nogil:
+            result = self.thisptr.lyman_singlet_brightness()
+        return np.asarray(result)
+
+
+
+def load_RT_binary(fname):
+    # Read a file written by save_source_function_binary or
+    # save_influence_matrix_binary. Returns a dict with the header
+    # values, a 'metadata' dict of strings, and an 'arrays' dict of
+    # read-only numpy memmaps into the file. See RT_binary_file.hpp for
+    # the layout.
+    import struct
+
+    with open(fname, 'rb') as f:
+        header = f.read(64)
+        (magic, version, real_size,
+         metadata_offset, metadata_size,
+         table_offset, n_arrays, alignment) = struct.unpack('=8sIIQQQII', header[:48])
+        if magic != b'CRNRTBIN':
+            raise ValueError(fname + " is not an RT binary file")
+        if version != 1:
+            raise ValueError("unsupported RT binary file version " + str(version))
+
+        f.seek(metadata_offset)
+        metadata = {}
+        for line in f.read(metadata_size).decode('utf-8').splitlines():
+            key, _, value = line.partition('=')
+            metadata[key] = value
+
+        f.seek(table_offset)
+        table = f.read(96*n_arrays)
+
+    dtype = np.float32 if real_size == 4 else np.float64
+    arrays = {}
+    for i in range(n_arrays):
+        entry = table[96*i:96*(i+1)]
+        name = entry[:64].split(b'\0', 1)[0].decode('utf-8')
+        n_dims, fortran_order, n0, n1, offset = struct.unpack('=IIQQQ', entry[64:96])
+        shape = (n0,) if n_dims == 1 else (n0, n1)
+        arrays[name] = np.memmap(fname, dtype=dtype, mode='r', offset=offset,
+                                 shape=shape, order='F' if fortran_order else 'C')
+
+    return {'version': version,
+            'real_size': real_size,
+            'metadata': metadata,
+            'arrays': arrays}
+
+def load_sweep_output(fname):
+    # Read the output of a sweep_parameters run. Returns a dict with
+    # 'parameters' (n_points x [nHexo, Texo]), 'done' (bool per point;
+    # points not done hold zeros) and 'brightness' (n_points x
+    # n_emissions x n_obs). See parameter_sweep.hpp for the layout.
+    import struct
+
+    with open(fname, 'rb') as f:
+        header = f.read(64)
+    (magic, version, real_size, n_points, n_emissions, n_obs,
+     params_offset, records_offset, record_size) = struct.unpack('=8sIIQIIQQQ', header[:56])
+    if magic != b'CRNSWEEP':
+        raise ValueError(fname + " is not a sweep output file")
+    if version != 1:
+        raise ValueError("unsupported sweep output file version " + str(version))
+
+    dtype = np.float32 if real_size == 4 else np.float64
+    parameters = np.memmap(fname, dtype=dtype, mode='r', offset=params_offset,
+                           shape=(n_points, 2))
+    record_dtype = np.dtype([('status', np.uint64),
+                             ('brightness', dtype, (n_emissions, n_obs))])
+    assert record_dtype.itemsize == record_size
+    records = np.memmap(fname, dtype=record_dtype, mode='r', offset=records_offset,
+                        shape=(n_points,))
+
+    return {'parameters': np.array(parameters),
+            'done': records['status'] == 1,
+            'brightness': np.array(records['brightness'])}
@@ -0,0 +1,255 @@
+#include "RT_binary_file.hpp"
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using std::string;
+using std::vector;
+using std::uint32_t;
+using std::uint64_t;
+
+constexpr char RT_binary_format::magic[9];
+const uint32_t RT_binary_format::version;
+const uint32_t RT_binary_format::alignment;
+const std::size_t RT_binary_format::header_size;
+const std::size_t RT_binary_format::table_entry_size;
+const std::size_t RT_binary_format::max_name_length;
+
+namespace {
+  uint64_t aligned(const uint64_t offset) {
+    const uint64_t a = RT_binary_format::alignment;
+    return (offset + a - 1) / a * a;
+  }
+
+  template <typename T>
+  void put(vector<char> &buffer, const uint64_t offset, const T &value) {
+    std::memcpy(buffer.data() + offset, &value, sizeof(T));
+  }
+  template <typename T>
+  T get(const char *buffer, const uint64_t offset) {
+    T value;
+    std::memcpy(&value, buffer + offset, sizeof(T));
+    return value;
+  }
+}
+
+
+RT_binary_writer::RT_binary_writer(const string &content, const string &git_hash/* = ""*/) {
+  add_metadata("content", content);
+  add_metadata("git_hash", git_hash == "" ? "unknown" : git_hash);
+}
+
+void RT_binary_writer::add_metadata(const string &key, const string &value) {
+  assert(key.find_first_of("=\n") == string::npos
+	 && value.find('\n') == string::npos
+	 && "metadata keys cannot contain '=' or newlines, values cannot contain newlines");
+  metadata.emplace_back(key, value);
+}
+
+void RT_binary_writer::add_array(const string &name, const Real *data, const std::size_t n) {
+  assert(name.size() <= RT_binary_format::max_name_length && "array name too long");
+  array_entry entry;
+  entry.name = name;
+  entry.n_dims = 1;
+  entry.fortran_order = 0;
+  entry.shape[0] = n;
+  entry.shape[1] = 1;
+  entry.data.assign(data, data + n);
+  arrays.push_back(std::move(entry));
+}
+
+void RT_binary_writer::add_array(const string &name, const VectorX &vec) {
+  add_array(name, vec.data(), vec.size());
+}
+
+void RT_binary_writer::add_array(const string &name, const MatrixX &mat) {
+  add_array(name, mat.data(), mat.size());
+  array_entry &entry = arrays.back();
+  entry.n_dims = 2;
+  entry.fortran_order = MatrixX::IsRowMajor ? 0 : 1;
+  entry.shape[0] = mat.rows();
+  entry.shape[1] = mat.cols();
+}
+
+bool RT_binary_writer::write(const string &fname) const {
+  // lay out the whole file in memory so it goes to disk in one write
+  string metadata_text;
+  for (auto &kv : metadata)
+    metadata_text += kv.first + "=" + kv.second + "\n";
+
+  const uint64_t metadata_offset = RT_binary_format::header_size;
+  const uint64_t table_offset = aligned(metadata_offset + metadata_text.size());
+  uint64_t data_offset = aligned(table_offset + arrays.size()*RT_binary_format::table_entry_size);
+
+  vector<uint64_t> array_offsets;
+  for (auto &entry : arrays) {
+    array_offsets.push_back(data_offset);
+    data_offset = aligned(data_offset + entry.data.size()*sizeof(Real));
+  }
+
+  vector<char> buffer(data_offset, 0);
+
+  std::memcpy(buffer.data(), RT_binary_format::magic, 8);
+  put<uint32_t>(buffer,  8, RT_binary_format::version);
+  put<uint32_t>(buffer, 12, sizeof(Real));
+  put<uint64_t>(buffer, 16, metadata_offset);
+  put<uint64_t>(buffer, 24, metadata_text.size());
+  put<uint64_t>(buffer, 32, table_offset);
+  put<uint32_t>(buffer, 40, arrays.size());
+  put<uint32_t>(buffer, 44, RT_binary_format::alignment);
+
+  std::memcpy(buffer.data() + metadata_offset, metadata_text.data(), metadata_text.size());
+
+  for (unsigned int i=0;i<arrays.size();i++) {
+    const array_entry &entry = arrays[i];
+    const uint64_t entry_offset = table_offset + i*RT_binary_format::table_entry_size;
+    std::memcpy(buffer.data() + entry_offset, entry.name.data(), entry.name.size());
+    put<uint32_t>(buffer, entry_offset + 64, entry.n_dims);
+    put<uint32_t>(buffer, entry_offset + 68, entry.fortran_order);
+    put<uint64_t>(buffer, entry_offset + 72, entry.shape[0]);
+    put<uint64_t>(buffer, entry_offset + 80, entry.shape[1]);
+    put<uint64_t>(buffer, entry_offset + 88, array_offsets[i]);
+
+    std::memcpy(buffer.data() + array_offsets[i], entry.data.data(), entry.data.size()*sizeof(Real));
+  }
+
+  std::ofstream file(fname.c_str(), std::ios::binary);
+  if (!file.is_open())
+    return false;
+  file.write(buffer.data(), buffer.size());
+  return file.good();
+}
+
+
+RT_binary_file::RT_binary_file(const string &fname)
+  : base(NULL), file_size(0), file_version(0), file_real_size(0)
+{
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size >= (off_t) RT_binary_format::header_size) {
+    file_size = file_stat.st_size;
+    void *mapped = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped != MAP_FAILED)
+      base = mapped;
+  }
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+
+  if (base != NULL && !parse())
+    close();
+}
+
+RT_binary_file::~RT_binary_file() {
+  close();
+}
+
+void RT_binary_file::close() {
+  if (base != NULL)
+    munmap(base, file_size);
+  base = NULL;
+  file_size = 0;
+  file_metadata.clear();
+  index.clear();
+}
+
+bool RT_binary_file::parse() {
+  const char *buffer = static_cast<const char*>(base);
+
+  if (std::memcmp(buffer, RT_binary_format::magic, 8) != 0)
+    return false;
+  file_version = get<uint32_t>(buffer, 8);
+  file_real_size = get<uint32_t>(buffer, 12);
+  if (file_version != RT_binary_format::version
+      || (file_real_size != 4 && file_real_size != 8))
+    return false;
+
+  const uint64_t metadata_offset = get<uint64_t>(buffer, 16);
+  const uint64_t metadata_size = get<uint64_t>(buffer, 24);
+  const uint64_t table_offset = get<uint64_t>(buffer, 32);
+  const uint32_t n_arrays = get<uint32_t>(buffer, 40);
+  if (metadata_offset + metadata_size > file_size
+      || table_offset + n_arrays*RT_binary_format::table_entry_size > file_size)
+    return false;
+
+  std::istringstream metadata_text(string(buffer + metadata_offset, metadata_size));
+  string line;
+  while (std::getline(metadata_text, line)) {
+    const std::size_t eq = line.find('=');
+    if (eq != string::npos)
+      file_metadata[line.substr(0, eq)] = line.substr(eq+1);
+  }
+
+  for (uint32_t i=0;i<n_arrays;i++) {
+    const uint64_t entry_offset = table_offset + i*RT_binary_format::table_entry_size;
+    const char *name_start = buffer + entry_offset;
+    string name(name_start, strnlen(name_start, 64));
+
+    array_info info;
+    info.n_dims        = get<uint32_t>(buffer, entry_offset + 64);
+    info.fortran_order = get<uint32_t>(buffer, entry_offset + 68);
+    info.shape[0]      = get<uint64_t>(buffer, entry_offset + 72);
+    info.shape[1]      = get<uint64_t>(buffer, entry_offset + 80);
+    info.offset        = get<uint64_t>(buffer, entry_offset + 88);
+    if (info.offset + info.shape[0]*info.shape[1]*file_real_size > file_size)
+      return false;
+    index[name] = info;
+  }
+
+  return true;
+}
+
+bool RT_binary_file::is_open() const {
+  return base != NULL;
+}
+uint32_t RT_binary_file::version() const {
+  return file_version;
+}
+uint32_t RT_binary_file::real_size() const {
+  return file_real_size;
+}
+
+string RT_binary_file::metadata(const string &key) const {
+  auto it = file_metadata.find(key);
+  return it == file_metadata.end() ? "" : it->second;
+}
+const std::map<string, string> & RT_binary_file::all_metadata() const {
+  return file_metadata;
+}
+
+bool RT_binary_file::has_array(const string &name) const {
+  return index.find(name) != index.end();
+}
+vector<string> RT_binary_file::array_names() const {
+  std::vector<string> names;
+  for (auto &entry : index)
+    names.push_back(entry.first);
+  return names;
+}
+
+const RT_binary_file::array_info & RT_binary_file::get_array_info(const string &name) const {
+  assert(is_open() && "file must be open to read arrays");
+  assert(file_real_size == sizeof(Real) && "file was written with a different floating point width");
+  auto it = index.find(name);
+  assert(it != index.end() && "array not found in file");
+  return it->second;
+}
+
+Eigen::Map<const VectorX> RT_binary_file::vector(const string &name) const {
+  const array_info &info = get_array_info(name);
+  const Real *data = reinterpret_cast<const Real*>(static_cast<const char*>(base) + info.offset);
+  return Eigen::Map<const VectorX>(data, info.shape[0]*info.shape[1]);
+}
+
+Eigen::Map<const MatrixX> RT_binary_file::matrix(const string &name) const {
+  const array_info &info = get_array_info(name);
+  assert((info.n_dims == 1 || info.fortran_order == (MatrixX::IsRowMajor ? 0u : 1u))
+	 && "matrix storage order does not match MatrixX");
+  const Real *data = reinterpret_cast<const Real*>(static_cast<const char*>(base) + info.offset);
+  return Eigen::Map<const MatrixX>(data, info.shape[0], info.shape[1]);
+}
@@ -0,0 +1,140 @@
+//RT_binary_file.hpp -- versioned binary container for source functions and influence matrices
+
+#ifndef __RT_BINARY_FILE_H
+#define __RT_BINARY_FILE_H
+
+#include "Real.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// File layout, in native byte order. All offsets are in bytes from
+// the start of the file, and array data is aligned so the file can be
+// memory-mapped and used in place (see load_RT_binary in the Python
+// module for a NumPy loader).
+//
+//   header, 64 bytes
+//     char     magic[8]         "CRNRTBIN"
+//     uint32   version
+//     uint32   real_size        bytes per value in all arrays, 4 or 8
+//     uint64   metadata_offset
+//     uint64   metadata_size
+//     uint64   table_offset
+//     uint32   n_arrays
+//     uint32   alignment        of every array offset
+//     uint64   reserved[2]
+//   metadata, "key=value\n" lines
+//   array table, n_arrays entries of 96 bytes
+//     char     name[64]         NUL padded
+//     uint32   n_dims           1 or 2
+//     uint32   fortran_order    1 if 2D data is stored column-major
+//     uint64   shape[2]         shape[1] is 1 for 1D arrays
+//     uint64   offset
+//   array data
+
+struct RT_binary_format {
+  static constexpr char magic[9] = "CRNRTBIN";
+  static const std::uint32_t version = 1;
+  static const std::uint32_t alignment = 64;
+  static const std::size_t header_size = 64;
+  static const std::size_t table_entry_size = 96;
+  static const std::size_t max_name_length = 63;
+};
+
+// collects metadata and arrays, then writes the whole file at once
+class RT_binary_writer {
+  struct array_entry {
+    std::string name;
+    std::uint32_t n_dims;
+    std::uint32_t fortran_order;
+    std::uint64_t shape[2];
+    std::vector<Real> data;
+  };
+
+  std::vector<std::pair<std::string, std::string>> metadata;
+  std::vector<array_entry> arrays;
+
+public:
+  // content names what the file holds ("source_function",
+  // "influence_matrix"); git_hash identifies the code that wrote it
+  RT_binary_writer(const std::string &content, const std::string &git_hash = "");
+
+  void add_metadata(const std::string &key, const std::string &value);
+  template <typename T>
+  void add_metadata(const std::string &key, const T &value) {
+    std::ostringstream s;
+    s.precision(17);
+    s << value;
+    add_metadata(key, s.str());
+  }
+
+  // arrays are copied when added
+  void add_array(const std::string &name, const Real *data, const std::size_t n);
+  void add_array(const std::string &name, const VectorX &vec);
+  void add_array(const std::string &name, const MatrixX &mat);
+
+  bool write(const std::string &fname) const;
+};
+
+// read-only memory-mapped view of a file written by RT_binary_writer
+class RT_binary_file {
+  struct array_info {
+    std::uint32_t n_dims;
+    std::uint32_t fortran_order;
+    std::uint64_t shape[2];
+    std::uint64_t offset;
+  };
+
+  void *base;
+  std::size_t file_size;
+  std::uint32_t file_version;
+  std::uint32_t file_real_size;
+  std::map<std::string, std::string> file_metadata;
+  std::map<std::string, array_info> index;
+
+  void close();
+  bool parse();
+  const array_info & get_array_info(const std::string &name) const;
+
+public:
+  // maps the file; check is_open() before use
+  RT_binary_file(const std::string &fname);
+  ~RT_binary_file();
+  RT_binary_file(const RT_binary_file &copy) = delete;
+  RT_binary_file& operator=(const RT_binary_file &rhs) = delete;
+
+  bool is_open() const;
+  std::uint32_t version() const;
+  std::uint32_t real_size() const;
+
+  // returns "" for missing keys
+  std::string metadata(const std::string &key) const;
+  // parse a numeric value, returning false if missing or malformed
+  template <typename T>
+  bool metadata(const std::string &key, T &value) const {
+    auto it = file_metadata.find(key);
+    if (it == file_metadata.end())
+      return false;
+    std::istringstream s(it->second);
+    T parsed;
+    if (!(s >> parsed))
+      return false;
+    value = parsed;
+    return true;
+  }
+  const std::map<std::string, std::string> & all_metadata() const;
+
+  bool has_array(const std::string &name) const;
+  std::vector<std::string> array_names() const;
+
+  // views into the mapped file, valid while this object exists. The
+  // file must have been written with the same Real width.
+  Eigen::Map<const VectorX> vector(const std::string &name) const;
+  Eigen::Map<const MatrixX> matrix(const std::string &name) const;
+};
+
+#endif
@@ -12,6 +12,7 @@
 #include "atmo_vec.hpp"
 #include "grid/boundaries.hpp"
 #include "observation.hpp"
+#include "RT_binary_file.hpp"
 #include <string>
 #include <cassert>
 #include <type_traits>
@@ -142,17 +143,21 @@ struct RT_grid {
     for (int i_emission=0;i_emission<n_emissions;i_emission++)
       emissions[i_emission]->solve();
   }
+  // solve using the factorization each emission kept from an earlier
+  // solve (see emission_voxels::set_keep_factorization); returns false
+  // if any emission had to be factored again
+  bool solve_with_factorization() {
+    bool reused = true;
+    for (int i_emission=0;i_emission<n_emissions;i_emission++)
+      reused = emissions[i_emission]->solve_with_factorization() && reused;
+    return reused;
+  }
   //gpu stuff is defined in RT_gpu.cu
   void solve_gpu();
 
 
-  //generate source functions on the grid
-  void generate_S() {
-  
-    //start timing
-    my_clock clk;
-    clk.start();
-
+  // compute the influence matrix and single scattering in every voxel
+  void compute_influence() {
     atmo_vector vec;
 
     Real max_tau_species = 0;
@@ -163,7 +168,9 @@ struct RT_grid {
       for (int i_emission = 0; i_emission < n_emissions; i_emission++)
 	temp_influence[i_emission].init();
       
-#pragma omp for
+      // contiguous blocks of start voxels per thread, matching
+      // emission_voxels::reset_solution
+#pragma omp for schedule(static)
       for (int i_vox = 0; i_vox < grid.n_voxels; i_vox++) {
 	
 	Real omega = 0.0; // make sure sum(domega) = 4*pi
@@ -201,12 +208,25 @@ struct RT_grid {
       }
       
     }
-    
-    //solve for the source function
-    solve();
 
     //std::cout << "max_tau_species = " << max_tau_species << std::endl;
+  }
+
+  //generate source functions on the grid
+  void generate_S(const bool reuse_factorization = false) {
   
+    //start timing
+    my_clock clk;
+    clk.start();
+
+    compute_influence();
+    
+    //solve for the source function
+    if (reuse_factorization)
+      solve_with_factorization();
+    else
+      solve();
+
     // print time elapsed
     clk.stop();
 #ifdef __PRINT_ELAPSED_TIME_TERMINAL
@@ -216,7 +236,46 @@ struct RT_grid {
     
     return;
   }
+
+  // generate source functions, solving iteratively with a coarse grid
+  // correction instead of factoring each kernel (see
+  // emission_voxels::solve_two_level). voxel_interp interpolates from
+  // the coarse voxels to the voxels of this grid. Returns false if any
+  // emission had to be factored after all.
+  bool generate_S_two_level(const SparseMatrixX &voxel_interp) {
+    my_clock clk;
+    clk.start();
+
+    compute_influence();
+
+    bool converged = true;
+    for (int i_emission=0;i_emission<n_emissions;i_emission++)
+      converged = emissions[i_emission]->solve_two_level(voxel_interp) && converged;
+
+    clk.stop();
+#ifdef __PRINT_ELAPSED_TIME_TERMINAL
+    clk.print_elapsed("source function generation takes ");
+    std::cout << std::endl;
+#endif
+
+    return converged;
+  }
   void generate_S_gpu();
+
+  // error estimate for each radial layer of the current solution, the
+  // largest over the emissions (see grid_type::radial_layer_error)
+  vector<Real> radial_layer_error() const {
+    vector<Real> error;
+    for (int i_emission=0;i_emission<n_emissions;i_emission++) {
+      vector<Real> emission_error = grid.radial_layer_error(emissions[i_emission]->source_function(),
+							    emissions[i_emission]->species_dtau());
+      if (error.size() == 0)
+	error = emission_error;
+      for (unsigned int i=0;i<error.size();i++)
+	error[i] = std::max(error[i], emission_error[i]);
+    }
+    return error;
+  }
   
   void save_influence(const string fname = "test/influence_matrix.dat") const {
     std::ofstream file(fname);
@@ -229,6 +288,58 @@ struct RT_grid {
     grid.save_S(fname, emissions, n_emissions);
   }
 
+  static string binary_prefix(const int i_emission) {
+    return "emission_" + std::to_string(i_emission) + "/";
+  }
+  void add_binary_header(RT_binary_writer &writer) const {
+    grid.save_binary(writer);
+    writer.add_metadata("n_emissions", int(n_emissions));
+    for (int i_emission=0;i_emission<n_emissions;i_emission++)
+      writer.add_metadata("emission_" + std::to_string(i_emission), string(emissions[i_emission]->name()));
+  }
+
+  // binary versions of the above, readable with RT_binary_file or
+  // load_RT_binary in Python. Arrays for each emission are stored
+  // under "emission_<i>/", with the emission name in the metadata.
+  bool save_S_binary(const string fname, const string git_hash = "") const {
+    RT_binary_writer writer("source_function", git_hash);
+    add_binary_header(writer);
+    for (int i_emission=0;i_emission<n_emissions;i_emission++)
+      emissions[i_emission]->save_binary(writer, binary_prefix(i_emission));
+    return writer.write(fname);
+  }
+  // restore a solution written by save_S_binary, after which
+  // brightness can be called without generate_S. The influence
+  // matrix is not restored.
+  bool load_S_binary(const string fname) {
+    RT_binary_file file(fname);
+    if (!file.is_open()
+	|| file.metadata("content") != "source_function"
+	|| file.real_size() != sizeof(Real))
+      return false;
+
+    int file_n_emissions;
+    if (!file.metadata("n_emissions", file_n_emissions)
+	|| file_n_emissions != n_emissions)
+      return false;
+
+    if (!grid.load_binary(file))
+      return false;
+    for (int i_emission=0;i_emission<n_emissions;i_emission++)
+      if (!emissions[i_emission]->load_binary(file, binary_prefix(i_emission)))
+	return false;
+
+    return true;
+  }
+
+  bool save_influence_binary(const string fname, const string git_hash = "") const {
+    RT_binary_writer writer("influence_matrix", git_hash);
+    add_binary_header(writer);
+    for (int i_emission=0;i_emission<n_emissions;i_emission++)
+      emissions[i_emission]->save_influence_binary(writer, binary_prefix(i_emission));
+    return writer.write(fname);
+  }
+
   //interpolated brightness routine
   CUDA_CALLABLE_MEMBER
   void brightness(const atmo_vector &vec, 
@@ -5,6 +5,7 @@
 
 #include "cuda_compatibility.hpp"
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
 
 #ifdef RT_FLOAT
 
@@ -46,12 +47,28 @@ typedef Eigen::Matrix<float, Eigen::Dynamic, 1> VectorXf;
 typedef Eigen::Matrix<Real,
 		      Eigen::Dynamic, Eigen::Dynamic,
 		      Eigen::RowMajor> MatrixX;
+typedef Eigen::Matrix<float,
+		      Eigen::Dynamic, Eigen::Dynamic,
+		      Eigen::RowMajor> MatrixXf;
 #else
 typedef Eigen::Matrix<Real,
 		      Eigen::Dynamic, Eigen::Dynamic,
 		      Eigen::ColMajor> MatrixX;
+typedef Eigen::Matrix<float,
+		      Eigen::Dynamic, Eigen::Dynamic,
+		      Eigen::ColMajor> MatrixXf; // single precision kernel factors, see emission_voxels::set_mixed_precision
 #endif
 
+// influence matrices are assembled a row at a time, each row by one
+// thread, so they are stored row-major whatever the layout of MatrixX
+typedef Eigen::Matrix<Real,
+		      Eigen::Dynamic, Eigen::Dynamic,
+		      Eigen::RowMajor> RowMatrixX;
+
+// sparse matrices, for interpolation between grids and the influence
+// matrices of grids too large to store densely
+typedef Eigen::SparseMatrix<Real, Eigen::RowMajor> SparseMatrixX;
+
 
 
 // CUDA needs a constexpr sqrt in order to compile O_1026_tracker
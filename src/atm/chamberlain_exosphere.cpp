@@ -7,6 +7,13 @@ using std::pow;
 
 #include <boost/math/special_functions/gamma.hpp>
 
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include "atomic_file.hpp"
+
 chamberlain_exosphere::chamberlain_exosphere() { }
 chamberlain_exosphere::chamberlain_exosphere(const doubReal rexoo,
 					     const doubReal Texoo,
@@ -23,9 +30,6 @@ doubReal chamberlain_exosphere::n(const doubReal rr) const {
   // computes hydrogen number density as a function of altitude above
   // the exobase, assuming a chamberlain exosphere w/o satellite particles
   doubReal r = rr;
-  
-  using boost::math::gamma_p;
-
 
   if ((r-rexo)/rexo<ATMEPS) 
     //if we are very close to the exobase due to a rounding error,
@@ -33,6 +37,17 @@ doubReal chamberlain_exosphere::n(const doubReal rr) const {
     r = rexo;
     
   const doubReal lambda = G*mMars*m_species/(kB*Texo*r);//chamberlain lambda
+
+  // multiply by the exobase density and return
+  doubReal retval = nexo*n_over_nexo(lambda, lambdac);
+  assert(retval > 0 && "n must be positive");
+  
+  return retval;
+}
+
+doubReal chamberlain_exosphere::n_over_nexo(const doubReal lambda, const doubReal lambdac) {
+  using boost::math::gamma_p;
+
   const doubReal psione = lambda*lambda/(lambda+lambdac);
 
   //gamma_p = complementary normalized incomplete gamma function
@@ -51,11 +66,7 @@ doubReal chamberlain_exosphere::n(const doubReal rr) const {
   doubReal norm = (1.0 + g1c);
   frac /= norm;
 
-  // multiply by the exobase density and return
-  doubReal retval = nexo*frac*exp(lambda-lambdac);
-  assert(retval > 0 && "n must be positive");
-  
-  return retval;
+  return frac*exp(lambda-lambdac);
 }
 doubReal chamberlain_exosphere::operator()(const doubReal r) const {
   return this->n(r);
@@ -100,51 +111,333 @@ doubReal chamberlain_exosphere::r(const doubReal &ntarget) const {
   return r.first + (r.second - r.first)/2;
 }
 
+void chamberlain_exosphere::tabulate() {
+  const int i_node = chamberlain_exosphere_table::node_below(lambdac);
+  auto table_lo = chamberlain_exosphere_table::get(i_node);
+  auto table_hi = chamberlain_exosphere_table::get(i_node+1);
+  table = std::make_shared<const chamberlain_exosphere_table>(lambdac, *table_lo, *table_hi);
+}
 
+doubReal chamberlain_exosphere::n_interp(const doubReal r) const {
+  const doubReal x = r/rexo;
+  if (table && table->covers_x(x))
+    return nexo*exp(table->log_frac_at(log(x)));
+  else
+    return n(r);
+}
 
-Temp_converter::Temp_converter(const doubReal rexoo/* = rexo_typical*/, const doubReal m_speciess/* = mH*/)
+doubReal chamberlain_exosphere::r_interp(const doubReal ntarget) const {
+  const doubReal frac = ntarget/nexo;
+  if (table && table->covers_frac(frac))
+    return rexo*exp(table->log_x_at(log(frac)));
+  else
+    return r(ntarget);
+}
+
+void chamberlain_exosphere::n_interp(const vector<doubReal> &r, vector<doubReal> &n_out) const {
+  n_out.resize(r.size());
+
+  int j = 0;
+  for (unsigned int i=0; i<r.size(); i++) {
+    const doubReal x = r[i]/rexo;
+    if (table && table->covers_x(x))
+      n_out[i] = nexo*exp(table->log_frac_at(log(x), j));
+    else
+      n_out[i] = n(r[i]);
+  }
+}
+
+
+
+chamberlain_exosphere_table::chamberlain_exosphere_table(const doubReal lambdacc)
+  : lambdac(lambdacc)
+{
+  log_x.push_back(0.0);
+  log_frac.push_back(0.0);
+
+  doubReal lx = 0.0;
+  while (lx < log_x_max && log_frac.back() > log_frac_min) {
+    const doubReal lambda = lambdac*exp(-lx);
+    lx += std::min({dlog_x_max, dlog_frac_max/lambda, std::max(dlog_x_min, 0.1*lx)});
+
+    const doubReal frac = chamberlain_exosphere::n_over_nexo(lambdac*exp(-lx), lambdac);
+    if (!(frac > 0) || !(log(frac) < log_frac.back()))
+      // far from the exobase the expression loses precision to
+      // cancellation; stop here and let callers use the exact form
+      break;
+
+    log_x.push_back(lx);
+    log_frac.push_back(log(frac));
+  }
+
+  assert(log_x.size() > 1 && "table must contain at least one interval");
+}
+
+chamberlain_exosphere_table::chamberlain_exosphere_table(const doubReal lambdacc,
+							 const chamberlain_exosphere_table &lo,
+							 const chamberlain_exosphere_table &hi)
+  : lambdac(lambdacc)
+{
+  const doubReal w = (lambdac - lo.lambdac)/(hi.lambdac - lo.lambdac);
+
+  int j = 0;
+  for (unsigned int k=0; k<lo.log_x.size() && lo.log_x[k] <= hi.log_x.back(); k++) {
+    log_x.push_back(lo.log_x[k]);
+    log_frac.push_back((1.0-w)*lo.log_frac[k] + w*hi.log_frac_at(lo.log_x[k], j));
+  }
+
+  assert(log_x.size() > 1 && "table must contain at least one interval");
+}
+
+bool chamberlain_exosphere_table::covers_x(const doubReal x) const {
+  return x >= 1.0 && log(x) <= log_x.back();
+}
+
+bool chamberlain_exosphere_table::covers_frac(const doubReal frac) const {
+  return frac <= 1.0 && log(frac) >= log_frac.back();
+}
+
+doubReal chamberlain_exosphere_table::log_frac_at(const doubReal lx) const {
+  const int j = bracket_index(log_x, lx);
+  return linear_interp_at(log_x, log_frac, j, lx);
+}
+
+doubReal chamberlain_exosphere_table::log_frac_at(const doubReal lx, int &j) const {
+  // walk from the previous bracket if the grid is sorted, otherwise
+  // start over with a binary search
+  const int jmax = log_x.size()-2;
+  if (lx < log_x[j])
+    j = bracket_index(log_x, lx);
+  while (j < jmax && lx > log_x[j+1])
+    j++;
+  return linear_interp_at(log_x, log_frac, j, lx);
+}
+
+doubReal chamberlain_exosphere_table::log_x_at(const doubReal lf) const {
+  const int j = bracket_index(log_frac, lf);
+  return linear_interp_at(log_frac, log_x, j, lf);
+}
+
+int chamberlain_exosphere_table::node_below(const doubReal lambdac) {
+  return (int) std::floor(log(lambdac)/dlog_lambdac);
+}
+
+doubReal chamberlain_exosphere_table::node_lambdac(const int i_node) {
+  return exp(i_node*dlog_lambdac);
+}
+
+std::shared_ptr<const chamberlain_exosphere_table> chamberlain_exosphere_table::get(const int i_node) {
+  static std::mutex cache_mutex;
+  static std::map<int, std::shared_ptr<const chamberlain_exosphere_table>> cache;
+
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto found = cache.find(i_node);
+    if (found != cache.end())
+      return found->second;
+  }
+
+  // build outside the lock so other lookups are not held up
+  auto new_table = std::make_shared<const chamberlain_exosphere_table>(node_lambdac(i_node));
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  if (cache.size() >= max_cached_tables)
+    // tables already handed out stay alive through their shared_ptr
+    cache.clear();
+  auto inserted = cache.emplace(i_node, new_table);
+  return inserted.first->second;
+}
+
+
+Temp_converter_table::Temp_converter_table(const doubReal rexoo, const doubReal m_speciess)
   : rexo(rexoo), m_species(m_speciess)
 {
   for (int iT = 0;iT<nT;iT++) {
-    T_list[iT]   = Tmin  + iT*Tstep; 
-    lc_list[iT]  = lc_from_T_exact(T_list[iT]);
-    eff_list[iT] = eff_from_T_exact(T_list[iT]);
+    T_list.push_back(Tmin  + iT*Tstep);
+    lc_list.push_back(lc_from_T_exact(T_list[iT], rexo, m_species));
+    eff_list.push_back(eff_from_T_exact(T_list[iT], rexo, m_species));
   }
-  eff_spline = cardinal_cubic_b_spline<doubReal>(eff_list,
-					       nT,
-					       Tmin,
-					       Tstep);
+  setup_splines();
+}
+
+Temp_converter_table::Temp_converter_table(const doubReal rexoo, const doubReal m_speciess,
+					   const vector<doubReal> &lc_listt,
+					   const vector<doubReal> &eff_listt)
+  : rexo(rexoo), m_species(m_speciess), lc_list(lc_listt), eff_list(eff_listt)
+{
+  assert((int) lc_list.size() == nT && (int) eff_list.size() == nT
+	 && "table size must match nT");
+  for (int iT = 0;iT<nT;iT++)
+    T_list.push_back(Tmin  + iT*Tstep);
+  setup_splines();
+}
+
+void Temp_converter_table::setup_splines() {
+  eff_spline = cardinal_cubic_b_spline<doubReal>(eff_list.begin(),
+						 eff_list.end(),
+						 Tmin,
+						 Tstep);
   
-  lc_spline = cardinal_cubic_b_spline<doubReal>(lc_list,
-					      nT,
-					      Tmin,
-					      Tstep);
+  lc_spline = cardinal_cubic_b_spline<doubReal>(lc_list.begin(),
+						lc_list.end(),
+						Tmin,
+						Tstep);
+}
+
+doubReal Temp_converter_table::lc_from_T_exact(const doubReal T, const doubReal rexo, const doubReal m_species) {
+  return G*mMars*m_species/(kB*T*rexo);
+}
+doubReal Temp_converter_table::eff_from_T_exact(const doubReal T, const doubReal rexo, const doubReal m_species) {
+  doubReal lambdac = lc_from_T_exact(T, rexo, m_species);
+  return 0.5 * sqrt( 2.0*kB*T / (m_species*pi) ) * (1.0 + lambdac) * exp(-lambdac);
+}
+
+doubReal Temp_converter_table::T_from_eff(const doubReal eff) const {
+  return linear_interp_at(eff_list, T_list, bracket_index(eff_list, eff), eff);
+}
+doubReal Temp_converter_table::T_from_lc(const doubReal lc) const {
+  return linear_interp_at(lc_list, T_list, bracket_index(lc_list, lc), lc);
+}
+
+bool Temp_converter_table::save(const std::string &fname) const {
+  const std::string tmp_fname = atomic_file_temp_name(fname);
+  std::ofstream file(tmp_fname.c_str(), std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  const doubReal header[4] = {rexo, m_species, Tmin, Tmax};
+  const int nTfile = nT;
+  file.write(file_magic, 8);
+  file.write(reinterpret_cast<const char*>(&file_version), sizeof(int));
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(&nTfile), sizeof(int));
+  file.write(reinterpret_cast<const char*>(lc_list.data()), nT*sizeof(doubReal));
+  file.write(reinterpret_cast<const char*>(eff_list.data()), nT*sizeof(doubReal));
+  file.close();
+
+  return atomic_file_commit(tmp_fname, fname, file.good());
+}
+
+std::shared_ptr<const Temp_converter_table> Temp_converter_table::load(const std::string &fname) {
+  // returns nullptr if the file is missing or does not match this build
+  std::ifstream file(fname.c_str(), std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+    return nullptr;
+  if (file.tellg() != file_size)
+    // truncated or from a different table layout
+    return nullptr;
+  file.seekg(0);
 
-  vector<doubReal> Tvec(T_list,T_list+nT);
-  vector<doubReal> lcvec(lc_list,lc_list+nT);
-  vector<doubReal> effvec(eff_list,eff_list+nT);
-  inv_eff = Linear_interp<doubReal>(effvec,Tvec);
-  inv_lc = Linear_interp<doubReal>(lcvec,Tvec);
+  char magic[8];
+  int version, nTfile;
+  doubReal header[4];
+  file.read(magic, 8);
+  file.read(reinterpret_cast<char*>(&version), sizeof(int));
+  file.read(reinterpret_cast<char*>(header), sizeof(header));
+  file.read(reinterpret_cast<char*>(&nTfile), sizeof(int));
+  if (!file.good()
+      || std::string(magic, 8) != std::string(file_magic, 8)
+      || version != file_version
+      || header[2] != Tmin || header[3] != Tmax || nTfile != nT)
+    return nullptr;
+
+  vector<doubReal> lc(nT), eff(nT);
+  file.read(reinterpret_cast<char*>(lc.data()), nT*sizeof(doubReal));
+  file.read(reinterpret_cast<char*>(eff.data()), nT*sizeof(doubReal));
+  if (!file.good())
+    return nullptr;
+
+  return std::make_shared<const Temp_converter_table>(header[0], header[1], lc, eff);
+}
+
+namespace {
+  std::mutex Temp_converter_cache_mutex;
+  std::map<std::pair<doubReal, doubReal>,
+	   std::shared_ptr<const Temp_converter_table>> Temp_converter_cache;
+  std::string Temp_converter_cache_dir = "";
+}
+
+std::string Temp_converter_table::cache_fname(const std::string &dirname,
+					      const doubReal rexo,
+					      const doubReal m_species) {
+  std::ostringstream fname;
+  fname << dirname << "/Temp_converter_table_"
+	<< std::hexfloat << rexo << "_" << m_species << ".dat";
+  return fname.str();
+}
+
+void Temp_converter_table::set_cache_dir(const std::string &dirname) {
+  std::lock_guard<std::mutex> lock(Temp_converter_cache_mutex);
+  Temp_converter_cache_dir = dirname;
+}
+
+std::shared_ptr<const Temp_converter_table> Temp_converter_table::get(const doubReal rexo,
+								       const doubReal m_species) {
+  const std::pair<doubReal, doubReal> key(rexo, m_species);
+  std::string dirname;
+  {
+    std::lock_guard<std::mutex> lock(Temp_converter_cache_mutex);
+    auto found = Temp_converter_cache.find(key);
+    if (found != Temp_converter_cache.end())
+      return found->second;
+    dirname = Temp_converter_cache_dir;
+  }
+
+  // build (or load) outside the lock; if two threads race here the
+  // first table inserted wins and both get the same object
+  std::shared_ptr<const Temp_converter_table> new_table;
+  if (dirname != "") {
+    new_table = load(cache_fname(dirname, rexo, m_species));
+    if (new_table && (new_table->rexo != rexo || new_table->m_species != m_species))
+      new_table = nullptr;
+  }
+  if (!new_table) {
+    new_table = std::make_shared<const Temp_converter_table>(rexo, m_species);
+    if (dirname != "")
+      new_table->save(cache_fname(dirname, rexo, m_species));
+  }
+
+  std::lock_guard<std::mutex> lock(Temp_converter_cache_mutex);
+  auto inserted = Temp_converter_cache.emplace(key, new_table);
+  return inserted.first->second;
+}
+
+
+
+Temp_converter::Temp_converter(const doubReal rexoo/* = rexo_typical*/, const doubReal m_speciess/* = mH*/)
+  : rexo(rexoo), m_species(m_speciess)
+{ }
+
+const Temp_converter_table & Temp_converter::table() const {
+  std::shared_ptr<const Temp_converter_table> t = std::atomic_load(&table_ptr);
+  if (!t) {
+    t = Temp_converter_table::get(rexo, m_species);
+    std::atomic_store(&table_ptr, t);
+  }
+  return *t;
 }
 
 doubReal Temp_converter::lc_from_T_exact(const doubReal T) const {
-  return G*mMars*m_species/(kB*T*rexo);
+  return Temp_converter_table::lc_from_T_exact(T, rexo, m_species);
 }
 doubReal Temp_converter::eff_from_T_exact(const doubReal T) const {
-  doubReal lambdac = lc_from_T_exact(T);
-  return 0.5 * sqrt( 2.0*kB*T / (m_species*pi) ) * (1.0 + lambdac) * exp(-lambdac);
+  return Temp_converter_table::eff_from_T_exact(T, rexo, m_species);
 }
 
 doubReal Temp_converter::eff_from_T(const doubReal T) const {
-  return eff_spline(T);
+  return table().eff_spline(T);
 }
 doubReal Temp_converter::T_from_eff(const doubReal eff) const {
-  return inv_eff(eff);
+  return table().T_from_eff(eff);
 }
 
 doubReal Temp_converter::lc_from_T(const doubReal T) const {
-  return lc_spline(T);
+  return table().lc_spline(T);
 }
 doubReal Temp_converter::T_from_lc(const doubReal lc) const {
-  return inv_lc(lc);
+  return table().T_from_lc(lc);
+}
+
+void Temp_converter::set_table_cache_dir(const std::string &dirname) {
+  Temp_converter_table::set_cache_dir(dirname);
 }
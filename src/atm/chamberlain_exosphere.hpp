@@ -3,6 +3,67 @@
 
 #include "Real.hpp"
 #include "constants.hpp"
+#include <vector>
+#include <memory>
+#include <string>
+#include <ios>
+using std::vector;
+
+struct chamberlain_exosphere_table {
+  // tabulated Chamberlain profile n(r)/nexo. In units of x = r/rexo
+  // this ratio depends only on lambdac, so one table serves every
+  // exobase density and every (rexo, Texo, mass) with the same
+  // lambdac. Tables are built on a fixed grid of lambdac nodes and
+  // shared through get(); exospheres interpolate between the two
+  // nodes bracketing their lambdac (see chamberlain_exosphere).
+  doubReal lambdac;
+
+  // lambdac nodes are uniform in log(lambdac). log(n/nexo) is close
+  // to linear in lambdac at fixed x, so interpolating between nodes
+  // keeps the relative error in n and r below ~1e-4.
+  static constexpr doubReal dlog_lambdac = 0.02;
+  static int node_below(const doubReal lambdac);
+  static doubReal node_lambdac(const int i_node);
+
+  // table extent; outside this range callers fall back to the exact
+  // expressions in chamberlain_exosphere
+  static constexpr doubReal log_x_max = 9.21; // x ~ 1e4
+  static constexpr doubReal log_frac_min = -80.0; // frac ~ 1e-35
+
+  // step control: the local log slope of the profile is ~ -lambda,
+  // so steps are small near the exobase of heavy species and grow
+  // with altitude. The profile also has a square-root cusp at the
+  // exobase, so the first steps grow geometrically from dlog_x_min.
+  static constexpr doubReal dlog_frac_max = 0.05;
+  static constexpr doubReal dlog_x_max = 0.005;
+  static constexpr doubReal dlog_x_min = 1e-8;
+
+  // log-log table; log_frac is strictly decreasing, so piecewise
+  // linear interpolation is monotone in both directions
+  vector<doubReal> log_x;
+  vector<doubReal> log_frac;
+
+  chamberlain_exosphere_table(const doubReal lambdacc);
+  // interpolate linearly in lambdac between two tables, on the x
+  // grid of the first. This needs no special function evaluations.
+  chamberlain_exosphere_table(const doubReal lambdacc,
+			      const chamberlain_exosphere_table &lo,
+			      const chamberlain_exosphere_table &hi);
+
+  bool covers_x(const doubReal x) const;
+  bool covers_frac(const doubReal frac) const;
+
+  // log(n/nexo) at log(x), x = r/rexo, and the inverse. The second
+  // form starts from the bracket j found by the previous call, which
+  // is fastest when evaluating a sorted grid.
+  doubReal log_frac_at(const doubReal lx) const;
+  doubReal log_frac_at(const doubReal lx, int &j) const;
+  doubReal log_x_at(const doubReal lf) const;
+
+  // process-wide cache of tables keyed by lambdac node (thread safe)
+  static std::shared_ptr<const chamberlain_exosphere_table> get(const int i_node);
+  static const unsigned int max_cached_tables = 256;
+};
 
 struct chamberlain_exosphere {
   doubReal rexo;
@@ -19,6 +80,21 @@ struct chamberlain_exosphere {
   doubReal n(const doubReal r) const;
   doubReal operator()(doubReal r) const; //alias for n
 
+  // n/nexo as a function of the chamberlain lambda at r and the exobase
+  static doubReal n_over_nexo(const doubReal lambda, const doubReal lambdac);
+
+  // tabulated profile for this lambdac, interpolated from the shared
+  // tables at the lambdac nodes on either side
+  std::shared_ptr<const chamberlain_exosphere_table> table;
+  void tabulate();
+
+  // interpolated versions of n and r, falling back to the exact
+  // functions if tabulate() has not been called or if the argument
+  // is outside the table range
+  doubReal n_interp(const doubReal r) const;
+  doubReal r_interp(const doubReal ntarget) const;
+  void n_interp(const vector<doubReal> &r, vector<doubReal> &n_out) const;
+
   template <typename T>
   struct nfinder {
     const T *parent;
@@ -42,9 +118,10 @@ struct chamberlain_exosphere {
 #include <boost/math/interpolators/cardinal_cubic_b_spline.hpp>
 using boost::math::interpolators::cardinal_cubic_b_spline;
 
-class Temp_converter {
-  //class to convert between exobase temperature and escape fraction
-protected:
+struct Temp_converter_table {
+  //tabulated exobase temperature <-> escape parameters for one
+  //(rexo, m_species). Tables are immutable once built and shared
+  //between all Temp_converters through get().
   const doubReal rexo;
   const doubReal m_species;
   static constexpr doubReal  Tmin = 100;
@@ -52,15 +129,53 @@ protected:
   static const        int    nT = 1101;
   static constexpr doubReal Tstep = (Tmax-Tmin)/(nT-1);
 
-
   //forward
-  doubReal T_list[nT];
-  doubReal lc_list[nT];
-  doubReal eff_list[nT];
+  vector<doubReal> T_list;
+  vector<doubReal> lc_list;
+  vector<doubReal> eff_list;
   cardinal_cubic_b_spline<doubReal> eff_spline;
   cardinal_cubic_b_spline<doubReal> lc_spline;
-  Linear_interp<doubReal> inv_eff;
-  Linear_interp<doubReal> inv_lc;
+  //inverse lookups use bracket_index, which is safe to share between threads
+
+  Temp_converter_table(const doubReal rexoo, const doubReal m_speciess);
+  Temp_converter_table(const doubReal rexoo, const doubReal m_speciess,
+		       const vector<doubReal> &lc_listt, const vector<doubReal> &eff_listt);
+
+  static doubReal lc_from_T_exact(const doubReal T, const doubReal rexo, const doubReal m_species);
+  static doubReal eff_from_T_exact(const doubReal T, const doubReal rexo, const doubReal m_species);
+
+  doubReal T_from_eff(const doubReal eff) const;
+  doubReal T_from_lc(const doubReal lc) const;
+
+  //binary table file: magic, version, rexo, m_species, Tmin, Tmax, nT,
+  //then nT doubles each of lc and eff
+  static constexpr char file_magic[9] = "TCONVTAB";
+  static constexpr int file_version = 1;
+  static constexpr std::streamoff file_size = (8 + 2*sizeof(int) + 4*sizeof(doubReal)
+					       + 2*nT*sizeof(doubReal));
+  bool save(const std::string &fname) const;
+  static std::shared_ptr<const Temp_converter_table> load(const std::string &fname);
+
+  //process-wide cache keyed by (rexo, m_species), thread safe. If a
+  //cache directory is set, tables are read from there when present
+  //and written there after they are computed.
+  static std::shared_ptr<const Temp_converter_table> get(const doubReal rexo, const doubReal m_species);
+  static void set_cache_dir(const std::string &dirname);
+  static std::string cache_fname(const std::string &dirname, const doubReal rexo, const doubReal m_species);
+
+protected:
+  void setup_splines();
+};
+
+class Temp_converter {
+  //class to convert between exobase temperature and escape fraction
+protected:
+  const doubReal rexo;
+  const doubReal m_species;
+
+  //tables are looked up on first use, so constructing a converter is free
+  mutable std::shared_ptr<const Temp_converter_table> table_ptr;
+  const Temp_converter_table & table() const;
 public:
   Temp_converter(const doubReal rexoo = rexo_typical, const doubReal m_speciess = mH);
 
@@ -72,6 +187,8 @@ public:
 
   doubReal lc_from_T(const doubReal T) const; 
   doubReal T_from_lc(const doubReal eff) const;
+
+  static void set_table_cache_dir(const std::string &dirname);
 };
 
 
@@ -11,6 +11,14 @@ using boost::numeric::odeint::integrate_const;
 #include <boost/numeric/odeint/stepper/runge_kutta4.hpp>
 using boost::numeric::odeint::runge_kutta4;
 
+#include <boost/numeric/odeint/integrate/integrate_times.hpp>
+using boost::numeric::odeint::integrate_times;
+
+#include <boost/numeric/odeint/stepper/runge_kutta_dopri5.hpp>
+#include <boost/numeric/odeint/stepper/generation.hpp>
+using boost::numeric::odeint::runge_kutta_dopri5;
+using boost::numeric::odeint::make_dense_output;
+
 #include "push_back.hpp"
 
 species_density_parameters::species_density_parameters(const doubReal masss,
@@ -76,6 +84,118 @@ void species_density_parameters::get_thermosphere_density_exact(const doubReal &
   n_species = exp(log_n_species_thermosphere_tmp.back());
 }
 
+bool species_density_parameters::can_reuse_solution(const doubReal &n_species_exo,
+						    const doubReal &n_CO2_exo,
+						    const doubReal &rmin,
+						    const int n_thermosphere_steps) const {
+  if (!reuse_thermosphere_solution || !last_solution.valid)
+    return false;
+
+  const vector<doubReal> temp_parameters = temp->profile_parameters();
+  if (temp_parameters.empty())
+    return false;
+
+  // escape_flux is nexo * effusion velocity, so its ratio to nexo
+  // only matches to rounding
+  const doubReal flux_per_n = escape_flux/n_species_exo;
+  const doubReal last_flux_per_n = last_solution.escape_flux_per_n_species;
+  const bool same_flux = (std::abs(flux_per_n - last_flux_per_n)
+			  <= 1e-12*std::abs(last_flux_per_n));
+
+  return (last_solution.n_CO2_exo == n_CO2_exo
+	  && last_solution.rexo == rexo
+	  && last_solution.rmin == rmin
+	  && last_solution.n_thermosphere_steps == n_thermosphere_steps
+	  && last_solution.adaptive_integration == adaptive_integration
+	  && last_solution.temp_parameters == temp_parameters
+	  && same_flux);
+}
+
+void species_density_parameters::integrate_thermosphere(const doubReal &n_species_exo,
+							const doubReal &n_CO2_exo,
+							const doubReal &rmin,
+							vector<doubReal> &log_nCO2_thermosphere,
+							vector<doubReal> &log_n_species_thermosphere,
+							vector<doubReal> &r_thermosphere,
+							const int n_thermosphere_steps,
+							bool get_interpolation_points) {
+  // expects rexo, escape_flux, and temp to be set by the caller
+
+  // reset the thermosphere vectors
+  log_nCO2_thermosphere.clear();
+  log_n_species_thermosphere.clear();
+  r_thermosphere.clear();
+
+  // odeint copies the system, so pass a reference to the derived object
+  auto system = [this](const vector<doubReal> &x, vector<doubReal> &dxdr, const doubReal &r) {
+    (*this)(x, dxdr, r);
+  };
+  
+  //integrate to get the species densities in the thermosphere
+  vector<doubReal> nexo(2);
+  nexo[0] = log(n_CO2_exo);
+  nexo[1] = log(n_species_exo);
+
+  doubReal thermosphere_step_r = -(rexo-rmin)/(n_thermosphere_steps-1.);
+
+  if (!get_interpolation_points) {
+    // integrate with a variable step size to the requested r
+    integrate( system , nexo , rexo , rmin , thermosphere_step_r);
+    log_nCO2_thermosphere.push_back(nexo[0]);
+    log_n_species_thermosphere.push_back(nexo[1]);
+    return;
+  }
+
+  // escape_flux scales with n_species_exo, so only the offset changes
+  if (escape_flux > 0 && can_reuse_solution(n_species_exo, n_CO2_exo, rmin, n_thermosphere_steps)) {
+    const doubReal log_scale = log(n_species_exo/last_solution.n_species_exo);
+    log_nCO2_thermosphere = last_solution.log_nCO2;
+    r_thermosphere = last_solution.r;
+    for (auto &&log_n : last_solution.log_n_species)
+      log_n_species_thermosphere.push_back(log_n + log_scale);
+    return;
+  }
+
+  if (adaptive_integration) {
+    // error-controlled steps, with dense output sampled on an evenly
+    // spaced grid so the arrays can be interpolated as before
+    vector<doubReal> r_out(n_thermosphere_steps);
+    for (int i = 0; i < n_thermosphere_steps; i++)
+      r_out[i] = rexo + i*thermosphere_step_r;
+    r_out.back() = rmin;
+
+    integrate_times( make_dense_output( adaptive_abs_tol , adaptive_rel_tol ,
+					runge_kutta_dopri5< vector<doubReal> >() ),
+		     system , nexo , r_out.begin() , r_out.end() , thermosphere_step_r,
+		     push_back_quantities( &log_nCO2_thermosphere,
+					   &log_n_species_thermosphere,
+					   &r_thermosphere ) );
+  } else {
+    //use a constant stepper for easy interpolation
+    runge_kutta4< vector<doubReal> > stepper;
+    integrate_const( stepper , system ,
+		     nexo , rexo , rmin , thermosphere_step_r,
+		     push_back_quantities( &log_nCO2_thermosphere,
+					   &log_n_species_thermosphere,
+					   &r_thermosphere ) );
+  }
+
+  if (escape_flux > 0) {
+    last_solution.valid = true;
+    last_solution.n_species_exo = n_species_exo;
+    last_solution.n_CO2_exo = n_CO2_exo;
+    last_solution.rexo = rexo;
+    last_solution.rmin = rmin;
+    last_solution.escape_flux_per_n_species = escape_flux/n_species_exo;
+    last_solution.temp_parameters = temp->profile_parameters();
+    last_solution.n_thermosphere_steps = n_thermosphere_steps;
+    last_solution.adaptive_integration = adaptive_integration;
+    last_solution.log_nCO2 = log_nCO2_thermosphere;
+    last_solution.log_n_species = log_n_species_thermosphere;
+    last_solution.r = r_thermosphere;
+  }
+}
+
 hydrogen_density_parameters::hydrogen_density_parameters(const doubReal mass/* =mH */)
   : species_density_parameters(mass, alpha_hydrogen, diffusion_coefs(DH0_hydrogen, s_hydrogen) )
 { }
@@ -126,33 +246,15 @@ void hydrogen_density_parameters::get_thermosphere_density_arrays(const doubReal
   rexo = rexoo;
   escape_flux = escape_fluxx;
   temp = tempp;
-  
-  // reset the thermosphere vectors
-  log_nCO2_thermosphere.clear();
-  log_n_species_thermosphere.clear();
-  r_thermosphere.clear();
-  
-  //integrate to get the species densities in the thermosphere
-  vector<doubReal> nexo(2);
-  nexo[0] = log(n_CO2_exo);
-  nexo[1] = log(n_species_exo);
-
-  doubReal thermosphere_step_r = -(rexo-r)/(n_thermosphere_steps-1.);
 
-  if (get_interpolation_points) {
-    //use a constant stepper for easy interpolation
-    runge_kutta4< vector<doubReal> > stepper;
-    integrate_const( stepper , *this ,
-		     nexo , rexo , r , thermosphere_step_r,
-		     push_back_quantities( &log_nCO2_thermosphere,
-					   &log_n_species_thermosphere,
-					   &r_thermosphere ) );
-  } else {
-    // integrate with a variable step size to the requested r
-    integrate( *this , nexo , rexo , r , thermosphere_step_r);
-    log_nCO2_thermosphere.push_back(nexo[0]);
-    log_n_species_thermosphere.push_back(nexo[1]);
-  }
+  integrate_thermosphere(n_species_exo,
+			 n_CO2_exo,
+			 r,
+			 log_nCO2_thermosphere,
+			 log_n_species_thermosphere,
+			 r_thermosphere,
+			 n_thermosphere_steps,
+			 get_interpolation_points);
 }
 
 
@@ -269,31 +371,16 @@ void oxygen_density_parameters::get_thermosphere_density_arrays(const doubReal &
   rexo = rexoo;
   escape_flux = escape_fluxx;
   temp = tempp;
-  
-  // reset the thermosphere vectors
-  log_nCO2_thermosphere.clear();
-  log_n_species_thermosphere.clear();
-  r_thermosphere.clear();
-  
-  //integrate to get the species densities in the thermosphere
-  vector<doubReal> nexo(2);
-  nexo[0] = log(n_CO2_exo);
-  nexo[1] = log(n_species_exo); // atomic oxygen density
-
-  doubReal thermosphere_step_r = -(rexo-r)/(n_thermosphere_steps-1.);
 
-  if (get_interpolation_points) {
-    //use a constant stepper for easy interpolation
-    runge_kutta4< vector<doubReal> > stepper;
-    integrate_const( stepper , *this ,
-		     nexo , rexo , r , thermosphere_step_r,
-		     push_back_quantities( &log_nCO2_thermosphere,
-					   &log_n_species_thermosphere,
-					   &r_thermosphere ) );
-  } else {
-    // integrate with a variable step size to the requested r
-    integrate( *this , nexo , rexo , r , thermosphere_step_r);
-    log_nCO2_thermosphere.push_back(nexo[0]);
-    log_n_species_thermosphere.push_back(nexo[2]);
-  }
+  // flux_O in operator() is currently zero, so the equations are
+  // still linear in nO and the shared integration (including reuse of
+  // the last solution) applies
+  integrate_thermosphere(n_species_exo,
+			 n_CO2_exo,
+			 r,
+			 log_nCO2_thermosphere,
+			 log_n_species_thermosphere,
+			 r_thermosphere,
+			 n_thermosphere_steps,
+			 get_interpolation_points);
 }
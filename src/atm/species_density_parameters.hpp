@@ -20,6 +20,18 @@ struct species_density_parameters {
   doubReal rexo;
   temperature *temp; // pointer to temperature, needed by operator () to get derivatives
 
+  // integration options for the interpolation arrays. The adaptive
+  // path uses an error-controlled dense-output stepper and samples it
+  // onto the output grid; otherwise a fixed-step RK4 is used.
+  bool adaptive_integration = true;
+  static constexpr doubReal adaptive_abs_tol = 1e-10;
+  static constexpr doubReal adaptive_rel_tol = 1e-10;
+
+  // if only n_species_exo changes between calls, the solution for
+  // log(n_species) shifts by a constant and log(nCO2) is unchanged, so
+  // the last solution can be rescaled instead of integrated again
+  bool reuse_thermosphere_solution = true;
+
   species_density_parameters(const doubReal masss,
 			     const doubReal alphaa,
 			     diffusion_coefs difff);
@@ -63,6 +75,40 @@ struct species_density_parameters {
 				      const doubReal &r, 
 				      doubReal &nCO2,
 				      doubReal &n_species);
+
+protected:
+  // shared implementation of get_thermosphere_density_arrays for
+  // species whose equations are linear in the species density
+  void integrate_thermosphere(const doubReal &n_species_exo,
+			      const doubReal &n_CO2_exo,
+			      const doubReal &rmin,
+			      vector<doubReal> &log_nCO2_thermosphere,
+			      vector<doubReal> &log_n_species_thermosphere,
+			      vector<doubReal> &r_thermosphere,
+			      const int n_thermosphere_steps,
+			      bool get_interpolation_points);
+
+  // last solution of the interpolation arrays and the inputs that produced it
+  struct thermosphere_solution {
+    bool valid = false;
+    doubReal n_species_exo;
+    doubReal n_CO2_exo;
+    doubReal rexo;
+    doubReal rmin;
+    doubReal escape_flux_per_n_species;
+    vector<doubReal> temp_parameters;
+    int n_thermosphere_steps;
+    bool adaptive_integration;
+
+    vector<doubReal> log_nCO2;
+    vector<doubReal> log_n_species;
+    vector<doubReal> r;
+  } last_solution;
+
+  bool can_reuse_solution(const doubReal &n_species_exo,
+			  const doubReal &n_CO2_exo,
+			  const doubReal &rmin,
+			  const int n_thermosphere_steps) const;
 };
 
 
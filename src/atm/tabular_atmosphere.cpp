@@ -51,13 +51,14 @@ void tabular_atmosphere::init_exosphere() {
     
     //set up the exosphere from the values at the exobase
     exosphere = chamberlain_exosphere(rexo, T_exo, n_species_exo, m_species);
+    exosphere.tabulate();
 };
 
 doubReal tabular_atmosphere::n_species(const doubReal &r) const {
   assert(log_n_species_spline.n > 0 && "n_species must be initialized!");
 
   if (compute_exosphere && r>rexo) {
-    return exosphere.n(r);
+    return exosphere.n_interp(r);
   } else  
     return exp(log_n_species_spline((r-rMars)/1e5));
 }
@@ -65,7 +66,7 @@ doubReal tabular_atmosphere::n_species(const doubReal &r) const {
 doubReal tabular_atmosphere::r_from_n_species(const doubReal &n_species_target) const {
   assert(inv_log_n_species_spline.n > 0 && "n_species must be initialized!");
   if (compute_exosphere && n_species_target < n_species(rexo))
-    return exosphere.r(n_species_target);
+    return exosphere.r_interp(n_species_target);
   else
     return inv_log_n_species_spline(log(n_species_target))*1e5 + rMars;
 }
@@ -20,6 +20,10 @@ doubReal temperature::Tprime(const doubReal &r) {
   return Tprime_internal;
 }
 
+vector<doubReal> temperature::profile_parameters() const {
+  return vector<doubReal>();
+}
+
 krasnopolsky_temperature::krasnopolsky_temperature(doubReal T_exoo/* = 200*/,
 						   doubReal T_tropoo/* = 125*/,
 						   doubReal r_tropoo/* = rMars + 90e5 */,
@@ -46,3 +50,7 @@ void krasnopolsky_temperature::get(const doubReal &r) {
     Tprime_internal = 0;
   }
 }
+
+vector<doubReal> krasnopolsky_temperature::profile_parameters() const {
+  return {T_exo, T_tropo, r_tropo, shape_parameter};
+}
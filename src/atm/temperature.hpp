@@ -3,6 +3,8 @@
 
 #include "Real.hpp"
 #include "constants.hpp"
+#include <vector>
+using std::vector;
 
 //generic temperature class
 struct temperature {
@@ -22,6 +24,11 @@ public:
 
   doubReal T(const doubReal &r);
   doubReal Tprime(const doubReal &r);
+
+  // parameters that fully determine the profile, used to decide
+  // whether a thermosphere solution can be reused. Empty means the
+  // profile cannot be compared and solutions are never reused.
+  virtual vector<doubReal> profile_parameters() const;
 };
 
 struct krasnopolsky_temperature : virtual public temperature {
@@ -36,6 +43,8 @@ protected:
   void get(const doubReal &r) override;
 
 public:
+  vector<doubReal> profile_parameters() const override;
+
   krasnopolsky_temperature(doubReal T_exoo = 200.0,
 			   doubReal T_tropoo = 125.0,
 			   doubReal r_tropoo = rMars + 90e5,
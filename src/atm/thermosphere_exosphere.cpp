@@ -63,7 +63,8 @@ void thermosphere_exosphere::setup_nspmin_nCO2exo(doubReal rminn,
 						 temperature *tempp)
 {
   //set the max altitude by finding the density at which the exosphere = n_species_min
-  doubReal rmaxx = exosphere.r(n_species_min);
+  exosphere.tabulate();
+  doubReal rmaxx = exosphere.r_interp(n_species_min);
   
   setup_rmax_nCO2exo(rminn,
 		     rexoo,
@@ -110,6 +111,7 @@ void thermosphere_exosphere::setup_rmax_nCO2exo(doubReal rminn,
   temp = tempp;
 
   exosphere = chamberlain_exosphere(rexoo, temp->T_exo, n_species_exo, species_thermosphere->mass);
+  exosphere.tabulate();
   species_thermosphere->get_thermosphere_density_arrays(n_species_exo,
 							nCO2exo,
 							rexo,
@@ -125,6 +127,7 @@ void thermosphere_exosphere::setup_rmax_nCO2exo(doubReal rminn,
 							/*get_interpolation_points = */true);
 
   CO2_exosphere = chamberlain_exosphere(rexoo, temp->T_exo, nCO2exo, mCO2);
+  CO2_exosphere.tabulate();
 
 #ifndef DNDEBUG
   //check the thermosphere values for any negatives
@@ -145,28 +148,21 @@ void thermosphere_exosphere::setup_rmax_nCO2exo(doubReal rminn,
   n_species_rmindiffusion = n_species(rmindiffusion);
   nCO2rmindiffusion = nCO2(rmindiffusion);
     
-  //now get the interpolation points in the exosphere
+  //sample the exosphere for output, densities come from the shared table
+  log_r_exosphere.clear();
+  log_n_species_exosphere.clear();
   exosphere_step_logr = (log(rmax) - log(rexo))/(n_exosphere_steps - 1.);
+  vector<doubReal> r_exosphere;
   for (int iexo = 0; iexo < n_exosphere_steps; iexo++) {
     log_r_exosphere.push_back( log(rexo) + iexo * exosphere_step_logr );
     assert(log_r_exosphere.back() > 0 && "radii must be positive");
-    log_n_species_exosphere.push_back( log( exosphere( exp( log_r_exosphere[iexo] ) ) ) );
-    assert(exp(log_n_species_exosphere.back()) > 0 && "densities must be positive");
+    r_exosphere.push_back( exp( log_r_exosphere[iexo] ) );
   }
-  log_n_species_exosphere_spline = Linear_interp<doubReal>(log_r_exosphere,log_n_species_exosphere);
-  invlog_n_species_exosphere = Linear_interp<doubReal>(log_n_species_exosphere,log_r_exosphere);
-
-
-  exosphere_step_CO2_logr = (log(CO2_exo_zero_level) - log(rexo))/(n_exosphere_steps - 1.);
-  for (int iexo = 0; iexo < n_exosphere_steps; iexo++) {
-    log_r_CO2_exosphere.push_back( log(rexo) + iexo * exosphere_step_CO2_logr );
-    assert(log_r_CO2_exosphere.back() > 0 && "radii must be positive");
-    log_n_CO2_exosphere.push_back( log( CO2_exosphere( exp( log_r_CO2_exosphere[iexo] ) ) ) );
-    assert(exp(log_n_CO2_exosphere.back()) > 0 && "densities must be positive");
+  exosphere.n_interp(r_exosphere, log_n_species_exosphere);
+  for (auto &n : log_n_species_exosphere) {
+    assert(n > 0 && "densities must be positive");
+    n = log(n);
   }
-  log_n_CO2_exosphere_spline = Linear_interp<doubReal>(log_r_CO2_exosphere,log_n_CO2_exosphere);
-  invlog_n_CO2_exosphere = Linear_interp<doubReal>(log_n_CO2_exosphere,log_r_CO2_exosphere);
-
 
   init=true;
 }
@@ -176,7 +172,7 @@ doubReal thermosphere_exosphere::nCO2(const doubReal &r) const {
   if (r>CO2_exo_zero_level)
     return 0.0;
   else if (r>rexo && CO2_exo_zero_level!=rexo)
-    return exp(log_n_CO2_exosphere_spline(log(r)));
+    return CO2_exosphere.n_interp(r);
   else {
     assert(r>=rmin && "r must be above the lower boundary of the atmosphere.");
     return exp(log_nCO2_thermosphere_spline(r));
@@ -188,7 +184,7 @@ doubReal thermosphere_exosphere::n_absorber(const doubReal &r) const  {
 
 doubReal thermosphere_exosphere::n_species(const doubReal &r) const {
   if (r>=rexo)
-    return exp(log_n_species_exosphere_spline(log(r)));
+    return exosphere.n_interp(r);
   else {
     if (r>=rmindiffusion)
       return exp(log_n_species_thermosphere_spline(r));
@@ -207,7 +203,7 @@ doubReal thermosphere_exosphere::r_from_n_species(const doubReal &nsptarget) con
   if (nsptarget==n_species_exo) {
     return rexo;
   } else if (nsptarget<n_species_exo) {
-    return exp(invlog_n_species_exosphere(log(nsptarget)));
+    return exosphere.r_interp(nsptarget);
   } else if (nsptarget>n_species_rmindiffusion) {
     return invlog_nCO2_thermosphere(log(nsptarget*nCO2rmindiffusion/n_species_rmindiffusion));
   } else {
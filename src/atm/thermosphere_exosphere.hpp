@@ -51,20 +51,14 @@ struct thermosphere_exosphere : virtual public atmosphere {
   Linear_interp<doubReal> log_n_species_thermosphere_spline;
   Linear_interp<doubReal> invlog_n_species_thermosphere;
   
-  //exosphere interpolation
+  //exosphere interpolation uses the shared Chamberlain tables, these
+  //samples are kept for save()
   static const int n_exosphere_steps = 100;
   doubReal exosphere_step_logr;
   vector<doubReal> log_n_species_exosphere;
   vector<doubReal> log_r_exosphere;
-  Linear_interp<doubReal> log_n_species_exosphere_spline;
-  Linear_interp<doubReal> invlog_n_species_exosphere;
 
   doubReal CO2_exo_zero_level = rexo + 500e5;
-  doubReal exosphere_step_CO2_logr;
-  vector<doubReal> log_n_CO2_exosphere;
-  vector<doubReal> log_r_CO2_exosphere;
-  Linear_interp<doubReal> log_n_CO2_exosphere_spline;
-  Linear_interp<doubReal> invlog_n_CO2_exosphere;
 
   thermosphere_exosphere(doubReal n_species_exoo, // for H, a good number is 10^5-6
 			 doubReal nCO2exoo, // a good number is ~10^9
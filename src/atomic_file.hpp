@@ -0,0 +1,37 @@
+//atomic_file.hpp -- write cache files so readers never see a partial file
+
+#ifndef __atomic_file_H
+#define __atomic_file_H
+
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// Cache files are written under a name unique to this process and
+// thread, then renamed over the final name. rename() replaces the
+// target atomically, so a concurrent reader (another worker sharing
+// the cache directory) sees either the old file, the complete new
+// one, or nothing, and an interrupted write leaves only a stray
+// temporary file.
+inline std::string atomic_file_temp_name(const std::string &fname) {
+  std::ostringstream tmp;
+  tmp << fname << ".tmp." << getpid()
+      << "." << std::hash<std::thread::id>()(std::this_thread::get_id());
+  return tmp.str();
+}
+
+// rename the finished temporary file into place, or remove it if the
+// write failed. Returns whether fname now holds the new file.
+inline bool atomic_file_commit(const std::string &tmp_fname,
+			       const std::string &fname,
+			       const bool write_ok) {
+  if (write_ok && std::rename(tmp_fname.c_str(), fname.c_str()) == 0)
+    return true;
+  std::remove(tmp_fname.c_str());
+  return false;
+}
+
+#endif
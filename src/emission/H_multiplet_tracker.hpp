@@ -145,6 +145,10 @@ struct H_lyman_multiplet_tracker {
   typename std::conditional<is_influence,
 			    voxel_array<N_VOXELS, n_upper>,
 			    Real>::type influence[n_upper];
+  // voxels with nonzero influence, so reset only zeroes those
+  typename std::conditional<is_influence,
+			    voxel_index_list<N_VOXELS>,
+			    empty_voxel_index_list>::type influence_voxels;
   
   // keep track of origin temperature and density for computing influence coefficients
   Real species_T_at_origin;
@@ -198,6 +202,9 @@ struct H_lyman_multiplet_tracker {
   CUDA_CALLABLE_MEMBER
   void init() {
     max_tau_species = 0.0;
+    for (int i_upper = 0; i_upper<n_upper; i_upper++)
+      influence[i_upper] = 0.0;
+    influence_voxels.clear();
   }
   
   CUDA_CALLABLE_MEMBER
@@ -221,8 +228,7 @@ struct H_lyman_multiplet_tracker {
       species_col_dens[i_lower] = 0.0;
     }
     
-    for (int i_upper = 0; i_upper<n_upper; i_upper++)
-      influence[i_upper] = 0.0;
+    influence_voxels.zero_listed(influence);
   }
   
   CUDA_CALLABLE_MEMBER
@@ -7,6 +7,7 @@
 #include "cuda_compatibility.hpp"
 #include "los_tracker.hpp"
 #include "gpu_vector.hpp"
+#include "RT_binary_file.hpp"
 
 template<typename emission_type,
 	 template<bool, int> class los_tracker_type>
@@ -185,6 +186,18 @@ public:
   void save_influence(std::ostream &file) const {
     static_cast<const emission_type*>(this)->save_influence(file);
   }
+  // add arrays to a binary file, with names starting with prefix
+  void save_binary(RT_binary_writer &writer, const std::string &prefix) const {
+    static_cast<const emission_type*>(this)->save_binary(writer, prefix);
+  }
+  void save_influence_binary(RT_binary_writer &writer, const std::string &prefix) const {
+    static_cast<const emission_type*>(this)->save_influence_binary(writer, prefix);
+  }
+  // restore everything brightness needs from a file written by
+  // save_binary, returning false if anything is missing
+  bool load_binary(const RT_binary_file &file, const std::string &prefix) {
+    return static_cast<emission_type*>(this)->load_binary(file, prefix);
+  }
   template<int n_elements>
   void save_brightness(std::ostream &file,  const gpu_vector<brightness_tracker<n_elements>> &los_brightness) const {
     // save a list of brightness trackers to file
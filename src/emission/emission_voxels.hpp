@@ -5,6 +5,8 @@
 
 #include "emission.hpp"
 #include "voxel_vector.hpp"
+#include "flush_subnormals.hpp"
+#include <type_traits>
 
 template <int N_VOXELS, // number of grid cells
 	  typename emission_type, // typename of derived emission type
@@ -22,12 +24,18 @@ protected:
   using parent::internal_solved;
 
 public:
-  static const int n_voxels = N_VOXELS;
-  static const int n_lower  = los_tracker_type<false,0>::n_lower; // n_lower and the others don't depend on template args
-  static const int n_upper  = los_tracker_type<false,0>::n_upper;
-  static const int n_lines  = los_tracker_type<false,0>::n_lines;
+  static constexpr int n_voxels = N_VOXELS;
+  static constexpr int n_lower  = los_tracker_type<false,0>::n_lower; // n_lower and the others don't depend on template args
+  static constexpr int n_upper  = los_tracker_type<false,0>::n_upper;
+  static constexpr int n_lines  = los_tracker_type<false,0>::n_lines;
 
-  static const int n_upper_elements = n_voxels*n_upper;
+  static constexpr int n_upper_elements = n_voxels*n_upper;
+
+  // The dense influence matrix holds n_upper_elements^2 values, too
+  // many for large (e.g. 3D) grids. Above this size it is stored
+  // row-compressed instead and solved iteratively, see solve_sparse.
+  static constexpr int max_dense_influence_elements = 8192;
+  static constexpr bool sparse_influence = n_upper_elements > max_dense_influence_elements;
 
   template <bool influence>
   using los = los_tracker_type<influence, n_voxels>;
@@ -42,10 +50,13 @@ protected:
 
   // default is n_upper states per voxel
   typedef voxel_vector<n_voxels, n_upper> vv;
-  typedef voxel_matrix<n_voxels, n_upper> vm;
+  typedef typename std::conditional<sparse_influence,
+				    voxel_sparse_matrix<n_voxels, n_upper>,
+				    voxel_matrix<n_voxels, n_upper>>::type vm;
 
   //Radiative transfer parameters
   vm influence_matrix; //influence matrix has dimensions n_upper_elements, n_upper_elements)
+  Real influence_drop_tolerance; // sparse storage only, see set_influence_drop_tolerance
   
   // line center optical depths
   vv_line tau_species_single_scattering;
@@ -55,6 +66,115 @@ protected:
   vv_upper singlescat; 
   vv_upper sourcefn;   
 
+  // LU factors of (I - influence_matrix), see set_keep_factorization
+  // and set_mixed_precision. Only one set of factors is held at a
+  // time; factored_in_float says which.
+  bool keep_factorization;
+  bool factorization_valid;
+  bool mixed_precision;
+  bool factored_in_float;
+  Eigen::PartialPivLU<MatrixX> kernel_lu;
+  Eigen::PartialPivLU<MatrixXf> kernel_lu_float;
+
+  // limits on the double precision refinement of single precision
+  // solutions, see set_mixed_precision
+  static const int max_refinement_iterations = 10;
+  static constexpr Real refinement_tolerance = STRICTEPS;
+
+  // The solve helpers below take their right-hand sides and solutions
+  // as Eigen::Ref, so that the voxel_vectors of an emission (VectorX)
+  // are used in place.
+
+  // one back-substitution with the factors from the last solve
+  void factors_solve(const Eigen::Ref<const MatrixX> &rhs, Eigen::Ref<MatrixX> X) const {
+    flush_subnormals flush;
+    if (factored_in_float)
+      X = kernel_lu_float.solve(rhs.cast<float>()).cast<Real>();
+    else
+      X = kernel_lu.solve(rhs);
+  }
+
+  // Solve (I - influence_matrix) X = rhs using the single precision
+  // factors as the preconditioner for iterative refinement, with
+  // residuals computed in double precision. Returns false if some
+  // column does not converge, which happens when the kernel is too
+  // poorly conditioned for single precision factors.
+  bool refine_float_solution(const Eigen::Ref<const MatrixX> &rhs, Eigen::Ref<MatrixX> X) const {
+    flush_subnormals flush;
+    const RowMatrixX &K = influence_matrix.eigen();
+    X = kernel_lu_float.solve(rhs.cast<float>()).cast<Real>();
+    MatrixX residual(rhs.rows(), rhs.cols());
+    MatrixX correction(rhs.rows(), rhs.cols());
+    for (int i_iteration=0;i_iteration<max_refinement_iterations;i_iteration++) {
+      residual.noalias() = K*X;
+      residual += rhs - X;
+      correction = kernel_lu_float.solve(residual.cast<float>()).cast<Real>();
+      X += correction;
+      if ((correction.colwise().norm().array()
+	   <= refinement_tolerance*X.colwise().norm().array()).all())
+	return true;
+    }
+    return false;
+  }
+
+  // Factor (I - influence_matrix) once pre_solve has been applied and
+  // solve for each column of rhs into X. In mixed precision mode the kernel
+  // is factored in single precision and the solution refined in
+  // double; if refinement fails the kernel is factored in double. The
+  // factors are left in place until release_unkept_factors.
+  void factor_kernel_and_solve(const Eigen::Ref<const MatrixX> &rhs, Eigen::Ref<MatrixX> X) {
+    // elimination through optically thick paths underflows to
+    // subnormals in either precision; they are far below anything
+    // that affects the solution
+    flush_subnormals flush;
+
+    factored_in_float = false;
+    if (mixed_precision) {
+      kernel_lu_float.compute(MatrixXf::Identity(n_upper_elements, n_upper_elements)
+			      - influence_matrix.eigen().template cast<float>());
+      factored_in_float = refine_float_solution(rhs, X);
+      if (!factored_in_float)
+	kernel_lu_float = Eigen::PartialPivLU<MatrixXf>();
+    }
+    if (!factored_in_float) {
+      //partialPivLu has multithreading support
+      kernel_lu.compute(MatrixX::Identity(n_upper_elements, n_upper_elements)
+			- influence_matrix.eigen());
+      X = kernel_lu.solve(rhs);
+    }
+  }
+  void release_unkept_factors() {
+    factorization_valid = keep_factorization;
+    if (!keep_factorization) {
+      kernel_lu = Eigen::PartialPivLU<MatrixX>();
+      kernel_lu_float = Eigen::PartialPivLU<MatrixXf>();
+    }
+  }
+
+  // solve for the source function once pre_solve has been applied
+  void factor_and_solve() {
+    factor_kernel_and_solve(singlescat.eigen(), sourcefn.eigen());
+    release_unkept_factors();
+
+    // // iterative solution.
+    // Real err = 1;
+    // int it = 0;
+    // VectorX sourcefn_old(n_upper_elements);
+    // sourcefn_old = singlescat;
+    // while (err > EPS && it < 500) {
+    // 	sourcefn = singlescat.eigen() + influence_matrix.eigen() * sourcefn_old.eigen();
+
+    // 	err=((sourcefn.eigen()-sourcefn_old.eigen().array().abs()/sourcefn_old.eigen().array()).maxCoeff();
+    // 	sourcefn_old = sourcefn;
+    // 	it++;
+    // }
+    // std::cout << "For " << internal_name << std::endl;
+    // std::cout << "  Scattering up to order: " << it << " included.\n";
+    // std::cout << "  Error at final order is: " << err << " .\n";
+
+    internal_solved=true;
+  }
+
   template <int N_STATES>
   CUDA_CALLABLE_MEMBER
   void interp_voxel_vector(const int n_interp_points,
@@ -105,6 +225,10 @@ protected:
 #endif
   
 public:
+  emission_voxels()
+    : influence_drop_tolerance(0.0), keep_factorization(false), factorization_valid(false),
+      mixed_precision(false), factored_in_float(false)
+  { }
   ~emission_voxels() {
 #if defined(__CUDACC__) and not defined(__CUDA_ARCH__)
     device_clear();
@@ -116,7 +240,16 @@ public:
     //we only need to reset influence_matrix
 #ifndef __CUDA_ARCH__
     //we are running on the CPU, reset using Eigen
-    influence_matrix.eigen().setZero();
+    if constexpr (sparse_influence) {
+      influence_matrix.reset();
+    } else {
+      // zero the rows of each start voxel on the thread that computes
+      // them in RT_grid::compute_influence (same static schedule), so
+      // that each block of rows is first touched by its writer
+#pragma omp parallel for schedule(static)
+      for (int j_vox=0;j_vox<n_voxels;j_vox++)
+	influence_matrix.zero_voxel_rows(j_vox);
+    }
 #else
     // we are inside a GPU kernel, each block resets one voxel (specified by i_vox), using all threads
     assert(i_vox!=-1 && "initialization error in reset_solution");
@@ -141,17 +274,36 @@ public:
     // offset allows parallel kernels to write to the same row without
     // collision, this is only used on the GPU
 #ifndef __CUDA_ARCH__
-    for (int i_upper=0;i_upper<n_upper;i_upper++) {
-      //      Real rowsum = 0.0;
-      for (unsigned int j_voxel = 0; j_voxel < n_voxels; j_voxel++) {
-	for (unsigned int j_upper = 0; j_upper < n_upper; j_upper++) {
-	  influence_matrix(start_voxel, i_upper,
-			   j_voxel    , j_upper) += tracker.influence[i_upper](j_voxel, j_upper);
-	  // rowsum += influence_matrix(start_voxel, i_upper,
-	  // 			     j_voxel    , j_upper);
+    // only the voxels the ray crossed have nonzero influence
+    const auto &crossed = tracker.influence_voxels;
+    if constexpr (sparse_influence) {
+      for (int i_upper=0;i_upper<n_upper;i_upper++) {
+	const int i_row = influence_matrix.get_element_num(start_voxel, i_upper);
+	if (crossed.full)
+	  influence_matrix.add_to_row(i_row, tracker.influence[i_upper].vec);
+	else
+	  influence_matrix.add_to_row(i_row, tracker.influence[i_upper].vec,
+				      crossed.voxels, crossed.n_listed);
+      }
+    } else if (crossed.full) {
+      for (int i_upper=0;i_upper<n_upper;i_upper++)
+	for (unsigned int j_voxel = 0; j_voxel < n_voxels; j_voxel++)
+	  for (unsigned int j_upper = 0; j_upper < n_upper; j_upper++)
+	    influence_matrix(start_voxel, i_upper,
+			     j_voxel    , j_upper) += tracker.influence[i_upper](j_voxel, j_upper);
+    } else {
+      // a voxel listed twice is zeroed in the tracker once added, so
+      // its influence is not added again
+      for (int i_listed = 0; i_listed < crossed.n_listed; i_listed++) {
+	const int j_voxel = crossed.voxels[i_listed];
+	for (int i_upper=0;i_upper<n_upper;i_upper++) {
+	  for (int j_upper = 0; j_upper < n_upper; j_upper++) {
+	    influence_matrix(start_voxel, i_upper,
+			     j_voxel    , j_upper) += tracker.influence[i_upper](j_voxel, j_upper);
+	    tracker.influence[i_upper](j_voxel, j_upper) = 0.0;
+	  }
 	}
       }
-      //assert(0.0 <= rowsum && rowsum <= 1.0 && "row represents scattering probability from this element");
     }
 #else
     // with seperate influence trackers for each thread
@@ -168,34 +320,249 @@ public:
   }
 
   void solve() {
+    if constexpr (sparse_influence) {
+      solve_sparse();
+    } else {
+      static_cast<emission_type*>(this)->pre_solve();
+      factor_and_solve();
+    }
+  }
+
+  // Solve for the source function of an influence matrix stored
+  // sparsely (see sparse_influence) by BiCGSTAB with a Jacobi
+  // preconditioner, starting from the single scattering. Eigen runs the
+  // sparse matrix-vector products in parallel with OpenMP. Returns
+  // false if the relative residual did not reach tolerance, in which
+  // case the last iterate is kept.
+  bool solve_sparse(const int max_iterations = 200,
+		    const Real tolerance = STRICTEPS) {
+    static_assert(sparse_influence, "dense influence matrices are solved with solve()");
+    influence_matrix.compress(influence_drop_tolerance);
     static_cast<emission_type*>(this)->pre_solve();
 
-    MatrixX kernel = MatrixX::Identity(n_upper_elements, n_upper_elements);
+    SparseMatrixX kernel(n_upper_elements, n_upper_elements);
+    kernel.setIdentity();
     kernel -= influence_matrix.eigen();
-    
-    sourcefn = kernel.partialPivLu().solve(singlescat.eigen()); //partialPivLu has multithreading support
-    
-    // // iterative solution.
-    // Real err = 1;
-    // int it = 0;
-    // VectorX sourcefn_old(n_upper_elements);
-    // sourcefn_old = singlescat;
-    // while (err > EPS && it < 500) {
-    // 	sourcefn = singlescat.eigen() + influence_matrix.eigen() * sourcefn_old.eigen();
 
-    // 	err=((sourcefn.eigen()-sourcefn_old.eigen().array().abs()/sourcefn_old.eigen().array()).maxCoeff();
-    // 	sourcefn_old = sourcefn;
-    // 	it++;
-    // }
-    // std::cout << "For " << internal_name << std::endl;
-    // std::cout << "  Scattering up to order: " << it << " included.\n";
-    // std::cout << "  Error at final order is: " << err << " .\n";
-      
+    Eigen::BiCGSTAB<SparseMatrixX, Eigen::DiagonalPreconditioner<Real>> solver;
+    solver.setMaxIterations(max_iterations);
+    solver.setTolerance(tolerance);
+    solver.compute(kernel);
+    sourcefn = solver.solveWithGuess(singlescat.eigen(), singlescat.eigen());
+
+    factorization_valid=false;
     internal_solved=true;
+    return solver.info() == Eigen::Success;
+  }
+
+  // Influence coefficients no larger than this are not kept when a
+  // sparse influence matrix is compressed, trading accuracy for
+  // memory: the coefficients of distant voxels seen through optically
+  // thick layers are tiny but numerous. The default of zero keeps
+  // every coefficient.
+  void set_influence_drop_tolerance(const Real tolerance) {
+    static_assert(sparse_influence, "only sparse influence matrices drop coefficients");
+    assert(tolerance >= 0 && "tolerance must be non-negative");
+    influence_drop_tolerance = tolerance;
+  }
+
+  // Keep the LU factors of (I - influence_matrix) after each solve, so
+  // that nearby models can be solved by iterative refinement with
+  // back-substitutions instead of a new factorization (see
+  // solve_with_factorization). The factors take as much memory as the
+  // influence matrix.
+  void set_keep_factorization(const bool keep = true) {
+    keep_factorization = keep;
+    if (!keep) {
+      kernel_lu = Eigen::PartialPivLU<MatrixX>();
+      kernel_lu_float = Eigen::PartialPivLU<MatrixXf>();
+      factorization_valid = false;
+    }
   }
+  bool has_factorization() const {
+    return factorization_valid;
+  }
+
+  // Factor the kernel in single precision and refine the solution in
+  // double precision, with residuals computed from the double
+  // precision influence matrix, so the source function keeps double
+  // precision accuracy (to refinement_tolerance) as long as the kernel
+  // condition number is well below 1/float epsilon. The factorization
+  // runs at twice the SIMD width and kept factors take half the
+  // memory. If refinement does not converge the kernel is factored in
+  // double precision instead. Dense influence matrices only.
+  void set_mixed_precision(const bool mixed = true) {
+    static_assert(!sparse_influence, "sparse influence matrices are solved iteratively in double precision");
+    mixed_precision = mixed;
+  }
+  bool get_mixed_precision() const {
+    return mixed_precision;
+  }
+
+  const VectorX & source_function() const {
+    return sourcefn.eigen();
+  }
+
+  // ||singlescat - (I - influence_matrix) sourcefn|| / ||singlescat||
+  // for the last solve, to check the accuracy of the solution
+  Real relative_residual() const {
+    assert(internal_solved && "solve before computing the residual");
+    const VectorX &S = sourcefn.eigen();
+    VectorX residual(n_upper_elements);
+    residual.noalias() = influence_matrix.eigen()*S;
+    residual += singlescat.eigen() - S;
+    return residual.norm()/singlescat.eigen().norm();
+  }
+
+  // Solve for a perturbed model whose influence matrix and single
+  // scattering have just been recomputed, using the factorization kept
+  // from an earlier solve as the preconditioner for iterative
+  // refinement, starting from the earlier solution. If refinement does
+  // not converge (the perturbation was too large) the kernel is
+  // factored again; returns false in that case.
+  bool solve_with_factorization(const int max_iterations = 20,
+				const Real tolerance = 1e-10) {
+    assert(factorization_valid && "solve with keep_factorization set before reusing the factorization");
+    static_cast<emission_type*>(this)->pre_solve();
+
+    VectorX S = sourcefn.eigen();
+    VectorX residual(n_upper_elements);
+    VectorX correction(n_upper_elements);
+    for (int i_iteration=0;i_iteration<max_iterations;i_iteration++) {
+      residual.noalias() = influence_matrix.eigen()*S;
+      residual += singlescat.eigen() - S;
+      factors_solve(residual, correction);
+      S += correction;
+      if (correction.norm() <= tolerance*S.norm()) {
+	sourcefn = std::move(S);
+	internal_solved=true;
+	return true;
+      }
+    }
+
+    factor_and_solve();
+    return false;
+  }
+
+  // Solve without factoring the full kernel A = I - influence_matrix,
+  // for grids where the O(N^3) factorization dominates. The source
+  // function is smooth in log radius and SZA, so a coarse grid of the
+  // same atmosphere captures most of it: with P (n_voxels x
+  // n_coarse_voxels, e.g. from interpolation_from) interpolating from
+  // the coarse voxels to these, the coarse kernel is P^T A P. The
+  // iteration starts from the coarse solution interpolated to this
+  // grid and is BiCGSTAB preconditioned by a two-level cycle (a Jacobi
+  // sweep before and after a coarse grid correction), so each
+  // iteration costs a few matrix-vector products instead of a
+  // factorization. If the relative residual does not fall below
+  // tolerance, the kernel is factored as usual and false is returned.
+  bool solve_two_level(const SparseMatrixX &voxel_interp,
+		       const int max_iterations = 50,
+		       const Real tolerance = 1e-10) {
+    assert(voxel_interp.rows() == n_voxels && "interpolation must have a row for each voxel");
+    static_cast<emission_type*>(this)->pre_solve();
+
+    if (keep_factorization) {
+      // the factors are wanted anyway
+      factor_and_solve();
+      return true;
+    }
+
+    // interpolate each upper state separately
+    vector<Eigen::Triplet<Real>> weights;
+    for (int i_voxel=0;i_voxel<voxel_interp.outerSize();i_voxel++)
+      for (SparseMatrixX::InnerIterator it(voxel_interp, i_voxel); it; ++it)
+	for (int i_upper=0;i_upper<n_upper;i_upper++)
+	  weights.emplace_back(i_voxel*n_upper + i_upper, it.col()*n_upper + i_upper, it.value());
+    SparseMatrixX P(n_upper_elements, voxel_interp.cols()*n_upper);
+    P.setFromTriplets(weights.begin(), weights.end());
+
+    const RowMatrixX &K = influence_matrix.eigen();
+    const VectorX &b = singlescat.eigen();
+    const VectorX diagonal = VectorX::Ones(n_upper_elements) - K.diagonal();
+
+    MatrixX AP = MatrixX(P) - K*P;
+    MatrixX coarse_kernel = P.transpose()*AP;
+    Eigen::PartialPivLU<MatrixX> coarse_lu(coarse_kernel);
+
+    auto kernel_times = [&](const VectorX &x) -> VectorX { return x - K*x; };
+    auto precondition = [&](const VectorX &r) -> VectorX {
+      VectorX z = r.cwiseQuotient(diagonal);
+      z += P*coarse_lu.solve(P.transpose()*(r - kernel_times(z)));
+      z += (r - kernel_times(z)).cwiseQuotient(diagonal);
+      return z;
+    };
+
+    VectorX S = P*coarse_lu.solve(P.transpose()*b);
+    VectorX r = b - kernel_times(S);
+    const VectorX r0 = r;
+    const Real b_norm = b.norm();
+    VectorX p = VectorX::Zero(n_upper_elements);
+    VectorX v = VectorX::Zero(n_upper_elements);
+    Real rho = 1, alpha = 1, omega = 1;
+
+    for (int i_iteration=0;i_iteration<=max_iterations;i_iteration++) {
+      if (r.norm() <= tolerance*b_norm) {
+	sourcefn = std::move(S);
+	factorization_valid=false;
+	internal_solved=true;
+	return true;
+      }
+      const Real rho_new = r0.dot(r);
+      if (i_iteration == max_iterations || rho_new == 0)
+	break;
+
+      p = r + (rho_new/rho)*(alpha/omega)*(p - omega*v);
+      rho = rho_new;
+      const VectorX y = precondition(p);
+      v = kernel_times(y);
+      alpha = rho/r0.dot(v);
+      const VectorX s = r - alpha*v;
+      const VectorX z = precondition(s);
+      const VectorX t = kernel_times(z);
+      omega = t.dot(s)/t.squaredNorm();
+      S += alpha*y + omega*z;
+      r = s - omega*t;
+      if (omega == 0)
+	break;
+    }
+
+    factor_and_solve();
+    return false;
+  }
+
   void solve_gpu();
   void transpose_influence_gpu();
-  
+
+  // copy out the quantities computed by generate_S, or put back a
+  // copy taken earlier for the same inputs. The influence matrix is
+  // not part of the solution and is left as it is.
+  void get_solution(vector<VectorX> &solution) const {
+    // a solution vector from an earlier call keeps its allocations
+    solution.resize(4);
+    solution[0] = sourcefn.eigen();
+    solution[1] = singlescat.eigen();
+    solution[2] = tau_species_single_scattering.eigen();
+    solution[3] = tau_absorber_single_scattering.eigen();
+  }
+  // whether solution has the layout get_solution gives for this grid
+  static bool solution_matches(const vector<VectorX> &solution) {
+    return (solution.size() == 4
+	    && solution[0].size() == n_voxels*n_upper
+	    && solution[1].size() == n_voxels*n_upper
+	    && solution[2].size() == n_voxels*n_lines
+	    && solution[3].size() == n_voxels*n_lines);
+  }
+  void restore_solution(const vector<VectorX> &solution) {
+    assert(solution_matches(solution) && "solution must come from get_solution");
+    sourcefn = solution[0];
+    singlescat = solution[1];
+    tau_species_single_scattering = solution[2];
+    tau_absorber_single_scattering = solution[3];
+    factorization_valid=false; // the factors belong to whatever was solved last
+    internal_solved=true;
+  }
+
   // update the brightness with the contribution from this voxel
   CUDA_CALLABLE_MEMBER
   void update_tracker_brightness_nointerp(const int &current_voxel,
@@ -237,6 +604,52 @@ public:
 	 << influence_matrix.eigen() << "\n\n";
   }
 
+  void save_binary(RT_binary_writer &writer, const std::string &prefix) const {
+    writer.add_metadata(prefix+"name", std::string(parent::name()));
+    writer.add_array(prefix+"tau_species_single_scattering", *tau_species_single_scattering.eigen_vec);
+    writer.add_array(prefix+"tau_absorber_single_scattering", *tau_absorber_single_scattering.eigen_vec);
+    writer.add_array(prefix+"singlescat", *singlescat.eigen_vec);
+    writer.add_array(prefix+"sourcefn", *sourcefn.eigen_vec);
+  }
+  void save_influence_binary(RT_binary_writer &writer, const std::string &prefix) const {
+    writer.add_array(prefix+"influence_matrix", MatrixX(*influence_matrix.eigen_mat));
+  }
+
+protected:
+  // helpers for derived load_binary routines
+  template <int N_STATES>
+  static bool load_voxel_vector(const RT_binary_file &file, const std::string &name,
+				voxel_vector<n_voxels, N_STATES> &vec) {
+    if (!file.has_array(name))
+      return false;
+    auto data = file.vector(name);
+    if (data.size() != vec.n_elements)
+      return false;
+    vec = VectorX(data);
+    return true;
+  }
+
+  // restores the name and the quantities computed by solve(); the
+  // influence matrix is not needed for brightness and is left alone
+  bool load_solution_binary(const RT_binary_file &file, const std::string &prefix) {
+    const std::string file_name = file.metadata(prefix+"name");
+    if (file_name == "" || file_name.size() >= parent::name_length)
+      return false;
+
+    if (!(load_voxel_vector(file, prefix+"tau_species_single_scattering", tau_species_single_scattering)
+	  && load_voxel_vector(file, prefix+"tau_absorber_single_scattering", tau_absorber_single_scattering)
+	  && load_voxel_vector(file, prefix+"singlescat", singlescat)
+	  && load_voxel_vector(file, prefix+"sourcefn", sourcefn)))
+      return false;
+
+    strcpy(internal_name, file_name.c_str());
+    factorization_valid=false;
+    internal_solved=true;
+    return true;
+  }
+
+public:
+
 #ifdef __CUDACC__
   using parent::device_emission;
   using parent::copy_trivial_member_to_device;
@@ -319,6 +732,7 @@ void emission_voxels<N_VOXELS,
   checkCudaErrors( cudaDeviceSynchronize() );
 
   static_cast<emission_type*>(this)->pre_solve_gpu();
+  factorization_valid = false; // factors are not kept for GPU solutions
   // this ensures that:
   // 1) emiss->influence_matrix represents the kernel, not the influence matrix
   // 2) emiss->sourcefn = emiss->singlescat (solution is found in-place)
@@ -89,17 +89,18 @@ protected:
 public:
   vv influence[n_upper]; // array needed here even for n_upper = 1
 			 // for compatibility with multiplet code
+  voxel_index_list<N_VOXELS> influence_voxels; // voxels with nonzero influence
   
   CUDA_CALLABLE_MEMBER
   void init() {
     los_tracker::init();
-    reset_influence();
+    influence[0] = 0.0;
+    influence_voxels.clear();
   }
 
   CUDA_CALLABLE_MEMBER
   void reset_influence() {
-    for (int j_pt = 0; j_pt < N_VOXELS; j_pt++)
-      influence[0](j_pt) = 0.0;
+    influence_voxels.zero_listed(influence);
   }
 
   CUDA_CALLABLE_MEMBER
@@ -323,10 +323,12 @@ public:
   void reset_tracker(const int &start_voxel,
 		     los<influence> &tracker) const {
     Real density_at_origin[n_lower];
-    if (!influence)
+    if (!influence) {
       // start voxel values don't matter for brightness calculations
+      for (int i_lower=0;i_lower<n_lower;i_lower++)
+	density_at_origin[i_lower] = 0.0;
       tracker.reset(0.0, density_at_origin);
-    else {
+    } else {
       for (int i_lower=0;i_lower<n_lower;i_lower++)
 	density_at_origin[i_lower] = species_density(start_voxel, i_lower);
       tracker.reset(species_T(start_voxel), density_at_origin);
@@ -400,6 +402,7 @@ public:
 	tracker.influence[i_upper_origin](current_voxel, j_upper_current) += coef;
       }
     }
+    tracker.influence_voxels.add(current_voxel);
     update_tracker_end(tracker);
   }
 
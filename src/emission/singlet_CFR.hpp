@@ -58,6 +58,7 @@ protected:
   using parent::tau_absorber_single_scattering;
   using parent::singlescat; 
   using parent::sourcefn;
+  using parent::load_voxel_vector;
 
   vv species_density; //average and point densities of species on the grid
   vv species_density_pt;
@@ -286,6 +287,11 @@ public:
   Real get_emission_g_factor() const {
     return emission_g_factor;
   };
+
+  // line center optical depth per unit length in each voxel
+  const VectorX & species_dtau() const {
+    return dtau_species.eigen();
+  }
   
   //overloads of RT methods
   template<bool influence>
@@ -365,6 +371,7 @@ public:
     assert(0<=coef && coef<=1 && "influence coefficients represent transition probabilities");
 
     tracker.influence[0](current_voxel) += coef;
+    tracker.influence_voxels.add(current_voxel);
 
     update_tracker_end(tracker);
   }
@@ -503,6 +510,21 @@ public:
       abs_pt(vnum) /= tweak_factor;
     }
   }
+  void rescale_species_density(const Real factor) {
+    // multiply the species density in every voxel by a constant,
+    // updating only the quantities that depend on it. Temperatures and
+    // absorber parameters are unchanged, so define() need not be called again.
+    assert(factor > 0 && "density scale factor must be positive");
+
+    species_density.eigen() *= factor;
+    species_density_pt.eigen() *= factor;
+    dtau_species.eigen() *= factor;
+    dtau_species_pt.eigen() *= factor;
+    abs.eigen() /= factor;
+    abs_pt.eigen() /= factor;
+
+    parent::reset_solution();
+  }
   void tweak_species_temp(const vector<int> voxel_numbers, const Real tweak_factor) {
     for (int i_tweak=0;i_tweak<voxel_numbers.size();i_tweak++) {
       int vnum = voxel_numbers[i_tweak];
@@ -542,6 +564,66 @@ public:
 	 <<      function(sourcefn.eigen(), i).transpose() << "\n\n";
   }
 
+  void save_binary(RT_binary_writer &writer, const std::string &prefix) const {
+    // the voxel quantities brightness needs, plus the solution
+    writer.add_metadata(prefix+"species_T_ref", species_T_ref);
+    writer.add_metadata(prefix+"species_sigma_T_ref", species_sigma_T_ref);
+    writer.add_metadata(prefix+"emission_g_factor", emission_g_factor);
+    writer.add_metadata(prefix+"branching_ratio", branching_ratio);
+
+    writer.add_array(prefix+"species_density", *species_density.eigen_vec);
+    writer.add_array(prefix+"species_density_pt", *species_density_pt.eigen_vec);
+    writer.add_array(prefix+"species_T_ratio", *species_T_ratio.eigen_vec);
+    writer.add_array(prefix+"species_T_ratio_pt", *species_T_ratio_pt.eigen_vec);
+    writer.add_array(prefix+"dtau_species", *dtau_species.eigen_vec);
+    writer.add_array(prefix+"dtau_species_pt", *dtau_species_pt.eigen_vec);
+    writer.add_array(prefix+"absorber_density", *absorber_density.eigen_vec);
+    writer.add_array(prefix+"absorber_density_pt", *absorber_density_pt.eigen_vec);
+    writer.add_array(prefix+"absorber_sigma", *absorber_sigma.eigen_vec);
+    writer.add_array(prefix+"absorber_sigma_pt", *absorber_sigma_pt.eigen_vec);
+    writer.add_array(prefix+"dtau_absorber", *dtau_absorber.eigen_vec);
+    writer.add_array(prefix+"dtau_absorber_pt", *dtau_absorber_pt.eigen_vec);
+    writer.add_array(prefix+"abs", *abs.eigen_vec);
+    writer.add_array(prefix+"abs_pt", *abs_pt.eigen_vec);
+
+    parent::save_binary(writer, prefix);
+  }
+
+  bool load_binary(const RT_binary_file &file, const std::string &prefix) {
+    // restore the solved state without define() or solve(), so
+    // brightness can be computed from a saved solution
+    Real file_T_ref, file_sigma_T_ref, file_g_factor, file_branching_ratio;
+    if (!(file.metadata(prefix+"species_T_ref", file_T_ref)
+	  && file.metadata(prefix+"species_sigma_T_ref", file_sigma_T_ref)
+	  && file.metadata(prefix+"emission_g_factor", file_g_factor)
+	  && file.metadata(prefix+"branching_ratio", file_branching_ratio)))
+      return false;
+
+    if (!(load_voxel_vector(file, prefix+"species_density", species_density)
+	  && load_voxel_vector(file, prefix+"species_density_pt", species_density_pt)
+	  && load_voxel_vector(file, prefix+"species_T_ratio", species_T_ratio)
+	  && load_voxel_vector(file, prefix+"species_T_ratio_pt", species_T_ratio_pt)
+	  && load_voxel_vector(file, prefix+"dtau_species", dtau_species)
+	  && load_voxel_vector(file, prefix+"dtau_species_pt", dtau_species_pt)
+	  && load_voxel_vector(file, prefix+"absorber_density", absorber_density)
+	  && load_voxel_vector(file, prefix+"absorber_density_pt", absorber_density_pt)
+	  && load_voxel_vector(file, prefix+"absorber_sigma", absorber_sigma)
+	  && load_voxel_vector(file, prefix+"absorber_sigma_pt", absorber_sigma_pt)
+	  && load_voxel_vector(file, prefix+"dtau_absorber", dtau_absorber)
+	  && load_voxel_vector(file, prefix+"dtau_absorber_pt", dtau_absorber_pt)
+	  && load_voxel_vector(file, prefix+"abs", abs)
+	  && load_voxel_vector(file, prefix+"abs_pt", abs_pt)))
+      return false;
+
+    species_T_ref = file_T_ref;
+    species_sigma_T_ref = file_sigma_T_ref;
+    emission_g_factor = file_g_factor;
+    branching_ratio = file_branching_ratio;
+    internal_init = true;
+
+    return parent::load_solution_binary(file, prefix);
+  }
+
   void save_brightness(std::ostream &file, const gpu_vector<brightness_tracker> &los_brightness) const {
     // save a list of brightness trackers to file
 
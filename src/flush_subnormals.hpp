@@ -0,0 +1,51 @@
+//flush_subnormals.hpp -- scoped flush to zero of subnormal floating point values
+
+#ifndef __flush_subnormals_h
+#define __flush_subnormals_h
+
+#if defined(__SSE2__) && !defined(__CUDA_ARCH__)
+#include <pmmintrin.h>
+#define FLUSH_SUBNORMALS_MASK (_MM_FLUSH_ZERO_MASK | _MM_DENORMALS_ZERO_MASK)
+#endif
+
+// While an object of this type exists, subnormal results are flushed
+// to zero and subnormal inputs are read as zero, on the calling thread
+// and on the OpenMP threads that Eigen runs its products on. x86
+// processes subnormals many times slower than normal values, and
+// single precision factorizations of optically thick kernels produce
+// a lot of them. Does nothing on other architectures.
+struct flush_subnormals {
+#ifdef FLUSH_SUBNORMALS_MASK
+  const bool already_flushing;
+
+  flush_subnormals()
+    : already_flushing((_mm_getcsr() & FLUSH_SUBNORMALS_MASK) == FLUSH_SUBNORMALS_MASK)
+  {
+    if (!already_flushing)
+      set_all_threads(true);
+  }
+  ~flush_subnormals() {
+    if (!already_flushing)
+      set_all_threads(false);
+  }
+
+private:
+  static void set_all_threads(const bool flush) {
+#pragma omp parallel
+    {
+      if (flush)
+	_mm_setcsr(_mm_getcsr() | FLUSH_SUBNORMALS_MASK);
+      else
+	_mm_setcsr(_mm_getcsr() & ~FLUSH_SUBNORMALS_MASK);
+    }
+  }
+
+public:
+#else
+  flush_subnormals() { }
+#endif
+  flush_subnormals(const flush_subnormals &) = delete;
+  flush_subnormals & operator=(const flush_subnormals &) = delete;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "forward_model_cache.hpp"
+#include "atomic_file.hpp"
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+using std::vector;
+using std::string;
+
+forward_model_key::forward_model_key(const string &variantt/* = ""*/)
+  : variant(variantt)
+{ }
+
+void forward_model_key::add(const doubReal value) {
+  values.push_back(value);
+}
+
+bool forward_model_key::valid() const {
+  return variant != "";
+}
+
+bool forward_model_key::operator==(const forward_model_key &other) const {
+  // compare bit patterns rather than values so that the comparison is
+  // exact and well defined for all inputs
+  return (variant == other.variant
+	  && values.size() == other.values.size()
+	  && std::memcmp(values.data(), other.values.data(), values.size()*sizeof(doubReal)) == 0);
+}
+
+std::size_t forward_model_key::hash() const {
+  // 64-bit FNV-1a over the variant name and the value bits
+  std::uint64_t h = 14695981039346656037ULL;
+  const std::uint64_t prime = 1099511628211ULL;
+
+  for (const char &c : variant) {
+    h ^= static_cast<unsigned char>(c);
+    h *= prime;
+  }
+
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(values.data());
+  for (std::size_t i = 0; i < values.size()*sizeof(doubReal); i++) {
+    h ^= bytes[i];
+    h *= prime;
+  }
+
+  return static_cast<std::size_t>(h);
+}
+
+
+constexpr char source_function_cache::file_magic[9];
+constexpr int source_function_cache::file_version;
+
+source_function_cache::source_function_cache(const std::size_t capacity/* = 0*/)
+  : parent(capacity), cache_dir(""), git_hash(""), n_disk_hits(0)
+{ }
+
+void source_function_cache::set_cache_dir(const string &dirname, const string &git_hashh) {
+  if (dirname != "" && git_hashh == "") {
+    // without a code version, files from other builds can't be told apart
+    std::cout << "source function disk cache needs a git hash, not using "
+	      << dirname << std::endl;
+    cache_dir = "";
+  } else
+    cache_dir = dirname;
+  git_hash = git_hashh;
+}
+string source_function_cache::get_cache_dir() const {
+  return cache_dir;
+}
+
+std::size_t source_function_cache::disk_hits() const {
+  return n_disk_hits;
+}
+
+string source_function_cache::cache_fname(const forward_model_key &key, const int n_voxels) const {
+  // the hash only picks the file; load() checks the full key
+  std::ostringstream fname;
+  fname << cache_dir << "/sourcefn_" << key.variant << "_" << n_voxels << "_"
+	<< std::hex << std::setw(16) << std::setfill('0') << key.hash()
+	<< (sizeof(Real) == sizeof(float) ? "_float" : "_double") << ".dat";
+  return fname.str();
+}
+
+// strings in the file are an int length followed by the characters
+static void write_string(std::ofstream &file, const string &str) {
+  const int n = str.size();
+  file.write(reinterpret_cast<const char*>(&n), sizeof(int));
+  file.write(str.data(), n);
+}
+static bool read_string(std::ifstream &file, string &str) {
+  int n;
+  file.read(reinterpret_cast<char*>(&n), sizeof(int));
+  if (!file.good() || n < 0 || n > 4096)
+    return false;
+  str.assign(n, '\0');
+  file.read(&str[0], n);
+  return file.good();
+}
+
+bool source_function_cache::save(const string &fname,
+				 const forward_model_key &key,
+				 const string &grid_name,
+				 const int n_voxels,
+				 const source_function_solution &sol) const {
+  // readers in other processes only ever see a complete file
+  const string tmp_fname = atomic_file_temp_name(fname);
+  std::ofstream file(tmp_fname.c_str(), std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  const int real_size = sizeof(Real);
+  const int n_variant = key.variant.size();
+  const int n_values = key.values.size();
+  const int n_emissions = sol.size();
+  file.write(file_magic, 8);
+  file.write(reinterpret_cast<const char*>(&file_version), sizeof(int));
+  file.write(reinterpret_cast<const char*>(&real_size), sizeof(int));
+  write_string(file, git_hash);
+  write_string(file, grid_name);
+  file.write(reinterpret_cast<const char*>(&n_voxels), sizeof(int));
+  file.write(reinterpret_cast<const char*>(&n_variant), sizeof(int));
+  file.write(key.variant.data(), n_variant);
+  file.write(reinterpret_cast<const char*>(&n_values), sizeof(int));
+  file.write(reinterpret_cast<const char*>(key.values.data()), n_values*sizeof(doubReal));
+  file.write(reinterpret_cast<const char*>(&n_emissions), sizeof(int));
+  for (auto &emission_sol: sol) {
+    const int n_quantities = emission_sol.size();
+    file.write(reinterpret_cast<const char*>(&n_quantities), sizeof(int));
+    for (auto &quantity: emission_sol) {
+      const int n = quantity.size();
+      file.write(reinterpret_cast<const char*>(&n), sizeof(int));
+      file.write(reinterpret_cast<const char*>(quantity.data()), n*sizeof(Real));
+    }
+  }
+  file.close();
+
+  return atomic_file_commit(tmp_fname, fname, file.good());
+}
+
+bool source_function_cache::load(const string &fname,
+				 const forward_model_key &key,
+				 const string &grid_name,
+				 const int n_voxels,
+				 source_function_solution &sol) const {
+  // returns false if the file is missing, was written by different
+  // code or for a different grid, or holds a different key
+  std::ifstream file(fname.c_str(), std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  char magic[8];
+  int version, real_size, file_n_voxels, n_variant, n_values, n_emissions;
+  string file_git_hash, file_grid_name;
+  file.read(magic, 8);
+  file.read(reinterpret_cast<char*>(&version), sizeof(int));
+  file.read(reinterpret_cast<char*>(&real_size), sizeof(int));
+  if (!file.good()
+      || string(magic, 8) != string(file_magic, 8)
+      || version != file_version
+      || real_size != sizeof(Real))
+    return false;
+  if (!read_string(file, file_git_hash) || file_git_hash != git_hash
+      || !read_string(file, file_grid_name) || file_grid_name != grid_name)
+    return false;
+  file.read(reinterpret_cast<char*>(&file_n_voxels), sizeof(int));
+  file.read(reinterpret_cast<char*>(&n_variant), sizeof(int));
+  if (!file.good()
+      || file_n_voxels != n_voxels
+      || n_variant != int(key.variant.size()))
+    return false;
+
+  forward_model_key file_key(string(n_variant, '\0'));
+  file.read(&file_key.variant[0], n_variant);
+  file.read(reinterpret_cast<char*>(&n_values), sizeof(int));
+  if (!file.good() || n_values != int(key.values.size()))
+    return false;
+  file_key.values.resize(n_values);
+  file.read(reinterpret_cast<char*>(file_key.values.data()), n_values*sizeof(doubReal));
+  if (!file.good() || !(file_key == key))
+    return false;
+
+  file.read(reinterpret_cast<char*>(&n_emissions), sizeof(int));
+  if (!file.good() || n_emissions < 0)
+    return false;
+  sol.resize(n_emissions);
+  for (auto &emission_sol: sol) {
+    int n_quantities;
+    file.read(reinterpret_cast<char*>(&n_quantities), sizeof(int));
+    if (!file.good() || n_quantities < 0)
+      return false;
+    emission_sol.resize(n_quantities);
+    for (auto &quantity: emission_sol) {
+      int n;
+      file.read(reinterpret_cast<char*>(&n), sizeof(int));
+      if (!file.good() || n < 0 || n % n_voxels != 0)
+	// every quantity is a whole number of values per voxel
+	return false;
+      quantity.resize(n);
+      file.read(reinterpret_cast<char*>(quantity.data()), n*sizeof(Real));
+    }
+  }
+
+  // the file must end exactly here; anything else is not ours
+  return file.good() && file.peek() == std::ifstream::traits_type::eof();
+}
+
+const source_function_solution* source_function_cache::find(const forward_model_key &key,
+							    const string &grid_name,
+							    const int n_voxels) {
+  if (!enabled())
+    return NULL;
+
+  const source_function_solution* sol = lookup(key);
+  if (sol != NULL) {
+    n_hits++;
+    return sol;
+  }
+
+  source_function_solution file_sol;
+  if (cache_dir != "" && load(cache_fname(key, n_voxels), key, grid_name, n_voxels, file_sol)) {
+    n_disk_hits++;
+    parent::insert(key, file_sol);
+    return lookup(key);
+  }
+
+  n_misses++;
+  return NULL;
+}
+
+void source_function_cache::insert(const forward_model_key &key,
+				   const source_function_solution &sol,
+				   const string &grid_name,
+				   const int n_voxels) {
+  if (!enabled())
+    return;
+  parent::insert(key, sol);
+  if (cache_dir != "")
+    save(cache_fname(key, n_voxels), key, grid_name, n_voxels, sol);
+}
+
+void source_function_cache::reset_stats() {
+  parent::reset_stats();
+  n_disk_hits = 0;
+}
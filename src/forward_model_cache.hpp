@@ -0,0 +1,193 @@
+//forward_model_cache.hpp -- bounded caches of forward model results, keyed by model inputs
+
+#ifndef __FORWARD_MODEL_CACHE_H
+#define __FORWARD_MODEL_CACHE_H
+
+#include "Real.hpp"
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <cstddef>
+
+// Exact description of the inputs to a forward model calculation: the
+// name of the routine that was called plus every number it depends
+// on. Keys compare equal only if all values are bitwise identical, so a
+// cache hit always reproduces the calculation it replaces.
+struct forward_model_key {
+  std::string variant;
+  std::vector<doubReal> values;
+
+  forward_model_key(const std::string &variantt = "");
+
+  void add(const doubReal value);
+  template <typename T>
+  void add(const std::vector<T> &vals) {
+    //prefix the length so adjacent vectors cannot be confused
+    add(vals.size());
+    for (auto &v: vals)
+      add(v);
+  }
+
+  bool valid() const;
+  bool operator==(const forward_model_key &other) const;
+  std::size_t hash() const;
+};
+
+struct forward_model_key_hash {
+  std::size_t operator()(const forward_model_key &key) const {
+    return key.hash();
+  }
+};
+
+// least-recently-used cache holding up to capacity entries. A
+// capacity of zero disables the cache.
+template <typename V>
+class forward_model_lru_cache {
+protected:
+  typedef std::pair<forward_model_key, V> entry;
+  std::list<entry> entries; // most recently used first
+  std::unordered_map<forward_model_key,
+		     typename std::list<entry>::iterator,
+		     forward_model_key_hash> index;
+  std::size_t max_entries;
+
+  std::size_t n_hits, n_misses;
+
+  const V* lookup(const forward_model_key &key) {
+    auto it = index.find(key);
+    if (it == index.end())
+      return NULL;
+    entries.splice(entries.begin(), entries, it->second);
+    return &(it->second->second);
+  }
+
+  void evict() {
+    while (entries.size() > max_entries) {
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+  }
+
+public:
+  forward_model_lru_cache(const std::size_t capacity = 0)
+    : max_entries(capacity), n_hits(0), n_misses(0)
+  { }
+
+  bool enabled() const {
+    return max_entries > 0;
+  }
+  std::size_t capacity() const {
+    return max_entries;
+  }
+  std::size_t size() const {
+    return entries.size();
+  }
+  std::size_t hits() const {
+    return n_hits;
+  }
+  std::size_t misses() const {
+    return n_misses;
+  }
+
+  void set_capacity(const std::size_t capacity) {
+    max_entries = capacity;
+    evict();
+  }
+
+  // returns a pointer to the cached value, or NULL on a miss. The
+  // pointer is valid until the next call to insert.
+  const V* find(const forward_model_key &key) {
+    if (!enabled())
+      return NULL;
+    const V* val = lookup(key);
+    val==NULL ? n_misses++ : n_hits++;
+    return val;
+  }
+
+  void insert(const forward_model_key &key, const V &value) {
+    if (!enabled())
+      return;
+    auto it = index.find(key);
+    if (it != index.end()) {
+      it->second->second = value;
+      entries.splice(entries.begin(), entries, it->second);
+      return;
+    }
+    entries.emplace_front(key, value);
+    index[key] = entries.begin();
+    evict();
+  }
+
+  void clear() {
+    entries.clear();
+    index.clear();
+  }
+  void reset_stats() {
+    n_hits = 0;
+    n_misses = 0;
+  }
+};
+
+// The quantities computed by RT_grid::generate_S for each emission:
+// sourcefn, singlescat, and the single scattering optical depths of the
+// species and absorber, in that order (see emission_voxels::get_solution).
+typedef std::vector<std::vector<VectorX>> source_function_solution;
+
+// in-memory cache of solved source functions, optionally backed by
+// one binary file per solution in a directory
+class source_function_cache : public forward_model_lru_cache<source_function_solution> {
+  typedef forward_model_lru_cache<source_function_solution> parent;
+
+  std::string cache_dir;
+  std::string git_hash;
+  std::size_t n_disk_hits;
+
+  // files record the code version (git hash), grid type and voxel
+  // count they were solved with, and are only read back if all three
+  // match the current build and grid
+  static constexpr char file_magic[9] = "SFNCACHE";
+  static constexpr int file_version = 2;
+
+  std::string cache_fname(const forward_model_key &key, const int n_voxels) const;
+  bool save(const std::string &fname, const forward_model_key &key,
+	    const std::string &grid_name, const int n_voxels,
+	    const source_function_solution &sol) const;
+  bool load(const std::string &fname, const forward_model_key &key,
+	    const std::string &grid_name, const int n_voxels,
+	    source_function_solution &sol) const;
+
+public:
+  source_function_cache(const std::size_t capacity = 0);
+
+  // solutions are written to this directory as they are computed and
+  // read back on an in-memory miss, so they survive eviction and
+  // restarts. git_hash identifies the code; files written by any other
+  // version are ignored. An empty dirname or git_hash disables the
+  // disk cache.
+  void set_cache_dir(const std::string &dirname, const std::string &git_hashh);
+  std::string get_cache_dir() const;
+
+  std::size_t disk_hits() const;
+
+  // grid_name and n_voxels describe the grid the solution belongs to
+  const source_function_solution* find(const forward_model_key &key,
+				       const std::string &grid_name, const int n_voxels);
+  void insert(const forward_model_key &key, const source_function_solution &sol,
+	      const std::string &grid_name, const int n_voxels);
+
+  void reset_stats();
+};
+
+struct forward_model_cache_stats {
+  long source_function_hits;
+  long source_function_disk_hits;
+  long source_function_misses;
+  long source_function_entries;
+  long brightness_hits;
+  long brightness_misses;
+  long brightness_entries;
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include "Real.hpp"
 #include "cuda_compatibility.hpp"
 #include "atmo_vec.hpp"
+#include "intersections.hpp"
 #include <algorithm>
 #include <limits>
 #include <iostream>
@@ -192,6 +193,26 @@ public:
     }
   }
 
+  // add the hits from intersecting the ray with N boundaries of
+  // dimension dim at once (see sphere_batch and cone_batch), which
+  // have indices first_idx, first_idx+1, ... and coordinates
+  // coordinates[0], coordinates[1], ...
+  template <int N>
+  CUDA_CALLABLE_MEMBER
+  void add_intersections(const Real start, const int dim,
+			 const int first_idx, const Real *coordinates,
+			 const batch_intersections<N> &hits) {
+    for (int i=0;i<N;i++) {
+      const int n_hits = hits.n_hits(i);
+      if (n_hits == 0)
+	continue;
+      // pack the hits as the scalar intersections do
+      const Real distances[2] = {hits.hit(0, i) ? hits.distances[0][i] : hits.distances[1][i],
+				 hits.distances[1][i]};
+      add_intersections(start, dim, first_idx+i, coordinates[i], distances, n_hits);
+    }
+  }
+
   CUDA_CALLABLE_MEMBER
   void propagate_indices() {
     //propogate voxel indices in each coordinate
@@ -232,8 +253,11 @@ public:
   }
 
   
+  // periodic_dimension (if any) wraps around, so its index may also
+  // jump between the first and last voxel
   CUDA_CALLABLE_MEMBER
-  bool check(const int (&n_bounds)[NDIM], const int &n_voxels) const {
+  bool check(const int (&n_bounds)[NDIM], const int &n_voxels,
+	     __attribute__((unused)) const int periodic_dimension = -1) const {
     if (size() > 0) {
       assert(size() > 1 && "there must be more than one boundary crossing for each ray");
       
@@ -253,7 +277,9 @@ public:
 	  //we only get here if this boundary index is changing
 	  n_dims_changing++;
 	  assert(n_dims_changing <=1 && "only one boundary can be crossed at a time.");
-	  assert((diff==1||diff==-1) && "changes in each dimension must be continuous.");
+	  assert((diff==1||diff==-1
+		  || ((int) j == periodic_dimension && (diff == n_bounds[j]-1 || diff == 1-n_bounds[j])))
+		 && "changes in each dimension must be continuous.");
 	}	
 
 	assert(boundaries[i].entering < n_voxels
@@ -8,14 +8,15 @@
 #include "cuda_compatibility.hpp"
 #include "boundaries.hpp"
 #include "atm/atmosphere_base.hpp"
+#include "RT_binary_file.hpp"
 
 using std::string;
 
 template <int NDIM, int NVOXELS, int NRAYS, int N_MAX_INTERSECTIONS, typename derived>
 struct grid {
-  static const int n_dimensions = NDIM; //dimensionality of the grid
+  static constexpr int n_dimensions = NDIM; //dimensionality of the grid
   int n_pts[NDIM];
-  static const int n_voxels = NVOXELS;//number of grid voxels
+  static constexpr int n_voxels = NVOXELS;//number of grid voxels
 
   //helper functions to swap between voxel and coordinate indices
   CUDA_CALLABLE_MEMBER
@@ -43,22 +44,22 @@ struct grid {
   };
 
   //ray info
-  static const int n_rays = NRAYS;
+  static constexpr int n_rays = NRAYS;
   atmo_ray rays[NRAYS];
   void setup_rays() {
     static_cast<derived*>(this)->setup_rays();
   } 
   
   //how to intersect rays with voxel boundaries
-  static const int n_max_intersections = N_MAX_INTERSECTIONS;
+  static constexpr int n_max_intersections = N_MAX_INTERSECTIONS;
   CUDA_CALLABLE_MEMBER
   void ray_voxel_intersections(const atmo_vector &vec,
 			       boundary_intersection_stepper<n_dimensions, n_max_intersections> &stepper) const {
     static_cast<const derived*>(this)->ray_voxel_intersections(vec, stepper);
   } 
   
-  //function to get interpolation coefs
-  static const int n_interp_points = 2*n_dimensions;
+  //function to get interpolation coefs, linear in each dimension
+  static constexpr int n_interp_points = 1 << n_dimensions;
   CUDA_CALLABLE_MEMBER
   void interp_weights(const int &ivoxel, const atmo_point &pt,
 		      int (&indices)[n_interp_points], Real (&weights)[n_interp_points],
@@ -72,6 +73,49 @@ struct grid {
   void save_S(const string &fname, const E* const *emiss, const int n_emissions) const {
     static_cast<const derived*>(this)->save_S(fname, emiss, n_emissions);
   }
+
+  // describe the grid in a binary file: the rays here, boundaries and
+  // points in the derived grid
+  void save_binary(RT_binary_writer &writer) const {
+    writer.add_metadata("n_dimensions", int(n_dimensions));
+    writer.add_metadata("n_voxels", int(n_voxels));
+    writer.add_metadata("n_rays", int(n_rays));
+    writer.add_metadata("rmin", rmin);
+    writer.add_metadata("rmax", rmax);
+
+    VectorX ray_t(n_rays), ray_p(n_rays), ray_domega(n_rays);
+    for (int i_ray=0;i_ray<n_rays;i_ray++) {
+      ray_t[i_ray] = rays[i_ray].t;
+      ray_p[i_ray] = rays[i_ray].p;
+      ray_domega[i_ray] = rays[i_ray].domega;
+    }
+    writer.add_array("grid/ray_t", ray_t);
+    writer.add_array("grid/ray_p", ray_p);
+    writer.add_array("grid/ray_domega", ray_domega);
+
+    static_cast<const derived*>(this)->save_grid_binary(writer);
+  }
+
+  // restore the voxels and rays of a grid saved by save_binary,
+  // returning false if the file describes a different grid
+  bool load_binary(const RT_binary_file &file) {
+    int file_n_voxels, file_n_rays;
+    Real file_rmin, file_rmax;
+    if (!(file.metadata("n_voxels", file_n_voxels)
+	  && file.metadata("n_rays", file_n_rays)
+	  && file.metadata("rmin", file_rmin)
+	  && file.metadata("rmax", file_rmax))
+	|| file_n_voxels != n_voxels
+	|| file_n_rays != n_rays)
+      return false;
+
+    rmin = file_rmin;
+    rmax = file_rmax;
+    if (!static_cast<derived*>(this)->load_grid_binary(file))
+      return false;
+    setup_rays();
+    return true;
+  }
 };
 
 #endif
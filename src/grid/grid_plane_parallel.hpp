@@ -186,6 +186,11 @@ struct plane_parallel_grid : grid<1,//N_DIMENSIONS, this is a 1D grid
       radial_boundaries[0] = atm_avg->rmin;
     }
 
+    setup_voxel_geometry();
+  }
+
+  // everything else about the voxels follows from the boundaries
+  void setup_voxel_geometry() {
     for (int i=0; i<n_radial_boundaries-1; i++) {
       this->voxels[i].rbounds[0] = radial_boundaries[i];
       this->voxels[i].rbounds[1] = radial_boundaries[i+1];
@@ -310,6 +315,29 @@ struct plane_parallel_grid : grid<1,//N_DIMENSIONS, this is a 1D grid
     assert(false && "interp_weights not implemented in grid_plane_parallel");
   }
 
+  void save_grid_binary(RT_binary_writer &writer) const {
+    writer.add_metadata("grid", "plane_parallel");
+    writer.add_metadata("rmethod", rmethod);
+    writer.add_array("grid/radial_boundaries", radial_boundaries, n_radial_boundaries);
+    writer.add_array("grid/pts_radii", pts_radii, n_radial_boundaries-1);
+  }
+
+  bool load_grid_binary(const RT_binary_file &file) {
+    if (file.metadata("grid") != "plane_parallel"
+	|| !file.has_array("grid/radial_boundaries"))
+      return false;
+    auto file_radial_boundaries = file.vector("grid/radial_boundaries");
+    if (file_radial_boundaries.size() != n_radial_boundaries
+	|| !file.metadata("rmethod", rmethod))
+      return false;
+
+    for (int i=0;i<n_radial_boundaries;i++)
+      radial_boundaries[i] = file_radial_boundaries[i];
+
+    setup_voxel_geometry();
+    return true;
+  }
+
   template<typename E>
   void save_S(const string &fname, const E* const *emissions, const int n_emissions) const {
     std::ofstream file(fname.c_str());
@@ -0,0 +1,574 @@
+// grid_spherical_3d.h -- spherical grid in radius, SZA, and azimuth around the Mars-Sun line
+
+#ifndef __grid_spherical_3d
+#define __grid_spherical_3d
+
+#include "Real.hpp"
+#include "constants.hpp"
+#include "cuda_compatibility.hpp"
+#include "grid.hpp"
+#include "coordinate_generation.hpp"
+#include "gauss_legendre_quadrature.hpp"
+#include "boundaries.hpp"
+#include "atm/atmosphere_base.hpp"
+#include "intersections.hpp"
+#include <fstream>
+#include <cmath>
+#include <string>
+
+// Unlike spherical_azimuthally_symmetric_grid, the SZA boundaries run
+// from 0 to pi with voxels meeting at the planet-sun line, and the
+// azimuth (local time) is divided into N_PHI wedges by half planes
+// that meet on the same line. The azimuth index wraps around.
+//
+// Influence matrices on this grid are usually too large to store
+// densely; emissions then store them row-compressed and solve
+// iteratively (see emission_voxels::sparse_influence).
+template <int N_RADIAL_BOUNDARIES, int N_SZA_BOUNDARIES, int N_PHI, int N_RAY_THETA, int N_RAY_PHI>
+struct spherical_3d_grid : grid<3, //this is a 3D grid
+				(N_RADIAL_BOUNDARIES-1)*(N_SZA_BOUNDARIES-1)*N_PHI,//nvoxels
+				N_RAY_THETA*N_RAY_PHI,//nrays
+				2*N_RADIAL_BOUNDARIES+2*N_SZA_BOUNDARIES+N_PHI,//max_boundary_crossings
+				spherical_3d_grid<N_RADIAL_BOUNDARIES,
+						  N_SZA_BOUNDARIES,
+						  N_PHI,
+						  N_RAY_THETA,
+						  N_RAY_PHI>>
+{
+  typedef grid<3/*N_DIM*/,
+	       (N_RADIAL_BOUNDARIES-1)*(N_SZA_BOUNDARIES-1)*N_PHI/*N_VOXELS*/,
+	       N_RAY_THETA*N_RAY_PHI/*N_RAYS*/,
+	       2*N_RADIAL_BOUNDARIES+2*N_SZA_BOUNDARIES+N_PHI/*N_MAX_INTERSECTIONS*/,
+	       spherical_3d_grid<N_RADIAL_BOUNDARIES,
+				 N_SZA_BOUNDARIES,
+				 N_PHI,
+				 N_RAY_THETA,
+				 N_RAY_PHI>> parent_grid;
+
+  // a cone at SZA = pi/2 is a plane, which the cone intersections
+  // cannot handle; with an odd number of SZA voxels no boundary falls
+  // there
+  static_assert((N_SZA_BOUNDARIES-1)%2 == 1, "number of SZA voxels must be odd");
+  static_assert(N_PHI >= 3, "at least three azimuth voxels are needed");
+
+  static const int r_dimension = 0;
+  static const int n_radial_boundaries = N_RADIAL_BOUNDARIES;
+  int rmethod;
+  static const int rmethod_altitude = 0;
+  static const int rmethod_log_n_species = 1;
+
+  Real radial_boundaries[n_radial_boundaries];
+  Real pts_radii[n_radial_boundaries-1];
+  Real log_pts_radii[n_radial_boundaries-1];
+  sphere_batch<n_radial_boundaries> radial_boundary_spheres;
+
+  static const int sza_dimension = 1;
+  static const int n_sza_boundaries = N_SZA_BOUNDARIES;
+  int szamethod;
+  static const int szamethod_uniform = 0;
+  static const int szamethod_uniform_cos = 1;
+
+  Real sza_boundaries[n_sza_boundaries];
+  Real pts_sza[n_sza_boundaries-1];
+  cone_batch<n_sza_boundaries-2> sza_boundary_cones;//no cones at 0 and pi
+
+  static const int phi_dimension = 2;
+  static const int n_phi_voxels = N_PHI;
+  Real phi_boundaries[n_phi_voxels+1];//last boundary is 2pi, same as the first
+  Real pts_phi[n_phi_voxels];
+  half_plane phi_boundary_planes[n_phi_voxels];
+
+  int raymethod_theta;
+  static const int raymethod_theta_gauss = 0;
+  static const int raymethod_theta_uniform = 1;
+
+  static const int n_theta = N_RAY_THETA;
+  Real ray_theta[n_theta];
+  static const int n_phi = N_RAY_PHI;
+  Real ray_phi[n_phi];
+
+  spherical_3d_grid()
+  {
+    this->n_pts[r_dimension] = n_radial_boundaries-1;
+    this->n_pts[sza_dimension] = n_sza_boundaries-1;
+    this->n_pts[phi_dimension] = n_phi_voxels;
+
+    rmethod = rmethod_altitude;
+    szamethod = szamethod_uniform_cos;
+    raymethod_theta = raymethod_theta_gauss;
+  }
+
+  void setup_voxels(const atmosphere &atm) {
+    this->rmin = atm.rmin;
+    this->rmax = atm.rmax;
+
+    assert((rmethod == rmethod_altitude
+	    || rmethod == rmethod_log_n_species)
+	   && "rmethod must match a defined radial points method");
+    if (rmethod == rmethod_altitude) {
+      vector<Real> radial_boundaries_vector;
+      get_radial_log_linear_points(radial_boundaries_vector, n_radial_boundaries,
+				   atm.rmin, atm.rexo, atm.rmax);
+      for (int i=0;i<n_radial_boundaries;i++)
+	radial_boundaries[i] = radial_boundaries_vector[i];
+    }
+    if (rmethod == rmethod_log_n_species) {
+      Real log_n_species_max = log(atm.n_species(atm.rmin));
+      Real log_n_species_min = log(atm.n_species(atm.rmax));
+      Real log_n_species_step = (log_n_species_max-log_n_species_min)/(n_radial_boundaries-1.);
+
+      for(int i=0;i<n_radial_boundaries;i++) {
+	Real n_species_target=exp(log_n_species_max-i*log_n_species_step);
+	radial_boundaries[i]=atm.r_from_n_species(n_species_target);
+      }
+    }
+
+    assert((szamethod == szamethod_uniform || szamethod == szamethod_uniform_cos)
+	   && "szamethod must match a defined sza points method");
+    const int n_sza_voxels = n_sza_boundaries-1;
+    for (int i=0;i<n_sza_boundaries;i++) {
+      if (szamethod == szamethod_uniform)
+	sza_boundaries[i] = i*pi/n_sza_voxels;
+      if (szamethod == szamethod_uniform_cos)
+	sza_boundaries[i] = std::acos(REAL(1.0)-REAL(2.0)*i/n_sza_voxels);
+    }
+    sza_boundaries[0] = 0;
+    sza_boundaries[n_sza_boundaries-1] = pi;
+
+    for (int i=0;i<n_phi_voxels+1;i++)
+      phi_boundaries[i] = i*2*pi/n_phi_voxels;
+
+    setup_voxel_geometry();
+  }
+
+  // everything else about the voxels follows from the boundaries
+  void setup_voxel_geometry() {
+    for (int i=0; i<n_radial_boundaries-1; i++) {
+      pts_radii[i]=sqrt(radial_boundaries[i]*radial_boundaries[i+1]);
+      log_pts_radii[i]=log(pts_radii[i]);
+    }
+
+    for (int i=0; i<n_radial_boundaries; i++)
+      radial_boundary_spheres.set_radius(i, radial_boundaries[i]);
+
+    for (int i=0;i<n_sza_boundaries-1;i++)
+      pts_sza[i]=0.5*(sza_boundaries[i] + sza_boundaries[i+1]);
+
+    for (int i=0;i<n_sza_boundaries-2;i++) {
+      sza_boundary_cones.set_angle(i, sza_boundaries[i+1]);
+      sza_boundary_cones.set_rmin(this->rmin);
+    }
+
+    for (int i=0;i<n_phi_voxels;i++) {
+      pts_phi[i]=0.5*(phi_boundaries[i] + phi_boundaries[i+1]);
+      phi_boundary_planes[i].set_angle(phi_boundaries[i]);
+    }
+
+    int i_voxel;
+    for (int i=0; i<n_radial_boundaries-1; i++) {
+      for (int j=0;j<n_sza_boundaries-1;j++) {
+	for (int k=0;k<n_phi_voxels;k++) {
+	  indices_to_voxel(i, j, k, i_voxel);
+
+	  this->voxels[i_voxel].rbounds[0] = radial_boundaries[i];
+	  this->voxels[i_voxel].rbounds[1] = radial_boundaries[i+1];
+	  this->voxels[i_voxel].tbounds[0] = sza_boundaries[j];
+	  this->voxels[i_voxel].tbounds[1] = sza_boundaries[j+1];
+	  this->voxels[i_voxel].pbounds[0] = phi_boundaries[k];
+	  this->voxels[i_voxel].pbounds[1] = phi_boundaries[k+1];
+	  this->voxels[i_voxel].i_voxel = i_voxel;
+
+	  this->voxels[i_voxel].pt.rtp(pts_radii[i], pts_sza[j], pts_phi[k]);
+	  this->voxels[i_voxel].pt.set_voxel_index(i_voxel);
+	}
+      }
+    }
+  }
+
+  void setup_rays() {
+    vector<Real> ray_theta_vector;
+    vector<Real> ray_weights_theta;
+
+    if (raymethod_theta == raymethod_theta_gauss) {
+      gauss_quadrature_points(ray_theta_vector,ray_weights_theta,0,pi,n_theta);
+      for (int i=0;i<n_theta;i++)
+	ray_weights_theta[i]*=std::sin(ray_theta_vector[i]);
+    } else if (raymethod_theta == raymethod_theta_uniform) {
+      ray_theta_vector.resize(n_theta);
+      ray_weights_theta.resize(n_theta);
+      Real theta_spacing = pi/(n_theta-1);
+      for (int i=0;i<n_theta;i++) {
+	ray_theta_vector[i]  = i*theta_spacing;
+	if (i==0 || i==n_theta-1)
+	  ray_weights_theta[i] = 1-std::cos(theta_spacing/2);
+	else
+	  ray_weights_theta[i] = (std::cos(ray_theta_vector[i]-theta_spacing/2) -
+				  std::cos(ray_theta_vector[i]+theta_spacing/2));
+      }
+    } else
+      assert(false && "raymethod_theta must be raymethod_theta_gauss or raymethod_theta_uniform.");
+
+    for (int i=0;i<n_theta;i++)
+      ray_theta[i] = ray_theta_vector[i];
+
+    Real phi_spacing = 2*pi/n_phi;
+    for (int i=0;i<n_phi;i++)
+      ray_phi[i] = (i+0.5)*phi_spacing;
+
+    Real omega = 0.0; // make sure sum(domega) = 4*pi
+    int iray;
+    for (int i=0;i<n_theta;i++) {
+      for (int j=0;j<n_phi;j++) {
+	iray = i * n_phi + j;
+	this->rays[iray].tp(ray_theta[i],ray_phi[j]);
+	this->rays[iray].set_ray_index(iray, ray_weights_theta[i], phi_spacing);
+	omega += this->rays[iray].domega;
+      }
+    }
+    assert(std::abs(omega - 1.0) < EPS && "omega must = 4*pi\n");
+  }
+
+  CUDA_CALLABLE_MEMBER
+  static void indices_to_voxel(const int &r_idx, const int &sza_idx, const int &phi_idx, int & vox_idx) {
+    if ((r_idx   < 0) || (  r_idx > (int) n_radial_boundaries-2) ||
+	(sza_idx < 0) || (sza_idx > (int) n_sza_boundaries-2) ||
+	(phi_idx < 0) || (phi_idx > (int) n_phi_voxels-1))
+      vox_idx = -1;
+    else
+      vox_idx = (r_idx*(n_sza_boundaries-1)+sza_idx)*n_phi_voxels+phi_idx;
+  }
+  CUDA_CALLABLE_MEMBER
+  static void indices_to_voxel(const int (&indices)[parent_grid::n_dimensions], int & vox_idx) {
+    indices_to_voxel(indices[r_dimension], indices[sza_dimension], indices[phi_dimension], vox_idx);
+  }
+
+  CUDA_CALLABLE_MEMBER
+  static void voxel_to_indices(const int &i_voxel, int (&indices)[parent_grid::n_dimensions]) {
+    if ((i_voxel < 0) || (i_voxel > parent_grid::n_voxels-1)) {
+      indices[r_dimension]=-1;
+      indices[sza_dimension]=-1;
+      indices[phi_dimension]=-1;
+    } else {
+      indices[r_dimension]=i_voxel / ((n_sza_boundaries-1)*n_phi_voxels);
+      indices[sza_dimension]=(i_voxel / n_phi_voxels) % (n_sza_boundaries-1);
+      indices[phi_dimension]=i_voxel % n_phi_voxels;
+    }
+  }
+
+  template <class V>
+  CUDA_CALLABLE_MEMBER
+  int find_coordinate_index(const Real &pt_coord, const V &boundaries, int n_boundaries) const {
+    int i;
+
+    for (i=0;i<n_boundaries;i++)
+      if (pt_coord < boundaries[i])
+	break;
+
+    i--;
+
+    assert((boundaries[n_boundaries-1]<=pt_coord ||
+	    pt_coord < boundaries[0] ||
+	    (boundaries[i]<=pt_coord &&pt_coord<boundaries[i+1]))
+	   && "we have found the appropriate point index");
+
+    return i;
+  }
+
+  CUDA_CALLABLE_MEMBER
+  void point_to_indices(const atmo_point &pt, int (&indices)[parent_grid::n_dimensions]) const {
+    indices[r_dimension] = find_coordinate_index(pt.r, radial_boundaries, n_radial_boundaries);
+    // SZA and phi cover all directions, the first and last boundaries
+    // are only reached through rounding
+    indices[sza_dimension] = find_coordinate_index(pt.t, sza_boundaries, n_sza_boundaries);
+    if (indices[sza_dimension] < 0)
+      indices[sza_dimension] = 0;
+    if (indices[sza_dimension] > n_sza_boundaries-2)
+      indices[sza_dimension] = n_sza_boundaries-2;
+    indices[phi_dimension] = find_coordinate_index(pt.p, phi_boundaries, n_phi_voxels+1);
+    if (indices[phi_dimension] < 0 || indices[phi_dimension] > n_phi_voxels-1)
+      indices[phi_dimension] = 0;
+  }
+
+
+  CUDA_CALLABLE_MEMBER
+  void ray_voxel_intersections(const atmo_vector &vec,
+			       boundary_intersection_stepper<parent_grid::n_dimensions,
+			                                     parent_grid::n_max_intersections> &stepper) const {
+
+    stepper.vec = vec;
+    stepper.boundaries.reset();
+
+    //define the origin
+    boundary<parent_grid::n_dimensions> origin;
+    if (vec.pt.i_voxel == -1) {
+      point_to_indices(vec.pt,origin.entering_indices);
+      indices_to_voxel(origin.entering_indices,origin.entering);
+    } else {
+      origin.entering = vec.pt.i_voxel;
+      voxel_to_indices(origin.entering,origin.entering_indices);
+    }
+    origin.distance = 0.0;
+    stepper.boundaries.append(origin);
+
+    //do the intersections for each coordinate
+    batch_intersections<n_radial_boundaries> sphere_hits;
+    radial_boundary_spheres.intersections(vec, sphere_hits);
+    stepper.boundaries.add_intersections(vec.pt.r, r_dimension,
+					 0, radial_boundaries,
+					 sphere_hits);
+
+    batch_intersections<n_sza_boundaries-2> cone_hits;
+    sza_boundary_cones.intersections(vec, cone_hits);
+    stepper.boundaries.add_intersections(vec.pt.t, sza_dimension,
+					 1, sza_boundaries+1,
+					 cone_hits);
+
+    // phi wraps around, so which voxel is entered depends on the
+    // direction of the crossing rather than on the starting phi
+    int n_hits = 0;
+    Real temp_distances[2] = {-1,-1};
+    for (int iphi=0;iphi<n_phi_voxels;iphi++) {
+      phi_boundary_planes[iphi].intersections(vec, temp_distances, n_hits);
+      if (n_hits == 0)
+	continue;
+      boundary<parent_grid::n_dimensions> new_boundary;
+      new_boundary.reset();
+      new_boundary.entering_indices[phi_dimension] = (phi_boundary_planes[iphi].increasing(vec)
+						      ? iphi
+						      : (iphi+n_phi_voxels-1) % n_phi_voxels);
+      new_boundary.distance = temp_distances[0];
+      stepper.boundaries.append(new_boundary);
+    }
+
+    //sort the list of intersections by distance & trim
+    stepper.boundaries.sort();
+    stepper.boundaries.propagate_indices();
+    stepper.boundaries.assign_voxel_indices(this);
+    stepper.boundaries.trim();
+#if !defined(NDEBUG)
+    int tnvoxels = this->n_voxels;
+    assert(stepper.boundaries.check(this->n_pts, tnvoxels, phi_dimension) && "boundary checks must pass");
+#endif
+
+    stepper.init_stepper();
+  }
+
+  CUDA_CALLABLE_MEMBER
+  void interp_weights(const int &ivoxel, const atmo_point &ptt,
+		      int (&indices)[parent_grid::n_interp_points],
+		      Real (&weights)[parent_grid::n_interp_points],
+		      int (&indices_1d)[2*parent_grid::n_dimensions],
+		      Real (&weights_1d)[parent_grid::n_dimensions]) const {
+    // n_interp_points = 8, because this is a 3d grid with linear interpolation
+
+    atmo_point pt = ptt;
+
+    int coord_indices[parent_grid::n_dimensions];
+    voxel_to_indices(ivoxel, coord_indices);
+    const int r_idx = coord_indices[r_dimension];
+    const int sza_idx = coord_indices[sza_dimension];
+    const int phi_idx = coord_indices[phi_dimension];
+
+    if (pt.r < radial_boundaries[r_idx] && radial_boundaries[r_idx]/pt.r>(1-EPS))
+      pt.r = radial_boundaries[r_idx]+EPS;
+    if (radial_boundaries[r_idx+1]<pt.r && pt.r/radial_boundaries[r_idx+1]<(1+EPS))
+      pt.r = radial_boundaries[r_idx+1]-EPS;
+    assert(radial_boundaries[r_idx] <= pt.r &&
+	   pt.r <= radial_boundaries[r_idx+1]
+	   && "pt must be in identified voxel.");
+
+    int r_lower_pt_idx, r_upper_pt_idx;
+    Real r_wt;
+    if (r_idx == 0 && pt.r <= pts_radii[0]) {
+      //we are below the lowest radial point in the source function grid
+      r_lower_pt_idx=r_upper_pt_idx=0;
+      r_wt=1.0;
+    } else if (r_idx == n_radial_boundaries-2 &&  pts_radii[n_radial_boundaries-2] <= pt.r) {
+      //we are above the highest radial point in the source function grid
+      r_lower_pt_idx=r_upper_pt_idx=n_radial_boundaries-2;
+      r_wt=0.0;
+    } else {
+      if (pt.r < pts_radii[r_idx])
+	r_lower_pt_idx = r_idx - 1;
+      else
+	r_lower_pt_idx = r_idx;
+      r_upper_pt_idx = r_lower_pt_idx + 1;
+
+      assert(r_lower_pt_idx >= 0 && r_upper_pt_idx < n_radial_boundaries-1 && "interpolation points must lie on grid.");
+
+      r_wt = (log(pt.r) - log_pts_radii[r_lower_pt_idx])/(log_pts_radii[r_upper_pt_idx]-log_pts_radii[r_lower_pt_idx]);
+    }
+
+    // near the planet-sun line the values of the first and last SZA
+    // points are used, rather than interpolating across the pole
+    int sza_lower_pt_idx, sza_upper_pt_idx;
+    Real sza_wt;
+    if (pt.t <= pts_sza[0]) {
+      sza_lower_pt_idx=sza_upper_pt_idx=0;
+      sza_wt=0.0;
+    } else if (pts_sza[n_sza_boundaries-2] <= pt.t) {
+      sza_lower_pt_idx=sza_upper_pt_idx=n_sza_boundaries-2;
+      sza_wt=0.0;
+    } else {
+      if (pt.t < pts_sza[sza_idx])
+	sza_lower_pt_idx = sza_idx - 1;
+      else
+	sza_lower_pt_idx = sza_idx;
+      sza_upper_pt_idx = sza_lower_pt_idx + 1;
+      sza_wt = (pt.t-pts_sza[sza_lower_pt_idx])/(pts_sza[sza_upper_pt_idx]-pts_sza[sza_lower_pt_idx]);
+    }
+
+    // phi wraps around; measure it from the voxel point in (-pi, pi]
+    const Real phi_spacing = 2*pi/n_phi_voxels;
+    Real dphi = pt.p - pts_phi[phi_idx];
+    if (dphi > pi)
+      dphi -= 2*pi;
+    if (dphi <= -pi)
+      dphi += 2*pi;
+    int phi_lower_pt_idx, phi_upper_pt_idx;
+    Real phi_wt;
+    if (dphi < 0) {
+      phi_lower_pt_idx = (phi_idx + n_phi_voxels - 1) % n_phi_voxels;
+      phi_wt = 1 + dphi/phi_spacing;
+    } else {
+      phi_lower_pt_idx = phi_idx;
+      phi_wt = dphi/phi_spacing;
+    }
+    phi_upper_pt_idx = (phi_lower_pt_idx + 1) % n_phi_voxels;
+    phi_wt = phi_wt < 0 ? 0 : (phi_wt > 1 ? 1 : phi_wt);
+
+    //return the 1D points and weights
+    indices_1d[0] = r_lower_pt_idx;
+    indices_1d[1] = sza_lower_pt_idx;
+    indices_1d[2] = phi_lower_pt_idx;
+    indices_1d[3] = r_upper_pt_idx;
+    indices_1d[4] = sza_upper_pt_idx;
+    indices_1d[5] = phi_upper_pt_idx;
+
+    weights_1d[0] = r_wt;
+    weights_1d[1] = sza_wt;
+    weights_1d[2] = phi_wt;
+
+    //and the voxel numbers and weights, corner (i,j,k) is bit i of
+    //the point number for r, j for SZA, k for phi
+    for (int i_pt=0;i_pt<parent_grid::n_interp_points;i_pt++) {
+      const bool r_upper = i_pt & 1;
+      const bool sza_upper = i_pt & 2;
+      const bool phi_upper = i_pt & 4;
+      indices_to_voxel(r_upper ? r_upper_pt_idx : r_lower_pt_idx,
+		       sza_upper ? sza_upper_pt_idx : sza_lower_pt_idx,
+		       phi_upper ? phi_upper_pt_idx : phi_lower_pt_idx,
+		       indices[i_pt]);
+      weights[i_pt] = ((r_upper ? r_wt : REAL(1.0)-r_wt)
+		       *(sza_upper ? sza_wt : REAL(1.0)-sza_wt)
+		       *(phi_upper ? phi_wt : REAL(1.0)-phi_wt));
+    }
+  }
+
+  // values in each radial layer along one SZA and azimuth, for output
+  static VectorX column_slice(VectorX quantity, int i_column) {
+    VectorX ret;
+    int indices[parent_grid::n_dimensions];
+    indices[sza_dimension] = i_column / n_phi_voxels;
+    indices[phi_dimension] = i_column % n_phi_voxels;
+
+    ret.resize(n_radial_boundaries-1);
+    for (int i=0;i<n_radial_boundaries-1;i++) {
+      indices[r_dimension]=i;
+      int voxel;
+      indices_to_voxel(indices, voxel);
+      ret(i) = quantity(voxel);
+    }
+
+    return ret;
+  }
+
+  void save_grid_binary(RT_binary_writer &writer) const {
+    writer.add_metadata("grid", "spherical_3d");
+    writer.add_metadata("rmethod", rmethod);
+    writer.add_metadata("szamethod", szamethod);
+    writer.add_metadata("raymethod_theta", raymethod_theta);
+    writer.add_array("grid/radial_boundaries", radial_boundaries, n_radial_boundaries);
+    writer.add_array("grid/pts_radii", pts_radii, n_radial_boundaries-1);
+    writer.add_array("grid/sza_boundaries", sza_boundaries, n_sza_boundaries);
+    writer.add_array("grid/pts_sza", pts_sza, n_sza_boundaries-1);
+    writer.add_array("grid/phi_boundaries", phi_boundaries, n_phi_voxels+1);
+    writer.add_array("grid/pts_phi", pts_phi, n_phi_voxels);
+    writer.add_array("grid/ray_theta", ray_theta, n_theta);
+    writer.add_array("grid/ray_phi", ray_phi, n_phi);
+  }
+
+  bool load_grid_binary(const RT_binary_file &file) {
+    if (file.metadata("grid") != "spherical_3d"
+	|| !file.has_array("grid/radial_boundaries")
+	|| !file.has_array("grid/sza_boundaries")
+	|| !file.has_array("grid/phi_boundaries"))
+      return false;
+    auto file_radial_boundaries = file.vector("grid/radial_boundaries");
+    auto file_sza_boundaries = file.vector("grid/sza_boundaries");
+    auto file_phi_boundaries = file.vector("grid/phi_boundaries");
+    if (file_radial_boundaries.size() != n_radial_boundaries
+	|| file_sza_boundaries.size() != n_sza_boundaries
+	|| file_phi_boundaries.size() != n_phi_voxels+1)
+      return false;
+    if (!(file.metadata("rmethod", rmethod)
+	  && file.metadata("szamethod", szamethod)
+	  && file.metadata("raymethod_theta", raymethod_theta)))
+      return false;
+
+    for (int i=0;i<n_radial_boundaries;i++)
+      radial_boundaries[i] = file_radial_boundaries[i];
+    for (int i=0;i<n_sza_boundaries;i++)
+      sza_boundaries[i] = file_sza_boundaries[i];
+    for (int i=0;i<n_phi_voxels+1;i++)
+      phi_boundaries[i] = file_phi_boundaries[i];
+
+    setup_voxel_geometry();
+    return true;
+  }
+
+  template<typename E>
+  void save_S(const string &fname, const E* const *emissions, const int n_emissions) const {
+    std::ofstream file(fname.c_str());
+    if (file.is_open())
+      {
+	VectorX r_boundaries_write_out = Eigen::Map<const VectorX>(radial_boundaries,
+								   n_radial_boundaries);
+	file << "radial boundaries [cm]: " << r_boundaries_write_out.transpose() << "\n\n";
+
+	VectorX r_pts_write_out = Eigen::Map<const VectorX>(pts_radii,
+							    n_radial_boundaries-1);
+	file << "pts radii [cm]: " << r_pts_write_out.transpose() << "\n\n";
+
+	VectorX sza_boundaries_write_out = Eigen::Map<const VectorX>(sza_boundaries,
+								     n_sza_boundaries);
+	file << "sza boundaries [rad]: " << sza_boundaries_write_out.transpose() << "\n\n";
+
+	VectorX sza_pts_write_out = Eigen::Map<const VectorX>(pts_sza,
+							      n_sza_boundaries-1);
+	file << "pts sza [rad]: " << sza_pts_write_out.transpose() << "\n\n";
+
+	VectorX phi_boundaries_write_out = Eigen::Map<const VectorX>(phi_boundaries,
+								     n_phi_voxels+1);
+	file << "phi boundaries [rad]: " << phi_boundaries_write_out.transpose() << "\n\n";
+
+	VectorX phi_pts_write_out = Eigen::Map<const VectorX>(pts_phi,
+							      n_phi_voxels);
+	file << "pts phi [rad]: " << phi_pts_write_out.transpose() << "\n\n";
+
+	for (int i_emission=0;i_emission<n_emissions;i_emission++) {
+	  file << "For " << emissions[i_emission]->name() << "\n";
+	  for (int j=0; j<n_sza_boundaries-1; j++) {
+	    for (int k=0; k<n_phi_voxels; k++) {
+	      file << "  For SZA = " << pts_sza[j] << ", phi = " << pts_phi[k] << ": \n";
+	      emissions[i_emission]->save(file,column_slice,j*n_phi_voxels+k);
+	    }
+	  }
+	}
+      }
+    file.close();
+  }
+
+};
+
+#endif
@@ -47,7 +47,7 @@ struct spherical_azimuthally_symmetric_grid : grid<2, //this is a 2D grid
   Real radial_boundaries[n_radial_boundaries];
   Real pts_radii[n_radial_boundaries-1];
   Real log_pts_radii[n_radial_boundaries-1];
-  sphere radial_boundary_spheres[n_radial_boundaries];
+  sphere_batch<n_radial_boundaries> radial_boundary_spheres;
 
   static const int sza_dimension = 1;
   static const int n_sza_boundaries = N_SZA_BOUNDARIES;
@@ -57,7 +57,7 @@ struct spherical_azimuthally_symmetric_grid : grid<2, //this is a 2D grid
 
   Real sza_boundaries[n_sza_boundaries];
   Real pts_sza[n_sza_boundaries-1];
-  cone sza_boundary_cones[n_sza_boundaries-2];//there are extra
+  cone_batch<n_sza_boundaries-2> sza_boundary_cones;//there are extra
 					      //boundaries outside of
 					      //the range to put
 					      //pts_sza=0,-1 on the
@@ -299,16 +299,6 @@ struct spherical_azimuthally_symmetric_grid : grid<2, //this is a 2D grid
       radial_boundaries[0] = atm_avg->rmin;
     }
     
-    for (int i=0; i<n_radial_boundaries-1; i++) {
-      pts_radii[i]=sqrt(radial_boundaries[i]*radial_boundaries[i+1]);
-      log_pts_radii[i]=log(pts_radii[i]);
-    }
-
-    for (int i=0; i<n_radial_boundaries; i++) 
-      radial_boundary_spheres[i].set_radius(radial_boundaries[i]);
-
-
-
     assert((szamethod == szamethod_uniform || szamethod == szamethod_uniform_cos)
 	   && "szamethod must match a defined sza points method");
     if (szamethod == szamethod_uniform) {
@@ -327,14 +317,27 @@ struct spherical_azimuthally_symmetric_grid : grid<2, //this is a 2D grid
       }
       sza_boundaries[n_sza_boundaries-1] = pi + acos(1.0-0.5*cos_sza_spacing);
     }
-  
+
+    setup_voxel_geometry();
+  }
+
+  // everything else about the voxels follows from the boundaries
+  void setup_voxel_geometry() {
+    for (int i=0; i<n_radial_boundaries-1; i++) {
+      pts_radii[i]=sqrt(radial_boundaries[i]*radial_boundaries[i+1]);
+      log_pts_radii[i]=log(pts_radii[i]);
+    }
+
+    for (int i=0; i<n_radial_boundaries; i++) 
+      radial_boundary_spheres.set_radius(i, radial_boundaries[i]);
+
     for (unsigned int i=0;i<n_sza_boundaries-1;i++) {
       pts_sza[i]=0.5*(sza_boundaries[i] + sza_boundaries[i+1]);
     }
     
     for (int i=0;i<n_sza_boundaries-2;i++) {
-      sza_boundary_cones[i].set_angle(sza_boundaries[i+1]);
-      sza_boundary_cones[i].set_rmin(atm.rmin);//radius below which to ignore
+      sza_boundary_cones.set_angle(i, sza_boundaries[i+1]);
+      sza_boundary_cones.set_rmin(this->rmin);//radius below which to ignore
 				               //bad cone intersections for
 				               //floating point rounding
 				               //reasons
@@ -477,21 +480,17 @@ struct spherical_azimuthally_symmetric_grid : grid<2, //this is a 2D grid
     stepper.boundaries.append(origin);
 
     //do the intersections for each coordinate
-    int n_hits = 0;
-    Real temp_distances[2] = {-1,-1};
-    for (unsigned int ir=0;ir<n_radial_boundaries;ir++) {
-      radial_boundary_spheres[ir].intersections(vec, temp_distances, n_hits);
-      stepper.boundaries.add_intersections(vec.pt.r, r_dimension,
-					   ir, radial_boundaries[ir],
-					   temp_distances, n_hits);
-    }
-
-    for (unsigned int isza=0;isza<n_sza_boundaries-2;isza++) {
-      sza_boundary_cones[isza].intersections(vec, temp_distances, n_hits);
-      stepper.boundaries.add_intersections(vec.pt.t, sza_dimension,
-					   isza+1, sza_boundaries[isza+1],
-					   temp_distances, n_hits);
-    }
+    batch_intersections<n_radial_boundaries> sphere_hits;
+    radial_boundary_spheres.intersections(vec, sphere_hits);
+    stepper.boundaries.add_intersections(vec.pt.r, r_dimension,
+					 0, radial_boundaries,
+					 sphere_hits);
+
+    batch_intersections<n_sza_boundaries-2> cone_hits;
+    sza_boundary_cones.intersections(vec, cone_hits);
+    stepper.boundaries.add_intersections(vec.pt.t, sza_dimension,
+					 1, sza_boundaries+1,
+					 cone_hits);
 
     //sort the list of intersections by distance & trim
     stepper.boundaries.sort();
@@ -611,6 +610,149 @@ struct spherical_azimuthally_symmetric_grid : grid<2, //this is a 2D grid
 	   && "interpolation weights must sum to 1.");
   }
 
+  // Interpolation from voxel quantities on a coarser grid of the same
+  // atmosphere to the voxel points of this grid, with the weights used
+  // for brightness (linear in log radius and SZA). Row i holds the
+  // weights for voxel i of this grid.
+  template <typename C>
+  SparseMatrixX interpolation_from(const C &coarse) const {
+    vector<Eigen::Triplet<Real>> weights;
+    weights.reserve(parent_grid::n_voxels*C::n_interp_points);
+
+    for (int i_voxel=0;i_voxel<parent_grid::n_voxels;i_voxel++) {
+      // keep the point inside the range covered by the coarse voxel points
+      atmo_point pt = this->voxels[i_voxel].pt;
+      Real r = pt.r;
+      Real t = pt.t;
+      const Real t_max = coarse.pts_sza[C::n_sza_boundaries-2];
+      if (t >= t_max)
+	t = t_max - CONEEPS*std::abs(t_max - coarse.pts_sza[C::n_sza_boundaries-3]);
+      if (t < coarse.pts_sza[0])
+	t = coarse.pts_sza[0];
+      r = std::max(r, coarse.radial_boundaries[0]);
+      r = std::min(r, coarse.radial_boundaries[C::n_radial_boundaries-1]);
+      pt.rtp(r, t, 0.);
+
+      int coarse_indices[C::n_dimensions];
+      coarse.point_to_indices(pt, coarse_indices);
+      coarse_indices[C::r_dimension] = std::min(coarse_indices[C::r_dimension], C::n_radial_boundaries-2);
+      int coarse_voxel;
+      coarse.indices_to_voxel(coarse_indices, coarse_voxel);
+
+      int indices[C::n_interp_points];
+      Real voxel_weights[C::n_interp_points];
+      int indices_1d[2*C::n_dimensions];
+      Real weights_1d[C::n_dimensions];
+      coarse.interp_weights(coarse_voxel, pt, indices, voxel_weights, indices_1d, weights_1d);
+
+      for (int i_interp=0;i_interp<C::n_interp_points;i_interp++)
+	weights.emplace_back(i_voxel, indices[i_interp], voxel_weights[i_interp]);
+    }
+
+    // repeated coarse points (at the grid edges) are summed
+    SparseMatrixX interp(parent_grid::n_voxels, C::n_voxels);
+    interp.setFromTriplets(weights.begin(), weights.end());
+    return interp;
+  }
+
+  // Error estimate for each radial layer of a solution, for adaptive
+  // refinement, from the source function and the line center optical
+  // depth per unit length in each voxel. The worst SZA is taken. Two
+  // terms contribute: the curvature k of log S in log r, which the
+  // linear interpolation misses over a layer of width h unless
+  // h*sqrt(k) is small, and the optical depth step across the layer,
+  // which the constant source function in each voxel misses once it
+  // approaches 1. The step enters as dtau/(1+dtau) so that optically
+  // thick layers, where the source function saturates, do not take
+  // the whole budget.
+  vector<Real> radial_layer_error(const VectorX &sourcefn, const VectorX &dtau) const {
+    assert(sourcefn.size() == parent_grid::n_voxels && dtau.size() == parent_grid::n_voxels
+	   && "one value per voxel is required");
+    const int n_layers = n_radial_boundaries-1;
+    vector<Real> error(n_layers, 0.0);
+
+    for (int j=0;j<n_sza_boundaries-1;j++) {
+      VectorX log_S = sza_slice(sourcefn, j);
+      for (int i=0;i<n_layers;i++)
+	log_S(i) = std::log(std::max(log_S(i), REAL(1e-30)));
+      const VectorX dtau_slice = sza_slice(dtau, j);
+
+      for (int i=0;i<n_layers;i++) {
+	// the end layers take the curvature of their neighbor
+	const int ic = std::min(std::max(i, 1), n_layers-2);
+	const Real h_lower = log_pts_radii[ic]-log_pts_radii[ic-1];
+	const Real h_upper = log_pts_radii[ic+1]-log_pts_radii[ic];
+	const Real curvature = 2*((log_S(ic+1)-log_S(ic))/h_upper
+				  - (log_S(ic)-log_S(ic-1))/h_lower)/(h_lower+h_upper);
+
+	const Real h = std::log(radial_boundaries[i+1]/radial_boundaries[i]);
+	const Real layer_tau = dtau_slice(i)*(radial_boundaries[i+1]-radial_boundaries[i]);
+	const Real layer_error = h*std::sqrt(std::abs(curvature)) + layer_tau/(1+layer_tau);
+
+	error[i] = std::max(error[i], layer_error);
+      }
+    }
+
+    return error;
+  }
+
+  // Move the radial boundaries so that each layer carries an equal
+  // share of layer_error (from radial_layer_error), keeping the
+  // innermost and outermost boundaries. The error is taken to be
+  // spread evenly in log r across each current layer. A fraction
+  // keep_fraction of the total is shared equally between the current
+  // layers instead, which limits how far one pass moves the grid away
+  // from the rmethod spacing: the optically thick layers set the
+  // source function everywhere above them and must not be emptied.
+  void redistribute_radial_boundaries(const vector<Real> &layer_error,
+				      const Real keep_fraction = 0.8) {
+    const int n_layers = n_radial_boundaries-1;
+    assert((int) layer_error.size() == n_layers && "one error estimate per layer is required");
+    assert(0 < keep_fraction && keep_fraction <= 1 && "keep_fraction must be in (0,1]");
+
+    vector<doubReal> log_r(n_radial_boundaries);
+    for (int i=0;i<n_radial_boundaries;i++)
+      log_r[i] = std::log(radial_boundaries[i]);
+
+    doubReal total_error = 0;
+    for (int i=0;i<n_layers;i++)
+      total_error += layer_error[i];
+    if (!(total_error > 0))
+      return;
+
+    // cumulative error, piecewise linear in log r
+    vector<doubReal> cumulative_error(n_radial_boundaries, 0.0);
+    for (int i=0;i<n_layers;i++)
+      cumulative_error[i+1] = (cumulative_error[i]
+			       + (1-keep_fraction)*layer_error[i]
+			       + keep_fraction*total_error/n_layers);
+
+    // place the new boundaries at equal steps in cumulative error
+    const doubReal error_step = cumulative_error[n_layers]/n_layers;
+    int i_layer = 0;
+    for (int i=1;i<n_layers;i++) {
+      const doubReal target = i*error_step;
+      while (cumulative_error[i_layer+1] < target && i_layer < n_layers-1)
+	i_layer++;
+      const doubReal frac = ((target - cumulative_error[i_layer])
+			     /
+			     (cumulative_error[i_layer+1] - cumulative_error[i_layer]));
+      radial_boundaries[i] = std::exp(log_r[i_layer] + frac*(log_r[i_layer+1]-log_r[i_layer]));
+    }
+
+    setup_voxel_geometry();
+  }
+
+  vector<Real> get_radial_boundaries() const {
+    return vector<Real>(radial_boundaries, radial_boundaries+n_radial_boundaries);
+  }
+  void set_radial_boundaries(const vector<Real> &boundaries) {
+    assert((int) boundaries.size() == n_radial_boundaries && "one value per radial boundary is required");
+    for (int i=0;i<n_radial_boundaries;i++)
+      radial_boundaries[i] = boundaries[i];
+    setup_voxel_geometry();
+  }
+
   static VectorX sza_slice(VectorX quantity, int i_sza) {
     VectorX ret;
     int indices[parent_grid::n_dimensions];
@@ -627,6 +769,43 @@ struct spherical_azimuthally_symmetric_grid : grid<2, //this is a 2D grid
     return ret;
   }
 
+  void save_grid_binary(RT_binary_writer &writer) const {
+    writer.add_metadata("grid", "spherical_azimuthally_symmetric");
+    writer.add_metadata("rmethod", rmethod);
+    writer.add_metadata("szamethod", szamethod);
+    writer.add_metadata("raymethod_theta", raymethod_theta);
+    writer.add_array("grid/radial_boundaries", radial_boundaries, n_radial_boundaries);
+    writer.add_array("grid/pts_radii", pts_radii, n_radial_boundaries-1);
+    writer.add_array("grid/sza_boundaries", sza_boundaries, n_sza_boundaries);
+    writer.add_array("grid/pts_sza", pts_sza, n_sza_boundaries-1);
+    writer.add_array("grid/ray_theta", ray_theta, n_theta);
+    writer.add_array("grid/ray_phi", ray_phi, n_phi);
+  }
+
+  bool load_grid_binary(const RT_binary_file &file) {
+    if (file.metadata("grid") != "spherical_azimuthally_symmetric"
+	|| !file.has_array("grid/radial_boundaries")
+	|| !file.has_array("grid/sza_boundaries"))
+      return false;
+    auto file_radial_boundaries = file.vector("grid/radial_boundaries");
+    auto file_sza_boundaries = file.vector("grid/sza_boundaries");
+    if (file_radial_boundaries.size() != n_radial_boundaries
+	|| file_sza_boundaries.size() != n_sza_boundaries)
+      return false;
+    if (!(file.metadata("rmethod", rmethod)
+	  && file.metadata("szamethod", szamethod)
+	  && file.metadata("raymethod_theta", raymethod_theta)))
+      return false;
+
+    for (int i=0;i<n_radial_boundaries;i++)
+      radial_boundaries[i] = file_radial_boundaries[i];
+    for (int i=0;i<n_sza_boundaries;i++)
+      sza_boundaries[i] = file_sza_boundaries[i];
+
+    setup_voxel_geometry();
+    return true;
+  }
+
   template<typename E>
   void save_S(const string &fname, const E* const *emissions, const int n_emissions) const {
     std::ofstream file(fname.c_str());
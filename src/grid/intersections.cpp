@@ -1,6 +1,7 @@
 //intersections.h -- routines for computing intersections between lines and geometric primitives
 
 #include "intersections.hpp"
+#include "constants.hpp"
 #include <cmath>
 
 CUDA_CALLABLE_MEMBER
@@ -179,3 +180,58 @@ void cone::intersections(const atmo_vector & vec,
 }
 
 
+
+
+
+//half plane
+
+void half_plane::set_angle(const Real &a) {
+  angle=a;
+  cosangle=std::cos(angle);
+  sinangle=std::sin(angle);
+}
+
+CUDA_CALLABLE_MEMBER
+bool half_plane::increasing(const atmo_vector & vec) const {
+  // component of the ray along the normal (-sin phi, cos phi, 0)
+  return vec.line_y*cosangle - vec.line_x*sinangle > 0;
+}
+
+CUDA_CALLABLE_MEMBER
+void half_plane::intersections(const atmo_vector & vec,
+			       Real (&distances)[2],
+			       int &n_hits) const {
+  n_hits = 0;
+
+  const Real rscale = vec.pt.r;
+  const Real normal_pt = (vec.pt.y*cosangle - vec.pt.x*sinangle)/rscale;
+  const Real normal_line = vec.line_y*cosangle - vec.line_x*sinangle;
+
+  if (!is_zero(normal_line)) {
+    const Real d = -normal_pt/normal_line;
+    // the plane is crossed on the phi side of the z axis, not the
+    // phi+pi side
+    const Real along = ((vec.pt.x + d*rscale*vec.line_x)*cosangle
+			+ (vec.pt.y + d*rscale*vec.line_y)*sinangle);
+    if (d > 0 && along > 0) {
+      distances[n_hits]=d*rscale;
+      n_hits++;
+    }
+  }
+
+#ifndef NDEBUG
+  for (int i=0;i<n_hits;i++) {
+    atmo_point ipt = vec.extend(distances[i]);
+    Real dphi = ipt.p - angle;
+    if (dphi > pi)
+      dphi -= 2*pi;
+    if (dphi < -pi)
+      dphi += 2*pi;
+    if (ipt.r*std::sin(ipt.t) > CONEEPS*rscale)
+      //points very close to the z axis (including rays through the
+      //origin, where every half plane meets) have poorly defined phi
+      assert(is_zero(dphi,CONEEPS)
+	     && "vector must intersect half plane at specified distance.");
+  }
+#endif
+}
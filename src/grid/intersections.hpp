@@ -6,6 +6,7 @@
 #include "Real.hpp"
 #include "cuda_compatibility.hpp"
 #include "atmo_vec.hpp"
+#include <cmath>
 
 class geom_primitive {
  protected:
@@ -62,6 +63,191 @@ public:
 		     int &n_hits) const;
 };
 
+
+// Batch versions of sphere and cone intersections, for the grids that
+// intersect every ray with all of their spheres and cones. The
+// surface parameters (radii, cone cosines) are stored in arrays so
+// that one ray is intersected with all N surfaces in a single loop,
+// which the compiler vectorizes, instead of N out-of-line calls. The
+// arithmetic is that of the scalar versions above, with every branch
+// replaced by a select so that the loop body is straight-line code
+// (GCC also needs -fno-math-errno -fno-trapping-math to vectorize
+// the square root, see the makefile).
+
+// vectorize the loop that follows on the CPU, where OpenMP is enabled
+#if defined(_OPENMP) && !defined(__CUDA_ARCH__)
+#define INTERSECTIONS_SIMD _Pragma("omp simd")
+#else
+#define INTERSECTIONS_SIMD
+#endif
+
+template <int N>
+struct batch_intersections {
+  // up to two hits per surface, in the order the scalar versions
+  // list them. Hits are at positive distances along the ray, so the
+  // sign of the distance is the hit mask: misses are stored as
+  // no_hit.
+  static constexpr Real no_hit = -1;
+  Real distances[2][N];
+
+  CUDA_CALLABLE_MEMBER
+  bool hit(const int i_hit, const int i_surface) const {
+    return distances[i_hit][i_surface] > 0;
+  }
+  CUDA_CALLABLE_MEMBER
+  int n_hits(const int i_surface) const {
+    return int(hit(0, i_surface)) + int(hit(1, i_surface));
+  }
+};
+
+template <int N>
+class sphere_batch : geom_primitive {
+protected:
+  Real r[N];
+  Real r2[N];
+
+public:
+  void set_radius(const int i, const Real &rr) {
+    assert(0 <= i && i < N && "sphere index must be in range");
+    r[i]=rr/scale;
+    r2[i]=r[i]*r[i];
+  }
+
+  CUDA_CALLABLE_MEMBER
+  void intersections(const atmo_vector & vec,
+		     batch_intersections<N> &hits) const {
+    // the quadratic of sphere::intersections for each sphere
+    const Real r_norm = vec.pt.r/scale;
+    const Real B = r_norm * vec.ray.cost;
+    const Real r_norm2 = r_norm * r_norm;
+
+    INTERSECTIONS_SIMD
+    for (int i=0;i<N;i++) {
+      const Real C = r_norm2 - r2[i];
+      const Real discr = B*B-C;
+      // misses and tangent rays are masked out below; clamping keeps
+      // the square root real
+      const Real root = std::sqrt(discr > 0 ? discr : Real(0));
+      const Real d0 = -B + ((B > 0) ? -root : root);
+      const Real d1 = C / d0;
+      const Real dist0 = d0*scale;
+      const Real dist1 = d1*scale;
+      hits.distances[0][i] = ((discr > 0) & (d0 > 0)) ? dist0 : hits.no_hit;
+      hits.distances[1][i] = ((discr > 0) & (d1 > 0)) ? dist1 : hits.no_hit;
+    }
+
+#ifndef NDEBUG
+    for (int i=0;i<N;i++)
+      for (int i_hit=0;i_hit<2;i_hit++)
+	if (hits.hit(i_hit, i)) {
+	  atmo_point ipt = vec.extend(hits.distances[i_hit][i]);
+	  assert(is_zero(ipt.r/r[i]/scale-1.0,EPS)
+		 && "vector must intersect sphere at specified distance.");
+	}
+#endif
+  }
+};
+
+template <int N>
+class cone_batch : geom_primitive {
+protected:
+  Real angle[N];
+  Real cosangle[N];
+  Real cosangle2[N];
+
+  Real rmin;
+public:
+  void set_angle(const int i, const Real &a) {
+    assert(0 <= i && i < N && "cone index must be in range");
+    angle[i]=a;
+    cosangle[i]=std::cos(angle[i]);
+    cosangle2[i]=cosangle[i]*cosangle[i];
+    assert(!(is_zero(cosangle[i]))
+	   && "problems occur if there is a cone with an opening angle of pi/2 degrees.");
+  }
+  void set_rmin(const Real &rminn) {
+    // see cone::set_rmin
+    rmin = rminn;
+  }
+
+  CUDA_CALLABLE_MEMBER
+  void intersections(const atmo_vector & vec,
+		     batch_intersections<N> &hits) const {
+    // the quadratic of cone::intersections for each cone, with the
+    // roots of both the quadratic and the linear (A == 0) case
+    // computed and the right one selected
+    const Real rscale = vec.pt.r;
+    const Real z_norm = vec.pt.z/rscale;
+    const Real line_z = vec.line_z;
+    const Real line_z2 = line_z * line_z;
+    const Real cost = vec.ray.cost;
+    const Real z_norm2 = z_norm * z_norm;
+
+    INTERSECTIONS_SIMD
+    for (int i=0;i<N;i++) {
+      const Real A = line_z2 - cosangle2[i];
+      const Real B = z_norm * line_z - cost * cosangle2[i];
+      const Real C = z_norm2 - cosangle2[i];
+
+      const bool linear = (A <= STRICTEPS) & (A >= -STRICTEPS);
+      const Real discr = B*B-A*C;
+      const Real root = std::sqrt(discr > 0 ? discr : Real(0));
+      const Real q = -B + ((B > 0) ? -root : root);
+
+      const Real d_linear = -C/(2*B);
+      const Real d_quadratic = q/A;
+      const Real d0 = linear ? d_linear : d_quadratic;
+      const Real d1 = C/q;
+
+      // only the nappe on the side of the cone's angle counts
+      const Real z0 = z_norm + d0*line_z;
+      const Real z1 = z_norm + d1*line_z;
+      const bool positive = cosangle[i] > 0;
+      const bool side0 = (positive & (z0 > 0)) | (!positive & (z0 < 0));
+      const bool side1 = (positive & (z1 > 0)) | (!positive & (z1 < 0));
+
+      const Real dist0 = d0*rscale;
+      const Real dist1 = d1*rscale;
+      hits.distances[0][i] = ((linear | (discr > 0)) & (d0 > 0) & side0) ? dist0 : hits.no_hit;
+      hits.distances[1][i] = (!linear & (discr > 0) & (d1 > 0) & side1) ? dist1 : hits.no_hit;
+    }
+
+#ifndef NDEBUG
+    for (int i=0;i<N;i++)
+      for (int i_hit=0;i_hit<2;i_hit++)
+	if (hits.hit(i_hit, i)) {
+	  atmo_point ipt = vec.extend(hits.distances[i_hit][i]);
+	  if (ipt.r > rmin)
+	    // see cone::intersections
+	    assert(is_zero(ipt.t/angle[i]-1,CONEEPS)
+		   && "vector must intersect cone at specified distance.");
+	}
+#endif
+  }
+};
+
+
+class half_plane : geom_primitive {
+  // half of a plane containing the z axis, on the side at azimuth
+  // angle phi; surface of constant phi in spherical coordinates
+protected:
+  Real angle;
+  Real cosangle;
+  Real sinangle;
+
+public:
+  void set_angle(const Real &a);
+
+  CUDA_CALLABLE_MEMBER
+  void intersections(const atmo_vector & vec,
+		     Real (&distances)[2],
+		     int &n_hits) const;
+
+  // whether a ray crossing the half plane moves toward larger phi
+  CUDA_CALLABLE_MEMBER
+  bool increasing(const atmo_vector & vec) const;
+};
+
   
 
 
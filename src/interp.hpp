@@ -5,6 +5,8 @@
 
 #include <cmath>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <Eigen/Dense>
 
 using std::pow;
@@ -203,6 +205,29 @@ struct Base_interp
   // derived classes provide this as the actual interpolation method used.
 };
 
+template <typename Real>
+int bracket_index(const vector<Real> &xx, const Real x)
+// return j such that x is in [xx[j], xx[j+1]], clamped to the ends of
+// the table. xx must be monotonic. Unlike Base_interp::hunt this keeps
+// no state between calls, so one table can be read from many threads.
+{
+  const bool ascnd = (xx.back() >= xx.front());
+  auto it = ascnd
+    ? std::upper_bound(xx.begin(), xx.end(), x)
+    : std::upper_bound(xx.begin(), xx.end(), x, std::greater<Real>());
+  int j = (it - xx.begin()) - 1;
+  return std::max(0, std::min((int) xx.size()-2, j));
+}
+
+template <typename Real>
+Real linear_interp_at(const vector<Real> &xx, const vector<Real> &yy,
+		      const int j, const Real x)
+// linear interpolation within the bracket returned by bracket_index
+{
+  if (xx[j] == xx[j+1]) return yy[j]; // table defective, but recover
+  else return yy[j] + ((x-xx[j])/(xx[j+1]-xx[j]))*(yy[j+1]-yy[j]);
+}
+
 template <typename Real>
 struct Linear_interp : Base_interp<Real>
 // piecewise linear interpolation object. Construct with x and y
@@ -9,83 +9,189 @@ using std::string;
 
 observation_fit::observation_fit(const string iph_sfn_fnamee)
   : atm_tabular(),
-    hydrogen_RT_pp(grid_pp, hydrogen_emissions_pp),
-    hydrogen_RT(grid, hydrogen_emissions),
-    hydrogen_obs(hydrogen_emissions),
     iph_sfn_fname(iph_sfn_fnamee),
     sim_iph(false),
-    deuterium_RT_pp(grid_pp, deuterium_emissions_pp),
-    deuterium_RT(grid, deuterium_emissions),
-    deuterium_obs(deuterium_emissions),
-    ly_multiplet_RT(grid, ly_multiplet_emissions),
-    ly_multiplet_obs(ly_multiplet_emissions),
-    ly_singlet_RT(grid, ly_singlet_emissions),
-    ly_singlet_obs(ly_singlet_emissions),
-    oxygen_RT(grid, oxygen_emissions),
-    oxygen_obs(oxygen_emissions)
+    high_resolution(false),
+    coarse_to_fine(false),
+    adaptive_radial_passes(0),
+    mixed_precision(false),
+    H_szamethod(grid_type::szamethod_uniform_cos),
+    observation_geometry_id(0)
 {
   //std::cout << "iph_sfn_fname = " << iph_sfn_fname << std::endl;
   
   CO2_exobase_density = default_CO2_exobase_density;
 
-  hydrogen_RT_pp.grid.rmethod = grid_pp.rmethod_log_n_species;
-  deuterium_RT_pp.grid.rmethod = grid_pp.rmethod_log_n_species;
+  tweak_H_density = false;
+  tweak_H_temp = false;
 
-  hydrogen_RT.grid.rmethod = grid.rmethod_altitude;//_tau_absorber;
-  // fixed altitude grid gives smooth solutions for changes in input parameters,
-  // other kinds of grids do not.
-  hydrogen_RT.grid.szamethod = grid.szamethod_uniform_cos;
-  hydrogen_RT.grid.raymethod_theta = grid.raymethod_theta_uniform;
+  density_rescale_shortcut = true;
+}
 
-  deuterium_RT.grid.rmethod = grid.rmethod_altitude;//_tau_absorber;
+template <typename G>
+void observation_fit::setup_sph_grid(G &RT_grid, const int szamethod) {
+  RT_grid.rmethod = grid.rmethod_altitude;//_tau_absorber;
   // fixed altitude grid gives smooth solutions for changes in input parameters,
   // other kinds of grids do not.
-  deuterium_RT.grid.szamethod = grid.szamethod_uniform_cos;
-  deuterium_RT.grid.raymethod_theta = grid.raymethod_theta_uniform;
+  RT_grid.szamethod = szamethod;
+  RT_grid.raymethod_theta = grid.raymethod_theta_uniform;
+}
 
-  ly_multiplet_RT.grid.rmethod = grid.rmethod_altitude;//_tau_absorber;
-  // fixed altitude grid gives smooth solutions for changes in input parameters,
-  // other kinds of grids do not.
-  ly_multiplet_RT.grid.szamethod = grid.szamethod_uniform_cos;
-  ly_multiplet_RT.grid.raymethod_theta = grid.raymethod_theta_uniform;
+template <typename S>
+void observation_fit::apply_g_factor(S &sys) {
+  if (g_factor.size() == 0)
+    return;
+  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++)
+    sys.emissions[i_emission]->set_emission_g_factor(g_factor[i_emission]);
+}
 
-  ly_singlet_RT.grid.rmethod = grid.rmethod_altitude;//_tau_absorber;
-  // fixed altitude grid gives smooth solutions for changes in input parameters,
-  // other kinds of grids do not.
-  ly_singlet_RT.grid.szamethod = grid.szamethod_uniform_cos;
-  ly_singlet_RT.grid.raymethod_theta = grid.raymethod_theta_uniform;
+template <typename S>
+void observation_fit::apply_mixed_precision(S &sys) {
+  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++)
+    sys.emissions[i_emission]->set_mixed_precision(mixed_precision);
+}
 
-  oxygen_RT.grid.rmethod = grid.rmethod_log_n_species;
-  oxygen_RT.grid.szamethod = grid.szamethod_uniform_cos;
-  oxygen_RT.grid.raymethod_theta = grid.raymethod_theta_uniform;
+template <typename E>
+void observation_fit::apply_multiplet_settings(E &emiss) {
+  H_cross_section_options.no_CO2_absorption ? emiss.set_CO2_absorption_off() : emiss.set_CO2_absorption_on();
 
-  tweak_H_density = false;
-  tweak_H_temp = false;
+  if (H_cross_section_options.temp_dependent_sH)
+    emiss.set_atmosphere_temp_RT();
+  else
+    emiss.set_constant_temp_RT(H_cross_section_options.constant_temp_sH);
+
+  if (g_factor.size() != 0)
+    emiss.set_solar_brightness(g_factor[0]/lyman_alpha_cross_section_total,
+			       g_factor[1]/lyman_beta_cross_section_total);
+}
+
+observation_fit::H_pp_subsystem & observation_fit::H_pp_system() {
+  if (!H_pp_sys) {
+    H_pp_sys.reset(new H_pp_subsystem(grid_pp));
+    H_pp_sys->RT.grid.rmethod = grid_pp.rmethod_log_n_species;
+    apply_g_factor(*H_pp_sys);
+    apply_mixed_precision(*H_pp_sys);
+  }
+  return *H_pp_sys;
+}
+observation_fit::H_pp_subsystem & observation_fit::D_pp_system() {
+  if (!D_pp_sys) {
+    D_pp_sys.reset(new H_pp_subsystem(grid_pp));
+    D_pp_sys->RT.grid.rmethod = grid_pp.rmethod_log_n_species;
+    apply_g_factor(*D_pp_sys);
+    apply_mixed_precision(*D_pp_sys);
+  }
+  return *D_pp_sys;
+}
+observation_fit::H_subsystem & observation_fit::H_system() {
+  if (!H_sys) {
+    H_sys.reset(new H_subsystem(grid));
+    setup_sph_grid(H_sys->RT.grid, H_szamethod);
+    apply_g_factor(*H_sys);
+    apply_mixed_precision(*H_sys);
+  }
+  return *H_sys;
+}
+observation_fit::H_subsystem & observation_fit::D_system() {
+  if (!D_sys) {
+    D_sys.reset(new H_subsystem(grid));
+    setup_sph_grid(D_sys->RT.grid, grid.szamethod_uniform_cos);
+    apply_g_factor(*D_sys);
+    apply_mixed_precision(*D_sys);
+  }
+  return *D_sys;
+}
+observation_fit::H_hires_subsystem & observation_fit::H_hires_system() {
+  if (!H_hires_sys) {
+    // the grid is large, so keep the template off the stack
+    std::unique_ptr<hires_grid_type> hires_grid(new hires_grid_type);
+    H_hires_sys.reset(new H_hires_subsystem(*hires_grid));
+    setup_sph_grid(H_hires_sys->RT.grid, H_szamethod);
+    apply_g_factor(*H_hires_sys);
+    apply_mixed_precision(*H_hires_sys);
+  }
+  return *H_hires_sys;
+}
+observation_fit::H_hires_subsystem & observation_fit::D_hires_system() {
+  if (!D_hires_sys) {
+    std::unique_ptr<hires_grid_type> hires_grid(new hires_grid_type);
+    D_hires_sys.reset(new H_hires_subsystem(*hires_grid));
+    setup_sph_grid(D_hires_sys->RT.grid, grid.szamethod_uniform_cos);
+    apply_g_factor(*D_hires_sys);
+    apply_mixed_precision(*D_hires_sys);
+  }
+  return *D_hires_sys;
+}
+observation_fit::H_pp_subsystem & observation_fit::hydrogen_pp_system(const bool deuterium) {
+  return deuterium ? D_pp_system() : H_pp_system();
+}
+observation_fit::H_subsystem & observation_fit::hydrogen_system(const bool deuterium) {
+  return deuterium ? D_system() : H_system();
+}
+observation_fit::H_hires_subsystem & observation_fit::hydrogen_hires_system(const bool deuterium) {
+  return deuterium ? D_hires_system() : H_hires_system();
+}
+observation_fit::ly_multiplet_subsystem & observation_fit::ly_multiplet_system() {
+  if (!ly_multiplet_sys) {
+    ly_multiplet_sys.reset(new ly_multiplet_subsystem(grid));
+    setup_sph_grid(ly_multiplet_sys->RT.grid, H_szamethod);
+    apply_multiplet_settings(*ly_multiplet_sys->emissions[0]);
+  }
+  return *ly_multiplet_sys;
+}
+observation_fit::ly_singlet_subsystem & observation_fit::ly_singlet_system() {
+  if (!ly_singlet_sys) {
+    ly_singlet_sys.reset(new ly_singlet_subsystem(grid));
+    setup_sph_grid(ly_singlet_sys->RT.grid, H_szamethod);
+    apply_multiplet_settings(*ly_singlet_sys->emissions[0]);
+  }
+  return *ly_singlet_sys;
+}
+observation_fit::oxygen_subsystem & observation_fit::O_1026_system() {
+  if (!O_1026_sys) {
+    O_1026_sys.reset(new oxygen_subsystem(grid));
+    O_1026_sys->RT.grid.rmethod = grid.rmethod_log_n_species;
+    O_1026_sys->RT.grid.szamethod = grid.szamethod_uniform_cos;
+    O_1026_sys->RT.grid.raymethod_theta = grid.raymethod_theta_uniform;
+  }
+  return *O_1026_sys;
 }
 
 void observation_fit::add_observation(const vector<vector<Real>> &MSO_locations, const vector<vector<Real>> &MSO_directions) {
-  hydrogen_obs.add_MSO_observation(MSO_locations,MSO_directions);
-  deuterium_obs.add_MSO_observation(MSO_locations,MSO_directions);
-  ly_multiplet_obs.add_MSO_observation(MSO_locations,MSO_directions);
-  ly_singlet_obs.add_MSO_observation(MSO_locations,MSO_directions);
-  oxygen_obs.add_MSO_observation(MSO_locations,MSO_directions);
+  assert(MSO_locations.size() == MSO_directions.size() && "location and look direction must have the same length.");
+
+  // cached brightnesses are only valid for the geometry they were computed with
+  brightness_cache.clear();
+  hires_brightness_cache.clear();
+
+  // subsystems pick up the new geometry when they next compute a brightness
+  obs_MSO_locations = MSO_locations;
+  obs_MSO_directions = MSO_directions;
+  observation_geometry_id++;
+
+  iph_mars_ecliptic_coords.clear();
+  iph_RA.clear();
+  iph_Dec.clear();
 }
 
 void observation_fit::set_g_factor(vector<Real> &g) {
-  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    hydrogen_emissions[i_emission]->set_emission_g_factor(g[i_emission]);
-    deuterium_emissions[i_emission]->set_emission_g_factor(g[i_emission]);
-    hydrogen_emissions_pp[i_emission]->set_emission_g_factor(g[i_emission]);
-  }
+  assert(g.size() >= n_hydrogen_emissions && "need a g factor for each hydrogen emission");
+  g_factor = g;
 
+  if (H_pp_sys) apply_g_factor(*H_pp_sys);
+  if (D_pp_sys) apply_g_factor(*D_pp_sys);
+  if (H_sys)    apply_g_factor(*H_sys);
+  if (D_sys)    apply_g_factor(*D_sys);
+  if (H_hires_sys) apply_g_factor(*H_hires_sys);
+  if (D_hires_sys) apply_g_factor(*D_hires_sys);
 
   std::cout << "Ly alpha solar brightness = " << g[0]/lyman_alpha_cross_section_total << std::endl;
   std::cout << "Ly beta solar brightness = " << g[1]/lyman_beta_cross_section_total << std::endl;
-  
-  ly_multiplet.set_solar_brightness(g[0]/lyman_alpha_cross_section_total,
-				    g[1]/lyman_beta_cross_section_total);
-  ly_singlet.set_solar_brightness(g[0]/lyman_alpha_cross_section_total,
-				  g[1]/lyman_beta_cross_section_total);
+
+  if (ly_multiplet_sys)
+    apply_multiplet_settings(*ly_multiplet_sys->emissions[0]);
+  if (ly_singlet_sys)
+    apply_multiplet_settings(*ly_singlet_sys->emissions[0]);
 }
 
 void observation_fit::simulate_iph(const bool sim_iphh) {
@@ -96,29 +202,39 @@ void observation_fit::add_observation_ra_dec(const std::vector<Real> &mars_eclip
 					     const std::vector<Real> &RAA,
 					     const std::vector<Real> &Decc) {
   simulate_iph(true);
-  hydrogen_obs.add_observation_ra_dec(mars_ecliptic_coords,
-				      RAA,
-				      Decc);
+  iph_mars_ecliptic_coords = mars_ecliptic_coords;
+  iph_RA = RAA;
+  iph_Dec = Decc;
+  with_hydrogen_system(false, [&](auto &H) {
+      attach_geometry(H);
+      H.obs.add_observation_ra_dec(mars_ecliptic_coords,
+				   RAA,
+				   Decc);
+    });
   get_unextincted_iph();
 }
 
 void observation_fit::get_unextincted_iph() {
-  //simulate the IPH brightness using Quemerais' IPH code
-  vector<Real> iph_brightness_lya = quemerais_iph_model(iph_sfn_fname,
-							lyman_alpha.get_emission_g_factor(),
-							hydrogen_obs.mars_ecliptic_pos,
-							hydrogen_obs.ra, hydrogen_obs.dec);
-  
-  for (int i_obs=0; i_obs < hydrogen_obs.size(); i_obs++) {
-    hydrogen_obs.iph_brightness_unextincted[i_obs][0] = iph_brightness_lya[i_obs];
-    if (n_hydrogen_emissions==2)
-      hydrogen_obs.iph_brightness_unextincted[i_obs][1] = (lyman_beta.get_emission_g_factor()
-							   / lyman_alpha.get_emission_g_factor()
-							   * iph_brightness_lya[i_obs]); 
-  }
+  with_hydrogen_system(false, [&](auto &H) {
+      attach_geometry(H);
+      auto &hydrogen_obs = H.obs;
+
+      //simulate the IPH brightness using Quemerais' IPH code
+      vector<Real> iph_brightness_lya = quemerais_iph_model(iph_sfn_fname,
+							    H.emissions[0]->get_emission_g_factor(),
+							    hydrogen_obs.mars_ecliptic_pos,
+							    hydrogen_obs.ra, hydrogen_obs.dec);
+  
+      for (int i_obs=0; i_obs < hydrogen_obs.size(); i_obs++) {
+	hydrogen_obs.iph_brightness_unextincted[i_obs][0] = iph_brightness_lya[i_obs];
+	if (n_hydrogen_emissions==2)
+	  hydrogen_obs.iph_brightness_unextincted[i_obs][1] = (H.emissions[1]->get_emission_g_factor()
+							       / H.emissions[0]->get_emission_g_factor()
+							       * iph_brightness_lya[i_obs]); 
+      }
+    });
 }
 
-
 void observation_fit::generate_source_function(const Real &nHexo, const Real &Texo,
 					       const string atmosphere_fname/* = ""*/,
 					       const string sourcefn_fname/* = ""*/,
@@ -127,6 +243,10 @@ void observation_fit::generate_source_function(const Real &nHexo, const Real &Te
 {
   //std::cout << "nHexo = " << nHexo << "; Texo = " << Texo << ".\n";
 
+  forward_model_key key = source_function_key("generate_source_function",
+					      {nHexo, Texo, CO2_exobase_density},
+					      plane_parallel, deuterium);
+
   temp = krasnopolsky_temperature(Texo);
   chamb_diff_1d atm(nHexo,
 		    CO2_exobase_density,
@@ -138,33 +258,17 @@ void observation_fit::generate_source_function(const Real &nHexo, const Real &Te
     atm.save(atmosphere_fname);
   
   if (plane_parallel) {
-    if (!deuterium) {
-      generate_source_function_plane_parallel(atm, Texo,
-					      hydrogen_RT_pp,
-					      lyman_alpha_pp,
-					      lyman_beta_pp,
-					      sourcefn_fname);
-    } else {
-      generate_source_function_plane_parallel(atm, Texo,
-					      deuterium_RT_pp,
-					      D_lyman_alpha_pp,
-					      D_lyman_beta_pp,
-					      sourcefn_fname);
-    }
+    generate_source_function_plane_parallel(atm, Texo,
+					    hydrogen_pp_system(deuterium),
+					    key,
+					    sourcefn_fname);
   } else {
-    if (!deuterium) {
-      generate_source_function_sph_azi_sym(atm, Texo,
-					   hydrogen_RT,
-					   lyman_alpha,
-					   lyman_beta,
-					   sourcefn_fname);
-    } else {
-      generate_source_function_sph_azi_sym(atm, Texo,
-					   deuterium_RT,
-					   D_lyman_alpha,
-					   D_lyman_beta,
-					   sourcefn_fname);
-    }
+    with_hydrogen_system(deuterium, [&](auto &sys) {
+	generate_source_function_sph_azi_sym(atm, Texo,
+					     sys,
+					     key,
+					     sourcefn_fname);
+      });
   }
 }
 
@@ -219,6 +323,52 @@ void observation_fit::generate_source_function_variable_thermosphere(const Real
   // std::cout << "nCO2rmin = " << nCO2rminn << ".\n";
   // std::cout << "T_tropo = " << T_tropo << "; z_tropo = " << (r_tropo-rMars)/1e5 << "; shape_parameter = " << shape_parameter << ".\n";
 
+  density_rescale_key rescale_key;
+  rescale_key.valid           = true;
+  rescale_key.nHexo           = nHexo;
+  rescale_key.Texo            = Texo;
+  rescale_key.nCO2rmin        = nCO2rminn;
+  rescale_key.rexo            = rexoo;
+  rescale_key.rmin            = rminn;
+  rescale_key.rmax            = rmaxx;
+  rescale_key.rmindiffusion   = rmindiffusionn;
+  rescale_key.T_tropo         = T_tropo;
+  rescale_key.r_tropo         = r_tropo;
+  rescale_key.shape_parameter = shape_parameter;
+
+  forward_model_key key = source_function_key("generate_source_function_variable_thermosphere",
+					      {nHexo, Texo,
+					       nCO2rminn, rexoo, rminn, rmaxx, rmindiffusionn,
+					       T_tropo, r_tropo, shape_parameter},
+					      plane_parallel, deuterium);
+
+  density_rescale_key &last_key = deuterium ? D_rescale_key : H_rescale_key;
+
+  // with rmax fixed, changing only nHexo scales the whole thermosphere
+  // and exosphere by the same factor (see
+  // species_density_parameters::integrate_thermosphere), so the
+  // previous voxel densities can be rescaled instead of rebuilding the
+  // atmosphere
+  if (density_rescale_shortcut
+      && !plane_parallel
+      && atmosphere_fname == ""
+      && !tweak_H_density && !tweak_H_temp
+      && nHexo > 0
+      && last_key.same_except_nHexo(rescale_key)
+      && adaptive_radial_passes == 0
+      && with_hydrogen_system(deuterium, [&](auto &sys) {
+	  return sys.RT.grid.rmethod == grid.rmethod_altitude;
+	})) {
+    with_hydrogen_system(deuterium, [&](auto &sys) {
+	rescale_source_function_sph_azi_sym(nHexo/last_key.nHexo,
+					    sys,
+					    key,
+					    sourcefn_fname);
+      });
+    last_key = rescale_key;
+    return;
+  }
+
   temp = krasnopolsky_temperature(Texo, T_tropo, r_tropo, shape_parameter, false/*shape parameter is in absolute units of km*/);
   chamb_diff_1d atm(rminn,
 		    rexoo,
@@ -235,59 +385,235 @@ void observation_fit::generate_source_function_variable_thermosphere(const Real
     atm.save(atmosphere_fname);
 
   if (plane_parallel) {
-    if (!deuterium) {
-      generate_source_function_plane_parallel(atm, Texo,
-					      hydrogen_RT_pp,
-					      lyman_alpha_pp,
-					      lyman_beta_pp,
-					      sourcefn_fname);
-    } else {
-      generate_source_function_plane_parallel(atm, Texo,
-					      deuterium_RT_pp,
-					      D_lyman_alpha_pp,
-					      D_lyman_beta_pp,
-					      sourcefn_fname);
-    }
+    generate_source_function_plane_parallel(atm, Texo,
+					    hydrogen_pp_system(deuterium),
+					    key,
+					    sourcefn_fname);
   } else {
-    if (!deuterium) {
-      generate_source_function_sph_azi_sym(atm, Texo,
-					   hydrogen_RT,
-					   lyman_alpha,
-					   lyman_beta,
-					   sourcefn_fname);
-    } else {
-      generate_source_function_sph_azi_sym(atm, Texo,
-					   deuterium_RT,
-					   D_lyman_alpha,
-					   D_lyman_beta,
-					   sourcefn_fname);
+    with_hydrogen_system(deuterium, [&](auto &sys) {
+	generate_source_function_sph_azi_sym(atm, Texo,
+					     sys,
+					     key,
+					     sourcefn_fname);
+      });
+
+    // tweaked densities and temperatures are not part of the key, so
+    // only untweaked solutions can be rescaled later
+    if (!tweak_H_density && !tweak_H_temp)
+      last_key = rescale_key;
+  }
+}
+
+bool observation_fit::density_rescale_key::same_except_nHexo(const density_rescale_key &other) const {
+  return (valid && other.valid
+	  && Texo            == other.Texo
+	  && nCO2rmin        == other.nCO2rmin
+	  && rexo            == other.rexo
+	  && rmin            == other.rmin
+	  && rmax            == other.rmax
+	  && rmindiffusion   == other.rmindiffusion
+	  && T_tropo         == other.T_tropo
+	  && r_tropo         == other.r_tropo
+	  && shape_parameter == other.shape_parameter);
+}
+
+void observation_fit::invalidate_density_rescale() {
+  H_rescale_key.valid = false;
+  D_rescale_key.valid = false;
+}
+void observation_fit::invalidate_density_rescale(const void *sys) {
+  if (sys == H_sys.get())
+    H_rescale_key.valid = false;
+  if (sys == D_sys.get())
+    D_rescale_key.valid = false;
+  if (sys == H_hires_sys.get())
+    H_rescale_key.valid = false;
+  if (sys == D_hires_sys.get())
+    D_rescale_key.valid = false;
+}
+
+void observation_fit::set_density_rescale_shortcut(const bool use_shortcut/* = true*/) {
+  density_rescale_shortcut = use_shortcut;
+  invalidate_density_rescale();
+}
+
+forward_model_key* observation_fit::solution_key(const void *sys) {
+  if (sys == H_sys.get())
+    return &hydrogen_solution_key;
+  if (sys == D_sys.get())
+    return &deuterium_solution_key;
+  if (sys == H_hires_sys.get())
+    return &hydrogen_hires_solution_key;
+  if (sys == D_hires_sys.get())
+    return &deuterium_hires_solution_key;
+  return NULL;
+}
+
+forward_model_key observation_fit::source_function_key(const string &variant,
+						       const vector<doubReal> &params,
+						       const bool plane_parallel,
+						       const bool deuterium) {
+  // everything besides the routine arguments that changes the solution
+  forward_model_key key(variant);
+  key.add(params);
+  key.add(plane_parallel);
+  key.add(deuterium);
+  key.add(mixed_precision);
+
+  // the key is built just before solving, so looking up the subsystem
+  // here does not create one that would otherwise go unused
+  if (plane_parallel) {
+    const H_pp_subsystem &sys = hydrogen_pp_system(deuterium);
+    key.add(sys.RT.grid.rmethod);
+    key.add(sys.emissions[0]->get_emission_g_factor());
+    key.add(sys.emissions[1]->get_emission_g_factor());
+  } else {
+    key.add(high_resolution);
+    if (high_resolution)
+      key.add(coarse_to_fine);
+    key.add(adaptive_radial_passes);
+    with_hydrogen_system(deuterium, [&](const auto &sys) {
+	key.add(sys.RT.grid.rmethod);
+	key.add(sys.RT.grid.szamethod);
+	key.add(sys.RT.grid.raymethod_theta);
+	key.add(sys.emissions[0]->get_emission_g_factor());
+	key.add(sys.emissions[1]->get_emission_g_factor());
+      });
+  }
+
+  key.add(H_cross_section_options.H_lya_xsec_coef);
+  key.add(H_cross_section_options.H_lyb_xsec_coef);
+  key.add(H_cross_section_options.CO2_lya_xsec);
+  key.add(H_cross_section_options.CO2_lyb_xsec);
+  key.add(H_cross_section_options.temp_dependent_sH);
+  key.add(H_cross_section_options.constant_temp_sH);
+  key.add(H_cross_section_options.no_CO2_absorption);
+
+  const species_density_parameters &thermosphere = deuterium ? D_thermosphere : H_thermosphere;
+  key.add(thermosphere.adaptive_integration);
+  key.add(thermosphere.adaptive_abs_tol);
+  key.add(thermosphere.adaptive_rel_tol);
+
+  key.add(tweak_H_density);
+  if (tweak_H_density) {
+    key.add(tweak_H_density_voxel_numbers);
+    key.add(tweak_H_density_factor);
+  }
+  key.add(tweak_H_temp);
+  if (tweak_H_temp) {
+    key.add(tweak_H_temp_voxel_numbers);
+    key.add(tweak_H_temp_factor);
+  }
+
+  return key;
+}
+
+void observation_fit::set_forward_model_cache_size(const int n_source_functions, const int n_brightnesses) {
+  assert(n_source_functions >= 0 && n_brightnesses >= 0 && "cache sizes must be non-negative");
+  sourcefn_cache.set_capacity(n_source_functions);
+  adapted_grid_cache.set_capacity(n_source_functions);
+  brightness_cache.set_capacity(n_brightnesses);
+  hires_brightness_cache.set_capacity(n_brightnesses);
+}
+void observation_fit::set_forward_model_cache_dir(const string dirname, const string git_hash/* = ""*/) {
+  sourcefn_cache.set_cache_dir(dirname, git_hash);
+}
+void observation_fit::clear_forward_model_cache() {
+  sourcefn_cache.clear();
+  sourcefn_cache.reset_stats();
+  adapted_grid_cache.clear();
+  brightness_cache.clear();
+  brightness_cache.reset_stats();
+  hires_brightness_cache.clear();
+  hires_brightness_cache.reset_stats();
+}
+forward_model_cache_stats observation_fit::get_forward_model_cache_stats() const {
+  forward_model_cache_stats stats;
+  stats.source_function_hits      = sourcefn_cache.hits();
+  stats.source_function_disk_hits = sourcefn_cache.disk_hits();
+  stats.source_function_misses    = sourcefn_cache.misses();
+  stats.source_function_entries   = sourcefn_cache.size();
+  stats.brightness_hits           = brightness_cache.hits()   + hires_brightness_cache.hits();
+  stats.brightness_misses         = brightness_cache.misses() + hires_brightness_cache.misses();
+  stats.brightness_entries        = brightness_cache.size()   + hires_brightness_cache.size();
+  return stats;
+}
+
+template <typename S>
+void observation_fit::hydrogen_brightness(S &sys) {
+  // brightness of the solution currently held by sys, from the
+  // cache if this solution has been seen with the current geometry
+  attach_geometry(sys);
+  typename S::RT_type &RT_obj = sys.RT;
+  auto &obs = sys.obs;
+  auto &cache = brightness_cache_for(sys);
+
+  const forward_model_key *current_key = solution_key(&sys);
+  const bool use_cache = (cache.enabled()
+			  && current_key != NULL
+			  && current_key->valid());
+
+  if (use_cache) {
+    const hydrogen_brightness_result<S> *cached = cache.find(*current_key);
+    if (cached != NULL) {
+      for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++)
+	for (int i=0;i<obs.size();i++)
+	  obs.los[i_emission][i] = (*cached)[i_emission][i];
+      return;
     }
   }
+
+  //compute brightness on the GPU if compiled with NVCC
+#ifdef __CUDACC__
+  RT_obj.brightness_gpu(obs);
+#else
+  RT_obj.brightness(obs);
+#endif
+
+  if (use_cache) {
+    hydrogen_brightness_result<S> result(n_hydrogen_emissions);
+    for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++)
+      result[i_emission].assign(obs.los[i_emission].v, obs.los[i_emission].v + obs.size());
+    cache.insert(*current_key, result);
+  }
+}
+
+template <typename S>
+void observation_fit::hydrogen_brightness(S &sys, Real *buffer) {
+  // brightness with the IPH added, in the layout of copy_los_field
+  hydrogen_brightness(sys);
+  auto &obs = sys.obs;
+
+  if (sim_iph)
+    obs.update_iph_extinction();
+
+  copy_los_field(sys, &brightness_tracker::brightness, buffer);
+
+  if (sim_iph)
+    for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++)
+      for (int i=0;i<obs.size();i++)
+	buffer[i_emission*obs.size() + i] += obs.iph_brightness_observed[i][i_emission];
 }
 
 void observation_fit::generate_source_function_nH_asym(const Real &nHexo, const Real &Texo,
 						       const Real &asym,
 						       const string sourcefn_fname/* = ""*/,
 						       const bool deuterium/* =false */) {
+  forward_model_key key = source_function_key("generate_source_function_nH_asym",
+					      {nHexo, Texo, asym, CO2_exobase_density},
+					      /*plane_parallel = */false, deuterium);
   
   temp = krasnopolsky_temperature(Texo);
   chamb_diff_1d_asymmetric atm_asym(nHexo,CO2_exobase_density,&temp,&H_thermosphere);
   atm_asym.copy_H_options(H_cross_section_options);
   atm_asym.set_asymmetry(asym);
 
-  if (!deuterium) {
-    generate_source_function_sph_azi_sym(atm_asym, Texo,
-					 hydrogen_RT,
-					 lyman_alpha,
-					 lyman_beta,
-					 sourcefn_fname);
-  } else {
-    generate_source_function_sph_azi_sym(atm_asym, Texo,
-					 deuterium_RT,
-					 D_lyman_alpha,
-					 D_lyman_beta,
-					 sourcefn_fname);
-  }
+  with_hydrogen_system(deuterium, [&](auto &sys) {
+      generate_source_function_sph_azi_sym(atm_asym, Texo,
+					   sys,
+					   key,
+					   sourcefn_fname);
+    });
 }
 
 void observation_fit::generate_source_function_temp_asym(const Real &nHavg,
@@ -330,6 +656,12 @@ void observation_fit::generate_source_function_temp_asym(const Real &nHavg,
   // std::cout << "T_tropo = " << T_tropo << "; z_tropo = " << (r_tropo-rMars)/1e5 << "; shape_parameter = " << shape_parameter << ".\n";
   // std::cout << "Tpower = " << Tpowerr << ".\n";
 
+  forward_model_key key = source_function_key("generate_source_function_temp_asym",
+					      {nHavg, Tnoon, Tmidnight,
+					       nCO2rminn, rexoo, rminn, rmaxx, rmindiffusionn,
+					       T_tropo, r_tropo, shape_parameter, Tpowerr},
+					      /*plane_parallel = */false, deuterium);
+
   chamb_diff_temp_asymmetric atm_asym(&H_thermosphere,
 				      nHavg,
 				      Tnoon, Tmidnight,
@@ -345,19 +677,12 @@ void observation_fit::generate_source_function_temp_asym(const Real &nHavg,
 				      Tpowerr);
   atm_asym.copy_H_options(H_cross_section_options);
   
-  if (!deuterium) {
-    generate_source_function_sph_azi_sym(atm_asym, Tnoon,
-					 hydrogen_RT,
-					 lyman_alpha,
-					 lyman_beta,
-					 sourcefn_fname);
-  } else {
-    generate_source_function_sph_azi_sym(atm_asym, Tnoon,
-					 deuterium_RT,
-					 D_lyman_alpha,
-					 D_lyman_beta,
-					 sourcefn_fname);
-  }
+  with_hydrogen_system(deuterium, [&](auto &sys) {
+      generate_source_function_sph_azi_sym(atm_asym, Tnoon,
+					   sys,
+					   key,
+					   sourcefn_fname);
+    });
 }
 
 void observation_fit::generate_source_function_tabular_atmosphere(const Real rmin, const Real rexo, const Real rmax,
@@ -368,6 +693,15 @@ void observation_fit::generate_source_function_tabular_atmosphere(const Real rmi
 								  const bool plane_parallel/*= false*/,
 								  const bool deuterium/* =false */,
 								  const string sourcefn_fname/* = ""*/) {
+  forward_model_key key = source_function_key("generate_source_function_tabular_atmosphere",
+					      {rmin, rexo, rmax, Real(compute_exosphere)},
+					      plane_parallel, deuterium);
+  key.add(alt_nH);
+  key.add(log_nH);
+  key.add(alt_nCO2);
+  key.add(log_nCO2);
+  key.add(alt_temp);
+  key.add(temp);
 
   tabular_1d new_atm_tabular(rmin,rexo,rmax,compute_exosphere);
   new_atm_tabular.copy_H_options(H_cross_section_options);
@@ -380,82 +714,123 @@ void observation_fit::generate_source_function_tabular_atmosphere(const Real rmi
   Real Texo = atm_tabular.Temp(rexo);
 
   if (plane_parallel) {
-    if (!deuterium) {
-      generate_source_function_plane_parallel(atm_tabular, Texo,
-					      hydrogen_RT_pp,
-					      lyman_alpha_pp,
-					      lyman_beta_pp,
-					      sourcefn_fname);
-    } else {
-      generate_source_function_plane_parallel(atm_tabular, Texo,
-					      deuterium_RT_pp,
-					      D_lyman_alpha_pp,
-					      D_lyman_beta_pp,
-					      sourcefn_fname);
-    }
+    generate_source_function_plane_parallel(atm_tabular, Texo,
+					    hydrogen_pp_system(deuterium),
+					    key,
+					    sourcefn_fname);
   } else {
-    if (!deuterium) {
-      generate_source_function_sph_azi_sym(atm_tabular, Texo,
-					   hydrogen_RT,
-					   lyman_alpha,
-					   lyman_beta,
-					   sourcefn_fname);
-    } else {
-      generate_source_function_sph_azi_sym(atm_tabular, Texo,
-					   deuterium_RT,
-					   D_lyman_alpha,
-					   D_lyman_beta,
-					   sourcefn_fname);
-    }
+    with_hydrogen_system(deuterium, [&](auto &sys) {
+	generate_source_function_sph_azi_sym(atm_tabular, Texo,
+					     sys,
+					     key,
+					     sourcefn_fname);
+      });
   }
 }
 
 void observation_fit::set_use_CO2_absorption(const bool use_CO2_absorption/* = true*/) {
+  invalidate_density_rescale();
   H_cross_section_options.no_CO2_absorption = !use_CO2_absorption;
   atm_tabular.no_CO2_absorption = !use_CO2_absorption;
-  use_CO2_absorption ? ly_multiplet.set_CO2_absorption_on() : ly_multiplet.set_CO2_absorption_off();
-  use_CO2_absorption ? ly_singlet.set_CO2_absorption_on() : ly_singlet.set_CO2_absorption_off();
+  if (ly_multiplet_sys)
+    apply_multiplet_settings(*ly_multiplet_sys->emissions[0]);
+  if (ly_singlet_sys)
+    apply_multiplet_settings(*ly_singlet_sys->emissions[0]);
 }
 void observation_fit::set_use_temp_dependent_sH(const bool use_temp_dependent_sH/* = true*/, const Real constant_temp_sH/* = -1*/) {
+  invalidate_density_rescale();
   H_cross_section_options.temp_dependent_sH = use_temp_dependent_sH;
   atm_tabular.temp_dependent_sH = use_temp_dependent_sH;
   
   H_cross_section_options.constant_temp_sH = constant_temp_sH;
   atm_tabular.constant_temp_sH = constant_temp_sH;
 
-  if (use_temp_dependent_sH) {
-    ly_multiplet.set_atmosphere_temp_RT();
-    ly_singlet.set_atmosphere_temp_RT();
-  } else {
-    ly_multiplet.set_constant_temp_RT(constant_temp_sH);
-    ly_singlet.set_constant_temp_RT(constant_temp_sH);
-  }
+  if (ly_multiplet_sys)
+    apply_multiplet_settings(*ly_multiplet_sys->emissions[0]);
+  if (ly_singlet_sys)
+    apply_multiplet_settings(*ly_singlet_sys->emissions[0]);
 }
 
 void observation_fit::set_sza_method_uniform() {
-  hydrogen_RT.grid.szamethod = hydrogen_RT.grid.szamethod_uniform;
-  ly_multiplet_RT.grid.szamethod = ly_multiplet_RT.grid.szamethod_uniform;
-  ly_singlet_RT.grid.szamethod = ly_singlet_RT.grid.szamethod_uniform;
+  invalidate_density_rescale();
+  set_H_szamethod(grid.szamethod_uniform);
 }
 void observation_fit::set_sza_method_uniform_cos() {
-  hydrogen_RT.grid.szamethod = hydrogen_RT.grid.szamethod_uniform_cos;
-  ly_multiplet_RT.grid.szamethod = ly_multiplet_RT.grid.szamethod_uniform_cos;
-  ly_singlet_RT.grid.szamethod = ly_singlet_RT.grid.szamethod_uniform_cos;
+  invalidate_density_rescale();
+  set_H_szamethod(grid.szamethod_uniform_cos);
+}
+void observation_fit::set_H_szamethod(const int szamethod) {
+  // applies to the H, multiplet, and singlet grids, including those
+  // created later
+  H_szamethod = szamethod;
+  if (H_sys)
+    H_sys->RT.grid.szamethod = szamethod;
+  if (H_hires_sys)
+    H_hires_sys->RT.grid.szamethod = szamethod;
+  if (ly_multiplet_sys)
+    ly_multiplet_sys->RT.grid.szamethod = szamethod;
+  if (ly_singlet_sys)
+    ly_singlet_sys->RT.grid.szamethod = szamethod;
+}
+
+void observation_fit::set_high_resolution(const bool high_resolutionn/* = true*/) {
+  if (high_resolutionn == high_resolution)
+    return;
+  invalidate_density_rescale();
+  high_resolution = high_resolutionn;
+
+  // the IPH was only simulated for the subsystem selected at the time
+  if (sim_iph && iph_RA.size() != 0) {
+    const vector<Real> mars_ecliptic_coords = iph_mars_ecliptic_coords;
+    const vector<Real> RAA = iph_RA;
+    const vector<Real> Decc = iph_Dec;
+    add_observation_ra_dec(mars_ecliptic_coords, RAA, Decc);
+  }
+}
+void observation_fit::set_coarse_to_fine(const bool coarse_to_finee/* = true*/) {
+  // the interpolation is set up with the grid on the next solve
+  coarse_to_fine = coarse_to_finee;
+  invalidate_density_rescale();
+}
+void observation_fit::set_mixed_precision(const bool mixed_precisionn/* = true*/) {
+  mixed_precision = mixed_precisionn;
+  if (H_pp_sys) apply_mixed_precision(*H_pp_sys);
+  if (D_pp_sys) apply_mixed_precision(*D_pp_sys);
+  if (H_sys)    apply_mixed_precision(*H_sys);
+  if (D_sys)    apply_mixed_precision(*D_sys);
+  if (H_hires_sys) apply_mixed_precision(*H_hires_sys);
+  if (D_hires_sys) apply_mixed_precision(*D_hires_sys);
+  invalidate_density_rescale();
+}
+void observation_fit::set_adaptive_radial_grid(const int n_passes/* = 2*/) {
+  assert(n_passes >= 0 && "number of adaptive passes must be non-negative");
+  adaptive_radial_passes = n_passes;
+  invalidate_density_rescale();
+}
+bool observation_fit::get_high_resolution() const {
+  return high_resolution;
+}
+int observation_fit::n_voxels() const {
+  return high_resolution ? hires_grid_type::n_voxels : grid_type::n_voxels;
 }
 
 void observation_fit::reset_H_lya_xsec_coef(const Real xsec_coef/* = lyman_alpha_line_center_cross_secion_coef*/) {
+  invalidate_density_rescale();
   H_cross_section_options.H_lya_xsec_coef = xsec_coef;
   atm_tabular.H_lya_xsec_coef = xsec_coef;
 }
 void observation_fit::reset_H_lyb_xsec_coef(const Real xsec_coef/* = lyman_beta_line_center_cross_section_coef*/) {
+  invalidate_density_rescale();
   H_cross_section_options.H_lyb_xsec_coef = xsec_coef;
   atm_tabular.H_lyb_xsec_coef = xsec_coef;
 }
 void observation_fit::reset_CO2_lya_xsec(const Real xsec/* = CO2_lyman_alpha_absorption_cross_section*/) {
+  invalidate_density_rescale();
   H_cross_section_options.CO2_lya_xsec = xsec;
   atm_tabular.CO2_lya_xsec = xsec;
 }
 void observation_fit::reset_CO2_lyb_xsec(const Real xsec/* = CO2_lyman_beta_absorption_cross_section*/) {
+  invalidate_density_rescale();
   H_cross_section_options.CO2_lyb_xsec = xsec;
   atm_tabular.CO2_lyb_xsec = xsec;
 }
@@ -486,76 +861,214 @@ void observation_fit::set_H_temp_tweak_values(const vector<int> voxels_to_tweak,
   tweak_H_temp_factor = tweak_factor;
 }
 
+vector<vector<vector<Real>>> observation_fit::brightness_jacobian(const Real &nHexo, const Real &Texo,
+								 const vector<vector<int>> &density_tweak_voxels/* = {}*/,
+								 const vector<vector<int>> &temp_tweak_voxels/* = {}*/,
+								 const Real relative_step/* = 1e-3*/) {
+  return with_hydrogen_system(false, [&](auto &sys) {
+      return brightness_jacobian(sys, nHexo, Texo,
+				 density_tweak_voxels, temp_tweak_voxels,
+				 relative_step);
+    });
+}
 
+template <typename S>
+vector<vector<vector<Real>>> observation_fit::brightness_jacobian(S &sys,
+								 const Real &nHexo, const Real &Texo,
+								 const vector<vector<int>> &density_tweak_voxels,
+								 const vector<vector<int>> &temp_tweak_voxels,
+								 const Real relative_step) {
+  assert(relative_step > 0 && relative_step < 1 && "relative step must be between 0 and 1");
+
+  // these solutions do not go through the caches, and the perturbed
+  // ones leave nothing a density rescale could start from
+  invalidate_density_rescale(&sys);
+  *solution_key(&sys) = forward_model_key();
+
+  const bool user_tweak_H_density = tweak_H_density;
+  const bool user_tweak_H_temp = tweak_H_temp;
+  const vector<int> user_tweak_H_density_voxel_numbers = tweak_H_density_voxel_numbers;
+  const vector<int> user_tweak_H_temp_voxel_numbers = tweak_H_temp_voxel_numbers;
+  const Real user_tweak_H_density_factor = tweak_H_density_factor;
+  const Real user_tweak_H_temp_factor = tweak_H_temp_factor;
+  tweak_H_density = false;
+  tweak_H_temp = false;
 
-vector<vector<Real>> observation_fit::brightness() {
-  //compute brightness on the GPU if compiled with NVCC
-#ifdef __CUDACC__
-  hydrogen_RT.brightness_gpu(hydrogen_obs);
-#else
-  hydrogen_RT.brightness(hydrogen_obs);
-#endif
+  auto model_brightness = [&](const Real &n, const Real &T, const bool reuse_factorization) {
+    temp = krasnopolsky_temperature(T);
+    chamb_diff_1d atm(n,
+		      CO2_exobase_density,
+		      &temp,
+		      &H_thermosphere);
+    atm.copy_H_options(H_cross_section_options);
+    define_source_function_sph_azi_sym(atm, T, sys);
+    sys.RT.generate_S(reuse_factorization);
+    return brightness();
+  };
+
+  vector<vector<vector<Real>>> jacobian;
+  auto add_derivative = [&](const vector<vector<Real>> &plus,
+			    const vector<vector<Real>> &minus,
+			    const Real &step) {
+    vector<vector<Real>> derivative = plus;
+    for (unsigned int i_emission=0;i_emission<plus.size();i_emission++)
+      for (unsigned int i_obs=0;i_obs<plus[i_emission].size();i_obs++)
+	derivative[i_emission][i_obs] = (plus[i_emission][i_obs] - minus[i_emission][i_obs]) / (2*step);
+    jacobian.push_back(derivative);
+  };
+
+  // the base model is the only one that is factored
+  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++)
+    sys.emissions[i_emission]->set_keep_factorization(true);
+  model_brightness(nHexo, Texo, false);
+  source_function_solution base_solution(n_hydrogen_emissions);
+  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++)
+    sys.emissions[i_emission]->get_solution(base_solution[i_emission]);
+
+  const Real nHexo_step = relative_step*nHexo;
+  add_derivative(model_brightness(nHexo + nHexo_step, Texo, true),
+		 model_brightness(nHexo - nHexo_step, Texo, true),
+		 nHexo_step);
+  const Real Texo_step = relative_step*Texo;
+  add_derivative(model_brightness(nHexo, Texo + Texo_step, true),
+		 model_brightness(nHexo, Texo - Texo_step, true),
+		 Texo_step);
+
+  tweak_H_density = true;
+  for (auto &voxels : density_tweak_voxels) {
+    tweak_H_density_voxel_numbers = voxels;
+    tweak_H_density_factor = 1 + relative_step;
+    vector<vector<Real>> plus = model_brightness(nHexo, Texo, true);
+    tweak_H_density_factor = 1 - relative_step;
+    add_derivative(plus, model_brightness(nHexo, Texo, true), relative_step);
+  }
+  tweak_H_density = false;
 
-  if (sim_iph)
-    hydrogen_obs.update_iph_extinction();
-  
-  vector<vector<Real>> brightness;
-  brightness.resize(n_hydrogen_emissions);
-  
-  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    brightness[i_emission].resize(hydrogen_obs.size());
-    
-    for (int i=0;i<hydrogen_obs.size();i++) {
-      brightness[i_emission][i] = hydrogen_obs.los[i_emission][i].brightness;
-      if (sim_iph)
-	brightness[i_emission][i] += hydrogen_obs.iph_brightness_observed[i][i_emission];
-    }
+  tweak_H_temp = true;
+  for (auto &voxels : temp_tweak_voxels) {
+    tweak_H_temp_voxel_numbers = voxels;
+    tweak_H_temp_factor = 1 + relative_step;
+    vector<vector<Real>> plus = model_brightness(nHexo, Texo, true);
+    tweak_H_temp_factor = 1 - relative_step;
+    add_derivative(plus, model_brightness(nHexo, Texo, true), relative_step);
   }
-  
-  return brightness;
-}
+  tweak_H_temp = false;
 
-vector<vector<Real>> observation_fit::species_col_dens() {
-  vector<vector<Real>> species_col_dens;
-  species_col_dens.resize(n_hydrogen_emissions);
-  
+  // put back the base model and solution for later brightness calls
+  temp = krasnopolsky_temperature(Texo);
+  chamb_diff_1d atm(nHexo,
+		    CO2_exobase_density,
+		    &temp,
+		    &H_thermosphere);
+  atm.copy_H_options(H_cross_section_options);
+  define_source_function_sph_azi_sym(atm, Texo, sys);
   for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    species_col_dens[i_emission].resize(hydrogen_obs.size());
-    
-    for (int i=0;i<hydrogen_obs.size();i++)
-      species_col_dens[i_emission][i] = hydrogen_obs.los[i_emission][i].species_col_dens;
+    sys.emissions[i_emission]->restore_solution(base_solution[i_emission]);
+    sys.emissions[i_emission]->set_keep_factorization(false);
   }
-  
-  return species_col_dens;
+
+  tweak_H_density = user_tweak_H_density;
+  tweak_H_temp = user_tweak_H_temp;
+  tweak_H_density_voxel_numbers = user_tweak_H_density_voxel_numbers;
+  tweak_H_temp_voxel_numbers = user_tweak_H_temp_voxel_numbers;
+  tweak_H_density_factor = user_tweak_H_density_factor;
+  tweak_H_temp_factor = user_tweak_H_temp_factor;
+
+  return jacobian;
 }
 
-vector<vector<Real>> observation_fit::tau_species_final() {
-  vector<vector<Real>> tau_species;
-  tau_species.resize(n_hydrogen_emissions);
-  
+
+
+template <typename S>
+void observation_fit::copy_los_field(const S &sys,
+				     Real brightness_tracker::* field,
+				     Real *buffer) {
+  // gather one tracker member into a row-major (emission, observation) array
+  const int n_obs = sys.obs.size();
   for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    tau_species[i_emission].resize(hydrogen_obs.size());
-    
-    for (int i=0;i<hydrogen_obs.size();i++)
-      tau_species[i_emission][i] = hydrogen_obs.los[i_emission][i].tau_species_final;
+    const typename S::emission_t::brightness_tracker *los = sys.obs.los[i_emission].v;
+    Real *row = buffer + i_emission*n_obs;
+    for (int i=0;i<n_obs;i++)
+      row[i] = los[i].*field;
   }
-  
-  return tau_species;
 }
 
+vector<vector<Real>> observation_fit::buffer_rows(const vector<Real> &buffer) const {
+  const int n_obs = n_observations();
+  vector<vector<Real>> rows(n_hydrogen_emissions);
+  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++)
+    rows[i_emission].assign(buffer.begin() + i_emission*n_obs,
+			    buffer.begin() + (i_emission+1)*n_obs);
+  return rows;
+}
+
+int observation_fit::n_observations() const {
+  return obs_MSO_locations.size();
+}
+int observation_fit::get_n_hydrogen_emissions() {
+  return n_hydrogen_emissions;
+}
+
+void observation_fit::brightness(Real *buffer) {
+  with_hydrogen_system(false, [&](auto &sys) { hydrogen_brightness(sys, buffer); });
+}
+void observation_fit::species_col_dens(Real *buffer) {
+  with_hydrogen_system(false, [&](auto &sys) {
+      attach_geometry(sys);
+      copy_los_field(sys, &brightness_tracker::species_col_dens, buffer);
+    });
+}
+void observation_fit::tau_species_final(Real *buffer) {
+  with_hydrogen_system(false, [&](auto &sys) {
+      attach_geometry(sys);
+      copy_los_field(sys, &brightness_tracker::tau_species_final, buffer);
+    });
+}
+void observation_fit::tau_absorber_final(Real *buffer) {
+  with_hydrogen_system(false, [&](auto &sys) {
+      attach_geometry(sys);
+      copy_los_field(sys, &brightness_tracker::tau_absorber_final, buffer);
+    });
+}
+
+void observation_fit::D_brightness(Real *buffer) {
+  with_hydrogen_system(true, [&](auto &sys) { hydrogen_brightness(sys, buffer); });
+}
+void observation_fit::D_col_dens(Real *buffer) {
+  with_hydrogen_system(true, [&](auto &sys) {
+      attach_geometry(sys);
+      copy_los_field(sys, &brightness_tracker::species_col_dens, buffer);
+    });
+}
+void observation_fit::tau_D_final(Real *buffer) {
+  with_hydrogen_system(true, [&](auto &sys) {
+      attach_geometry(sys);
+      copy_los_field(sys, &brightness_tracker::tau_species_final, buffer);
+    });
+}
+
+vector<vector<Real>> observation_fit::brightness() {
+  vector<Real> buffer(n_hydrogen_emissions*n_observations());
+  brightness(buffer.data());
+  return buffer_rows(buffer);
+}
+
+vector<vector<Real>> observation_fit::species_col_dens() {
+  vector<Real> buffer(n_hydrogen_emissions*n_observations());
+  species_col_dens(buffer.data());
+  return buffer_rows(buffer);
+}
+
+vector<vector<Real>> observation_fit::tau_species_final() {
+  vector<Real> buffer(n_hydrogen_emissions*n_observations());
+  tau_species_final(buffer.data());
+  return buffer_rows(buffer);
+}
 
 vector<vector<Real>> observation_fit::tau_absorber_final() {
-  vector<vector<Real>> tau_absorber;
-  tau_absorber.resize(n_hydrogen_emissions);
-  
-  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    tau_absorber[i_emission].resize(hydrogen_obs.size());
-    
-    for (int i=0;i<hydrogen_obs.size();i++)
-      tau_absorber[i_emission][i] = hydrogen_obs.los[i_emission][i].tau_absorber_final;
-  }
-  
-  return tau_absorber;
+  vector<Real> buffer(n_hydrogen_emissions*n_observations());
+  tau_absorber_final(buffer.data());
+  return buffer_rows(buffer);
 }
 
 
@@ -563,14 +1076,18 @@ vector<vector<Real>> observation_fit::iph_brightness_observed() {
   vector<vector<Real>> iph_b;
   iph_b.resize(n_hydrogen_emissions);
 
-  hydrogen_obs.update_iph_extinction();
+  with_hydrogen_system(false, [&](auto &H) {
+      attach_geometry(H);
+      auto &hydrogen_obs = H.obs;
+      hydrogen_obs.update_iph_extinction();
   
-  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    iph_b[i_emission].resize(hydrogen_obs.size());
+      for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
+	iph_b[i_emission].resize(hydrogen_obs.size());
     
-    for (int i=0;i<hydrogen_obs.size();i++)
-      iph_b[i_emission][i] =  hydrogen_obs.iph_brightness_observed[i][i_emission];
-  }
+	for (int i=0;i<hydrogen_obs.size();i++)
+	  iph_b[i_emission][i] =  hydrogen_obs.iph_brightness_observed[i][i_emission];
+      }
+    });
   
   return iph_b;
 }
@@ -579,77 +1096,72 @@ vector<vector<Real>> observation_fit::iph_brightness_unextincted() {
   vector<vector<Real>> iph_b;
   iph_b.resize(n_hydrogen_emissions);
 
-  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    iph_b[i_emission].resize(hydrogen_obs.size());
+  with_hydrogen_system(false, [&](auto &H) {
+      attach_geometry(H);
+      auto &hydrogen_obs = H.obs;
+
+      for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
+	iph_b[i_emission].resize(hydrogen_obs.size());
     
-    for (int i=0;i<hydrogen_obs.size();i++)
-      iph_b[i_emission][i] =  hydrogen_obs.iph_brightness_unextincted[i][i_emission];
-  }
+	for (int i=0;i<hydrogen_obs.size();i++)
+	  iph_b[i_emission][i] =  hydrogen_obs.iph_brightness_unextincted[i][i_emission];
+      }
+    });
   
   return iph_b;
 }
 
 vector<vector<Real>> observation_fit::D_brightness() {
-  //compute brightness on the GPU if compiled with NVCC
-#ifdef __CUDACC__
-  deuterium_RT.brightness_gpu(deuterium_obs);
-#else
-  deuterium_RT.brightness(deuterium_obs);
-#endif
-
-  if (sim_iph)
-    deuterium_obs.update_iph_extinction();
-  
-  vector<vector<Real>> brightness;
-  brightness.resize(n_hydrogen_emissions);
-  
-  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    brightness[i_emission].resize(deuterium_obs.size());
-    
-    for (int i=0;i<deuterium_obs.size();i++) {
-      brightness[i_emission][i] = deuterium_obs.los[i_emission][i].brightness;
-      if (sim_iph)
-	brightness[i_emission][i] += deuterium_obs.iph_brightness_observed[i][i_emission];
-    }
-  }
-  
-  return brightness;
+  vector<Real> buffer(n_hydrogen_emissions*n_observations());
+  D_brightness(buffer.data());
+  return buffer_rows(buffer);
 }
 
 vector<vector<Real>> observation_fit::D_col_dens() {
-  vector<vector<Real>> species_col_dens;
-  species_col_dens.resize(n_hydrogen_emissions);
-  
-  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    species_col_dens[i_emission].resize(deuterium_obs.size());
-    
-    for (int i=0;i<deuterium_obs.size();i++)
-      species_col_dens[i_emission][i] = deuterium_obs.los[i_emission][i].species_col_dens;
-  }
-  
-  return species_col_dens;
+  vector<Real> buffer(n_hydrogen_emissions*n_observations());
+  D_col_dens(buffer.data());
+  return buffer_rows(buffer);
 }
 
 vector<vector<Real>> observation_fit::tau_D_final() {
-  vector<vector<Real>> tau_species;
-  tau_species.resize(n_hydrogen_emissions);
-  
-  for (int i_emission=0;i_emission<n_hydrogen_emissions;i_emission++) {
-    tau_species[i_emission].resize(deuterium_obs.size());
-    
-    for (int i=0;i<deuterium_obs.size();i++)
-      tau_species[i_emission][i] = deuterium_obs.los[i_emission][i].tau_species_final;
-  }
-  
-  return tau_species;
+  vector<Real> buffer(n_hydrogen_emissions*n_observations());
+  tau_D_final(buffer.data());
+  return buffer_rows(buffer);
 }
 
 void observation_fit::save_influence_matrix(const string fname) {
-   hydrogen_RT.save_influence(fname);
+  with_hydrogen_system(false, [&](auto &sys) { sys.RT.save_influence(fname); });
 }
 
 void observation_fit::save_influence_matrix_O_1026(const string fname) {
-   oxygen_RT.save_influence(fname);
+   O_1026_system().RT.save_influence(fname);
+}
+
+bool observation_fit::save_source_function_binary(const string fname,
+						  const bool deuterium/* = false*/,
+						  const string git_hash/* = ""*/) {
+  return with_hydrogen_system(deuterium, [&](auto &sys) {
+      return sys.RT.save_S_binary(fname, git_hash);
+    });
+}
+
+bool observation_fit::save_influence_matrix_binary(const string fname,
+						   const bool deuterium/* = false*/,
+						   const string git_hash/* = ""*/) {
+  return with_hydrogen_system(deuterium, [&](auto &sys) {
+      return sys.RT.save_influence_binary(fname, git_hash);
+    });
+}
+
+bool observation_fit::load_source_function_binary(const string fname,
+						  const bool deuterium/* = false*/) {
+  return with_hydrogen_system(deuterium, [&](auto &sys) {
+      // the loaded solution did not come from any key we know about
+      invalidate_density_rescale(&sys);
+      *solution_key(&sys) = forward_model_key();
+
+      return sys.RT.load_S_binary(fname);
+    });
 }
 
 
@@ -682,6 +1194,10 @@ void observation_fit::O_1026_generate_source_function(const Real &nOexo,
   
   atm.spherical = true;
 
+  oxygen_subsystem &sys = O_1026_system();
+  RT_grid<oxygen_emission_type, n_oxygen_emissions, grid_type> &oxygen_RT = sys.RT;
+  oxygen_emission_type &oxygen_1026 = *sys.emissions[0];
+
   oxygen_RT.grid.setup_voxels(atm);
   oxygen_RT.grid.setup_rays();
 
@@ -708,6 +1224,12 @@ void observation_fit::O_1026_generate_source_function(const Real &nOexo,
 }
 
 vector<vector<Real>> observation_fit::O_1026_brightness() {
+  oxygen_subsystem &sys = O_1026_system();
+  attach_geometry(sys);
+  RT_grid<oxygen_emission_type, n_oxygen_emissions, grid_type> &oxygen_RT = sys.RT;
+  observation<oxygen_emission_type, n_oxygen_emissions> &oxygen_obs = sys.obs;
+  const oxygen_emission_type &oxygen_1026 = *sys.emissions[0];
+
   //compute brightness on the GPU if compiled with NVCC
 #ifdef __CUDACC__
   oxygen_RT.brightness_gpu(oxygen_obs);
@@ -748,6 +1270,10 @@ void observation_fit::lyman_multiplet_generate_source_function(const Real &nHexo
   
   atm.spherical = true;
 
+  ly_multiplet_subsystem &sys = ly_multiplet_system();
+  ly_multiplet_subsystem::RT_type &ly_multiplet_RT = sys.RT;
+  ly_multiplet_type &ly_multiplet = *sys.emissions[0];
+
   ly_multiplet_RT.grid.setup_voxels(atm);
   ly_multiplet_RT.grid.setup_rays();
 
@@ -773,6 +1299,11 @@ void observation_fit::lyman_multiplet_generate_source_function(const Real &nHexo
 }
 
 vector<vector<Real>> observation_fit::lyman_multiplet_brightness() {
+  ly_multiplet_subsystem &sys = ly_multiplet_system();
+  attach_geometry(sys);
+  ly_multiplet_subsystem::RT_type &ly_multiplet_RT = sys.RT;
+  observation<ly_multiplet_type, 1> &ly_multiplet_obs = sys.obs;
+
   //compute brightness on the GPU if compiled with NVCC
 #ifdef __CUDACC__
   ly_multiplet_RT.brightness_gpu(ly_multiplet_obs);
@@ -818,6 +1349,10 @@ void observation_fit::lyman_singlet_generate_source_function(const Real &nHexo,
   
   atm.spherical = true;
 
+  ly_singlet_subsystem &sys = ly_singlet_system();
+  ly_singlet_subsystem::RT_type &ly_singlet_RT = sys.RT;
+  ly_singlet_type &ly_singlet = *sys.emissions[0];
+
   ly_singlet_RT.grid.setup_voxels(atm);
   ly_singlet_RT.grid.setup_rays();
 
@@ -843,6 +1378,11 @@ void observation_fit::lyman_singlet_generate_source_function(const Real &nHexo,
 }
 
 vector<vector<Real>> observation_fit::lyman_singlet_brightness() {
+  ly_singlet_subsystem &sys = ly_singlet_system();
+  attach_geometry(sys);
+  ly_singlet_subsystem::RT_type &ly_singlet_RT = sys.RT;
+  observation<ly_singlet_type, 1> &ly_singlet_obs = sys.obs;
+
   //compute brightness on the GPU if compiled with NVCC
 #ifdef __CUDACC__
   ly_singlet_RT.brightness_gpu(ly_singlet_obs);
@@ -4,6 +4,9 @@
 #define __OBSERVATION_FIT_H
 
 #include <string> 
+#include <memory>
+#include <utility>
+#include <typeinfo>
 #include "Real.hpp"
 #include "observation.hpp"
 #include "atm/temperature.hpp"
@@ -13,6 +16,7 @@
 #include "atm/chamb_diff_temp_asymmetric.hpp"
 #include "atm/tabular_1d.hpp"
 #include "RT_grid.hpp"
+#include "forward_model_cache.hpp"
 #include "grid/grid_plane_parallel.hpp"
 #include "grid/grid_spherical_azimuthally_symmetric.hpp"
 #include "emission/singlet_CFR.hpp"
@@ -20,6 +24,14 @@
 #include "emission/H_lyman_multiplet_test.hpp"
 #include "emission/O_1026.hpp"
 
+// Independent observation_fit objects share no mutable state (the
+// shared exosphere and temperature tables are locked internally, and
+// calls into the Fortran IPH model are serialized), so separate
+// instances may be used concurrently from different threads. A single
+// instance is not safe to use from more than one thread at a time.
+// Each instance still runs its own OpenMP loops; when running several
+// instances in parallel, limit OMP_NUM_THREADS to avoid oversubscribing
+// the cores.
 class observation_fit {
 protected:
   hydrogen_density_parameters H_thermosphere;
@@ -34,12 +46,6 @@ protected:
   H_cross_sections H_cross_section_options;
   tabular_1d atm_tabular;
 
-  //  // for comparison with Pratik
-  // static const int n_radial_boundaries = 90;
-  // static const int n_sza_boundaries = 32;/*20 for 10 deg increments with szamethod_uniform*/
-  // static const int n_rays_theta = 24;
-  // static const int n_rays_phi = 16;
-
   //standard resolution case
   static const int n_radial_boundaries = 40;
   static const int n_sza_boundaries = 20;/*20 for 10 deg increments with szamethod_uniform*/
@@ -55,78 +61,177 @@ protected:
 					       n_rays_phi> grid_type;
   grid_type grid;
 
+  // high resolution case (also used for comparison with Pratik), for
+  // final fits. Only the H and D spherical models are instantiated at
+  // this resolution; set_high_resolution switches between the two at
+  // run time.
+  static const int n_radial_boundaries_hires = 90;
+  static const int n_sza_boundaries_hires = 32;
+  static const int n_rays_theta_hires = 24;
+  static const int n_rays_phi_hires = 16;
+  typedef spherical_azimuthally_symmetric_grid<n_radial_boundaries_hires,
+					       n_sza_boundaries_hires,
+					       n_rays_theta_hires,
+					       n_rays_phi_hires> hires_grid_type;
+
+  // Each radiative transfer problem is held in an RT_subsystem: its
+  // emissions, the RT_grid that solves for them, and the observation
+  // used to simulate brightnesses. The emissions carry the voxel
+  // influence matrices, so subsystems are created on first use by the
+  // accessors below, and the observation geometry is only attached
+  // when a brightness is first requested from a subsystem.
+  template <typename emission_type, int N_EMISSIONS>
+  struct emission_set {
+    emission_type emission_storage[N_EMISSIONS];
+    emission_type *emissions[N_EMISSIONS];
+
+    emission_set() {
+      for (int i_emission=0;i_emission<N_EMISSIONS;i_emission++)
+	emissions[i_emission] = &emission_storage[i_emission];
+    }
+  };
+
+  template <typename emission_type, int N_EMISSIONS, typename RT_grid_type>
+  struct RT_subsystem : emission_set<emission_type, N_EMISSIONS> {
+    using emission_set<emission_type, N_EMISSIONS>::emissions;
+
+    static const int n_emissions = N_EMISSIONS;
+    typedef emission_type emission_t;
+    typedef RT_grid<emission_type, N_EMISSIONS, RT_grid_type> RT_type;
+    RT_type RT;
+    observation<emission_type, N_EMISSIONS> obs;
+    int obs_geometry_id; // observation_geometry_id when obs was last set up, -1 if never
+    // interpolation from a coarse grid of the same atmosphere, used to
+    // solve without factoring the kernels; empty if not used
+    SparseMatrixX coarse_interp;
+
+    RT_subsystem(const RT_grid_type &gridd)
+      : RT(gridd, emissions), obs(emissions), obs_geometry_id(-1)
+    { }
+  };
+
   // define hydrogen emissions
   static const int n_hydrogen_emissions = 2;
 
   typedef singlet_CFR<plane_parallel_grid_type::n_voxels> hydrogen_emission_type_pp;
-  hydrogen_emission_type_pp lyman_alpha_pp, lyman_beta_pp;
-  hydrogen_emission_type_pp *hydrogen_emissions_pp[n_hydrogen_emissions] = {&lyman_alpha_pp, &lyman_beta_pp};
-
-  typedef RT_grid<hydrogen_emission_type_pp, n_hydrogen_emissions, plane_parallel_grid_type> H_RT_type_pp;
-  H_RT_type_pp hydrogen_RT_pp;
+  typedef RT_subsystem<hydrogen_emission_type_pp, n_hydrogen_emissions, plane_parallel_grid_type> H_pp_subsystem;
+  typedef H_pp_subsystem::RT_type H_RT_type_pp;
 
   typedef singlet_CFR<grid_type::n_voxels> hydrogen_emission_type;
-  hydrogen_emission_type lyman_alpha, lyman_beta;
-  hydrogen_emission_type *hydrogen_emissions[n_hydrogen_emissions] = {&lyman_alpha, &lyman_beta};
-
-  typedef RT_grid<hydrogen_emission_type, n_hydrogen_emissions, grid_type> H_RT_type;
-  H_RT_type hydrogen_RT;
-
-  observation<hydrogen_emission_type, n_hydrogen_emissions> hydrogen_obs;
+  typedef RT_subsystem<hydrogen_emission_type, n_hydrogen_emissions, grid_type> H_subsystem;
+  typedef H_subsystem::RT_type H_RT_type;
 
+  typedef singlet_CFR<hires_grid_type::n_voxels> hydrogen_emission_type_hires;
+  typedef RT_subsystem<hydrogen_emission_type_hires, n_hydrogen_emissions, hires_grid_type> H_hires_subsystem;
 
+  // hydrogen and deuterium share emission types and grids
+  std::unique_ptr<H_pp_subsystem> H_pp_sys, D_pp_sys;
+  std::unique_ptr<H_subsystem> H_sys, D_sys;
+  std::unique_ptr<H_hires_subsystem> H_hires_sys, D_hires_sys;
 
   // Interplanetary H Lyman alpha
   string iph_sfn_fname; // quemerais IPH source function filename
   bool sim_iph;
 
-
-
-  // define deuterium emissions
-  hydrogen_emission_type_pp D_lyman_alpha_pp, D_lyman_beta_pp;
-  hydrogen_emission_type_pp *deuterium_emissions_pp[n_hydrogen_emissions] = {&D_lyman_alpha_pp, &D_lyman_beta_pp};
-  H_RT_type_pp deuterium_RT_pp;
-
-  hydrogen_emission_type D_lyman_alpha, D_lyman_beta;
-  hydrogen_emission_type *deuterium_emissions[n_hydrogen_emissions] = {&D_lyman_alpha, &D_lyman_beta};
-  H_RT_type deuterium_RT;
-
-  observation<hydrogen_emission_type, n_hydrogen_emissions> deuterium_obs;
-
-
-
   // H Lyman alpha multiplet models
   typedef H_lyman_multiplet<grid_type::n_voxels> ly_multiplet_type;
-  ly_multiplet_type ly_multiplet;
-  ly_multiplet_type *ly_multiplet_emissions[1] = {&ly_multiplet};
-
-  typedef RT_grid<ly_multiplet_type, 1, grid_type> H_RT_ly_multiplet_type;
-  H_RT_ly_multiplet_type ly_multiplet_RT;
-
-  observation<ly_multiplet_type, 1> ly_multiplet_obs;
-
+  typedef RT_subsystem<ly_multiplet_type, 1, grid_type> ly_multiplet_subsystem;
+  std::unique_ptr<ly_multiplet_subsystem> ly_multiplet_sys;
 
   // H Lyman alpha singlet model in multiplet framework
   typedef H_lyman_singlet<grid_type::n_voxels> ly_singlet_type;
-  ly_singlet_type ly_singlet;
-  ly_singlet_type *ly_singlet_emissions[1] = {&ly_singlet};
-
-  typedef RT_grid<ly_singlet_type, 1, grid_type> H_RT_ly_singlet_type;
-  H_RT_ly_singlet_type ly_singlet_RT;
-
-  observation<ly_singlet_type, 1> ly_singlet_obs;
-  
+  typedef RT_subsystem<ly_singlet_type, 1, grid_type> ly_singlet_subsystem;
+  std::unique_ptr<ly_singlet_subsystem> ly_singlet_sys;
 
   // define oxygen emissions
   static const int n_oxygen_emissions = 1;
 
   typedef O_1026_emission<grid_type::n_voxels> oxygen_emission_type;
-  oxygen_emission_type oxygen_1026;
-  oxygen_emission_type *oxygen_emissions[n_oxygen_emissions] = {&oxygen_1026};
+  typedef RT_subsystem<oxygen_emission_type, n_oxygen_emissions, grid_type> oxygen_subsystem;
+  std::unique_ptr<oxygen_subsystem> O_1026_sys;
+
+  // accessors that create each subsystem on first use and apply the
+  // current settings to it
+  H_pp_subsystem & H_pp_system();
+  H_pp_subsystem & D_pp_system();
+  H_subsystem & H_system();
+  H_subsystem & D_system();
+  H_pp_subsystem & hydrogen_pp_system(const bool deuterium);
+  H_subsystem & hydrogen_system(const bool deuterium);
+  H_hires_subsystem & H_hires_system();
+  H_hires_subsystem & D_hires_system();
+  H_hires_subsystem & hydrogen_hires_system(const bool deuterium);
+  ly_multiplet_subsystem & ly_multiplet_system();
+  ly_singlet_subsystem & ly_singlet_system();
+  oxygen_subsystem & O_1026_system();
+
+  // Calls f with the H or D spherical subsystem at the selected
+  // resolution. f is instantiated for both subsystem types, so it is
+  // usually a generic lambda.
+  bool high_resolution;
+  template <typename F>
+  auto with_hydrogen_system(const bool deuterium, F f) -> decltype(f(std::declval<H_subsystem&>())) {
+    if (high_resolution)
+      return f(hydrogen_hires_system(deuterium));
+    else
+      return f(hydrogen_system(deuterium));
+  }
 
-  RT_grid<oxygen_emission_type, n_oxygen_emissions, grid_type> oxygen_RT;
+  // solve the high resolution models with a coarse grid correction
+  // instead of a factorization
+  bool coarse_to_fine;
+  template <typename A>
+  void setup_coarse_interp(A &/*atmm*/, H_subsystem &/*sys*/) { }
+  template <typename A>
+  void setup_coarse_interp(A &atmm, H_hires_subsystem &sys) {
+    if (!coarse_to_fine) {
+      sys.coarse_interp.resize(0, 0);
+      return;
+    }
+    // the standard grid of this atmosphere, only its geometry is needed
+    std::unique_ptr<grid_type> coarse_grid(new grid_type);
+    setup_sph_grid(*coarse_grid, sys.RT.grid.szamethod);
+    coarse_grid->rmethod = sys.RT.grid.rmethod;
+    coarse_grid->setup_voxels(atmm);
+    sys.coarse_interp = sys.RT.grid.interpolation_from(*coarse_grid);
+  }
 
-  observation<oxygen_emission_type, n_oxygen_emissions> oxygen_obs;
+  // number of times the radial boundaries of the H/D spherical grids
+  // are moved toward the layers with the largest error estimate
+  // before the final solve; 0 keeps the boundaries from rmethod
+  int adaptive_radial_passes;
+  // boundaries found by adaptation, keyed like the source function
+  // cache and sized with it
+  forward_model_lru_cache<vector<Real>> adapted_grid_cache;
+
+  // settings kept here so they can be applied to subsystems created later
+  vector<Real> g_factor; // empty until set_g_factor is called
+  bool mixed_precision; // see set_mixed_precision
+  int H_szamethod;
+  void set_H_szamethod(const int szamethod);
+  template <typename G>
+  void setup_sph_grid(G &RT_grid, const int szamethod);
+  template <typename S>
+  void apply_g_factor(S &sys);
+  template <typename S>
+  void apply_mixed_precision(S &sys);
+  template <typename E>
+  void apply_multiplet_settings(E &emiss);
+
+  // observation geometry, attached to each subsystem's observation
+  // only when that subsystem is asked for a brightness
+  vector<vector<Real>> obs_MSO_locations, obs_MSO_directions;
+  int observation_geometry_id;
+  // IPH inputs for the current geometry, kept so the IPH can be
+  // simulated again when the resolution changes
+  vector<Real> iph_mars_ecliptic_coords, iph_RA, iph_Dec;
+  template <typename S>
+  void attach_geometry(S &sys) {
+    if (sys.obs_geometry_id != observation_geometry_id) {
+      sys.obs.add_MSO_observation(obs_MSO_locations, obs_MSO_directions);
+      sys.obs_geometry_id = observation_geometry_id;
+    }
+  }
 
   // variables used to test sensitivity to density and temperature in each voxel
   bool tweak_H_density;
@@ -137,10 +242,118 @@ protected:
   vector<int> tweak_H_temp_voxel_numbers;
   Real tweak_H_temp_factor;
 
+  // inputs of the last full spherical solution computed by
+  // generate_source_function_variable_thermosphere. If a later call
+  // changes only nHexo, the species density scales by the same factor
+  // everywhere and the fixed altitude grid does not move, so the
+  // emissions can be rescaled in place without rebuilding the
+  // atmosphere or regridding.
+  struct density_rescale_key {
+    bool valid = false;
+    Real nHexo, Texo, nCO2rmin, rexo, rmin, rmax, rmindiffusion;
+    Real T_tropo, r_tropo, shape_parameter;
+
+    bool same_except_nHexo(const density_rescale_key &other) const;
+  };
+  density_rescale_key H_rescale_key, D_rescale_key;
+  bool density_rescale_shortcut;
+
+  void invalidate_density_rescale();
+  void invalidate_density_rescale(const void *sys);
+
+  // optional caches of solved source functions and simulated
+  // brightnesses. Source functions are keyed by the generating
+  // routine, its arguments, and every setting that enters define() or
+  // generate_S; brightnesses by the key of the solution they were
+  // computed from. Both are disabled (zero capacity) by default.
+  source_function_cache sourcefn_cache;
+  template <typename S>
+  using hydrogen_brightness_result = vector<vector<typename S::emission_t::brightness_tracker>>;
+  forward_model_lru_cache<hydrogen_brightness_result<H_subsystem>> brightness_cache;
+  forward_model_lru_cache<hydrogen_brightness_result<H_hires_subsystem>> hires_brightness_cache;
+  forward_model_lru_cache<hydrogen_brightness_result<H_subsystem>> & brightness_cache_for(H_subsystem &/*sys*/) {
+    return brightness_cache;
+  }
+  forward_model_lru_cache<hydrogen_brightness_result<H_hires_subsystem>> & brightness_cache_for(H_hires_subsystem &/*sys*/) {
+    return hires_brightness_cache;
+  }
+
+  // inputs of the solution currently held by the H and D spherical subsystems
+  forward_model_key hydrogen_solution_key, deuterium_solution_key;
+  forward_model_key hydrogen_hires_solution_key, deuterium_hires_solution_key;
+  forward_model_key* solution_key(const void *sys);
+
+  forward_model_key source_function_key(const string &variant,
+					const vector<doubReal> &params,
+					const bool plane_parallel,
+					const bool deuterium);
+
+  template <typename S>
+  void generate_S(S &sys) {
+    //compute source function on the GPU if compiled with NVCC
+#ifdef __CUDACC__
+    sys.RT.generate_S_gpu();
+#else
+    if (sys.coarse_interp.rows() != 0)
+      sys.RT.generate_S_two_level(sys.coarse_interp);
+    else
+      sys.RT.generate_S();
+#endif
+  }
+
+  template <typename S>
+  void solve_source_function(S &sys, const forward_model_key &key) {
+    // cached solutions are tied to the grid they were solved on
+    const string grid_name = typeid(sys.RT.grid).name();
+    const int n_voxels = sys.RT.grid.n_voxels;
+
+    const source_function_solution *cached = sourcefn_cache.find(key, grid_name, n_voxels);
+    bool restored = (cached != NULL && int(cached->size()) == S::n_emissions);
+    for (int i_emission=0;restored && i_emission<S::n_emissions;i_emission++)
+      restored = S::emission_t::solution_matches((*cached)[i_emission]);
+
+    if (restored) {
+      for (int i_emission=0;i_emission<S::n_emissions;i_emission++)
+	sys.emissions[i_emission]->restore_solution((*cached)[i_emission]);
+    } else {
+      generate_S(sys);
+
+      if (sourcefn_cache.enabled()) {
+	source_function_solution solution(S::n_emissions);
+	for (int i_emission=0;i_emission<S::n_emissions;i_emission++)
+	  sys.emissions[i_emission]->get_solution(solution[i_emission]);
+	sourcefn_cache.insert(key, solution, grid_name, n_voxels);
+      }
+    }
+
+    forward_model_key *current_key = solution_key(&sys);
+    if (current_key != NULL)
+      *current_key = key;
+  }
+
+  template <typename S>
+  void hydrogen_brightness(S &sys);
+  template <typename S>
+  void hydrogen_brightness(S &sys, Real *buffer);
+
+  // the brightness trackers of all singlet_CFR resolutions share these fields
+  template <typename S>
+  static void copy_los_field(const S &sys,
+			     Real brightness_tracker::* field,
+			     Real *buffer);
+  vector<vector<Real>> buffer_rows(const vector<Real> &buffer) const;
+
+  template <typename S>
+  std::vector<std::vector<std::vector<Real>>> brightness_jacobian(S &sys,
+								  const Real &nHexo, const Real &Texo,
+								  const vector<vector<int>> &density_tweak_voxels,
+								  const vector<vector<int>> &temp_tweak_voxels,
+								  const Real relative_step);
+
 public:
   observation_fit(const string iph_sfn_fnamee);
 
-  Temp_converter Tconv;//also takes exobase alt argument
+  Temp_converter Tconv;//also takes exobase alt argument, tables are shared and built on first use
 
   void add_observation(const std::vector<vector<Real>> &MSO_locations,
 		       const std::vector<vector<Real>> &MSO_directions);
@@ -187,13 +400,16 @@ public:
 						      const bool plane_parallel=false,
 						      const bool deuterium=false);
 
-  template <typename A, typename RT, typename E>
+  template <typename A, typename S>
   void generate_source_function_plane_parallel(A &atmm, const Real &Texo,
-					       RT &RT_obj,
-					       E &lya_obj,
-					       E &lyb_obj,
+					       S &sys,
+					       const forward_model_key &key,
 					       const string sourcefn_fname = "")
   {
+    typename S::RT_type &RT_obj = sys.RT;
+    auto &lya_obj = *sys.emissions[0];
+    auto &lyb_obj = *sys.emissions[1];
+
     bool atmm_spherical = atmm.spherical;
     atmm.spherical = false;
     
@@ -227,32 +443,78 @@ public:
     
     atmm.spherical = atmm_spherical;  
     
-    //compute source function on the GPU if compiled with NVCC
-#ifdef __CUDACC__
-    RT_obj.generate_S_gpu();
-#else
-    RT_obj.generate_S();
-#endif
+    solve_source_function(sys, key);
     
     if (sourcefn_fname!="")
-      RT_obj.save_S(sourcefn_fname);
+      sys.RT.save_S(sourcefn_fname);
   }
   
-  template <typename A, typename RT, typename E>
+  template <typename A, typename S>
   void generate_source_function_sph_azi_sym(A &atmm, const Real &Texo,
-					    RT &RT_obj,
-					    E &lya_obj,
-					    E &lyb_obj,
+					    S &sys,
+					    const forward_model_key &key,
 					    const string sourcefn_fname = "")
   {
+    // any full solution replaces the state a density rescale would start from
+    invalidate_density_rescale(&sys);
+
+    define_source_function_sph_azi_sym(atmm, Texo, sys);
+    if (adaptive_radial_passes > 0)
+      adapt_radial_grid(atmm, Texo, sys, key);
+    
+    solve_source_function(sys, key);
+    
+    if (sourcefn_fname!="")
+      sys.RT.save_S(sourcefn_fname);
+  }
+
+  // Solve, move the radial boundaries so each layer has an equal share
+  // of the error estimate (see
+  // spherical_azimuthally_symmetric_grid::radial_layer_error), and
+  // define the emissions again on the new grid, adaptive_radial_passes
+  // times. The final solve is left to the caller.
+  template <typename A, typename S>
+  void adapt_radial_grid(A &atmm, const Real &Texo,
+			 S &sys,
+			 const forward_model_key &key)
+  {
+    const vector<Real> *cached = adapted_grid_cache.find(key);
+    if (cached != NULL) {
+      sys.RT.grid.set_radial_boundaries(*cached);
+      define_source_function_sph_azi_sym(atmm, Texo, sys, /*keep_radial_boundaries = */true);
+      return;
+    }
+
+    for (int i_pass=0;i_pass<adaptive_radial_passes;i_pass++) {
+      generate_S(sys);
+      sys.RT.grid.redistribute_radial_boundaries(sys.RT.radial_layer_error());
+      define_source_function_sph_azi_sym(atmm, Texo, sys, /*keep_radial_boundaries = */true);
+    }
+    adapted_grid_cache.insert(key, sys.RT.grid.get_radial_boundaries());
+  }
+
+  // set up the grid and emissions for an atmosphere, without
+  // solving. keep_radial_boundaries leaves boundaries set by
+  // adapt_radial_grid in place.
+  template <typename A, typename S>
+  void define_source_function_sph_azi_sym(A &atmm, const Real &Texo,
+					  S &sys,
+					  const bool keep_radial_boundaries = false)
+  {
+    typename S::RT_type &RT_obj = sys.RT;
+    auto &lya_obj = *sys.emissions[0];
+    auto &lyb_obj = *sys.emissions[1];
+
     bool change_spherical = false;
     if (atmm.spherical != true) {
       change_spherical = true;
       atmm.spherical = true;
     }
     
-    RT_obj.grid.setup_voxels(atmm);
+    if (!keep_radial_boundaries)
+      RT_obj.grid.setup_voxels(atmm);
     RT_obj.grid.setup_rays();
+    setup_coarse_interp(atmm, sys);
     
     //update the emission density values
     lya_obj.define("H Lyman alpha",
@@ -281,19 +543,25 @@ public:
     
     if (change_spherical)
       atmm.spherical = false;    
-    
-    //compute source function on the GPU if compiled with NVCC
-#ifdef __CUDACC__
-    RT_obj.generate_S_gpu();
-#else
-    RT_obj.generate_S();
-#endif
+  }
+
+  template <typename S>
+  void rescale_source_function_sph_azi_sym(const Real &density_factor,
+					   S &sys,
+					   const forward_model_key &key,
+					   const string sourcefn_fname = "")
+  {
+    // grid and emission parameters are already defined, only the
+    // species density changes
+    for (int i_emission=0;i_emission<S::n_emissions;i_emission++)
+      sys.emissions[i_emission]->rescale_species_density(density_factor);
+
+    solve_source_function(sys, key);
     
     if (sourcefn_fname!="")
-      RT_obj.save_S(sourcefn_fname);
+      sys.RT.save_S(sourcefn_fname);
   }
 
-
   void generate_source_function_nH_asym(const Real &nHexo, const Real &Texo,
 					const Real &asym,
 					const string sourcefn_fname = "",
@@ -334,6 +602,38 @@ public:
 
   void set_sza_method_uniform();
   void set_sza_method_uniform_cos();
+
+  // Switch the H and D spherical models between the standard grid
+  // (40x20 boundaries, 7x12 rays) and the high resolution grid
+  // (90x32 boundaries, 24x16 rays). Solutions at each resolution are
+  // kept separately; the O 1026, multiplet, and plane-parallel models
+  // always use the standard grid.
+  void set_high_resolution(const bool high_resolutionn = true);
+  bool get_high_resolution() const;
+  // number of voxels in the H spherical grid at the current resolution,
+  // e.g. to choose voxels for set_H_density_tweak_values
+  int n_voxels() const;
+
+  // Solve the high resolution models iteratively, starting from and
+  // preconditioned by the standard grid, instead of factoring the
+  // kernel (see emission_voxels::solve_two_level). Solutions agree
+  // with the direct solve to about 1e-10; the saving is in the solve,
+  // not the influence calculation.
+  void set_coarse_to_fine(const bool coarse_to_finee = true);
+
+  // Factor the hydrogen kernels in single precision and refine the
+  // source functions in double precision (see
+  // emission_voxels::set_mixed_precision). Source functions agree
+  // with the double precision factorization to about 1e-10.
+  void set_mixed_precision(const bool mixed_precisionn = true);
+
+  // Move the radial boundaries of the H/D spherical grids toward the
+  // layers with the largest error estimate (curvature of the source
+  // function and optical depth per layer), solving n_passes times
+  // before the final solve. The number of boundaries is unchanged.
+  // n_passes = 0 returns to the fixed rmethod boundaries. Jacobians
+  // are computed on the fixed grid.
+  void set_adaptive_radial_grid(const int n_passes = 2);
   
   void reset_H_lya_xsec_coef(const Real xsec_coef = lyman_alpha_line_center_cross_section_coef);
   void reset_H_lyb_xsec_coef(const Real xsec_coef = lyman_beta_line_center_cross_section_coef);
@@ -347,10 +647,56 @@ public:
   void save_influence_matrix(const string fname);
   void save_influence_matrix_O_1026(const string fname);
 
+  // binary, memory-mappable versions of the H or D source function
+  // and influence matrix (see RT_binary_file.hpp for the format)
+  bool save_source_function_binary(const string fname,
+				   const bool deuterium = false,
+				   const string git_hash = "");
+  bool save_influence_matrix_binary(const string fname,
+				    const bool deuterium = false,
+				    const string git_hash = "");
+  // restore a source function saved by save_source_function_binary in
+  // place of a generate_source_function call, so brightness can be
+  // simulated for new observations without solving again
+  bool load_source_function_binary(const string fname,
+				   const bool deuterium = false);
+
   void set_H_density_tweak(const bool tweak_H_densityy = false);
   void set_H_density_tweak_values(const vector<int> voxels_to_tweak, const Real tweak_factor);
   void set_H_temp_tweak(const bool tweak_H_tempp = false);
   void set_H_temp_tweak_values(const vector<int> voxels_to_tweak, const Real tweak_factor);
+
+  // Derivatives of the H brightness of the current observation by
+  // central differences around the untweaked model for nHexo and Texo,
+  // returned as jacobian[i_parameter][i_emission][i_obs]. Parameters
+  // are nHexo, Texo, then one per voxel group in density_tweak_voxels
+  // and temp_tweak_voxels; the tweak derivatives are with respect to
+  // the tweak factor at 1 (i.e. the log of the voxel density or
+  // temperature). The base model is factored once and each perturbed
+  // model is solved by iterative refinement preconditioned with that
+  // factorization; the influence calculation is still repeated for
+  // every perturbed model and dominates its cost. Afterwards the base
+  // solution is left in place, without its influence matrix, and the
+  // tweak settings are unchanged.
+  std::vector<std::vector<std::vector<Real>>> brightness_jacobian(const Real &nHexo, const Real &Texo,
+								  const vector<vector<int>> &density_tweak_voxels = {},
+								  const vector<vector<int>> &temp_tweak_voxels = {},
+								  const Real relative_step = 1e-3);
+
+  // rescale the previous solution in place when only nHexo changes
+  // between calls to generate_source_function_variable_thermosphere
+  void set_density_rescale_shortcut(const bool use_shortcut = true);
+
+  // bounded caches of source functions and H/D brightnesses. A size of
+  // zero disables a cache. Restored solutions do not include the
+  // influence matrix, so save_influence_matrix is only meaningful
+  // after a solution has actually been computed.
+  void set_forward_model_cache_size(const int n_source_functions, const int n_brightnesses);
+  // directory where solved source functions are also kept on disk ("" for
+  // none). Files are only reused by code with the same git_hash.
+  void set_forward_model_cache_dir(const string dirname, const string git_hash = "");
+  void clear_forward_model_cache();
+  forward_model_cache_stats get_forward_model_cache_stats() const;
   
   std::vector<std::vector<Real>> brightness();
   std::vector<std::vector<Real>> species_col_dens();
@@ -363,6 +709,20 @@ public:
   std::vector<std::vector<Real>> D_col_dens();
   std::vector<std::vector<Real>> tau_D_final();
 
+  // The same results written without intermediate copies into a
+  // caller-supplied row-major buffer of
+  // get_n_hydrogen_emissions()*n_observations() values, e.g. the data
+  // of a NumPy array. D_ results have the same shape.
+  int n_observations() const;
+  static int get_n_hydrogen_emissions();
+  void brightness(Real *buffer);
+  void species_col_dens(Real *buffer);
+  void tau_species_final(Real *buffer);
+  void tau_absorber_final(Real *buffer);
+  void D_brightness(Real *buffer);
+  void D_col_dens(Real *buffer);
+  void tau_D_final(Real *buffer);
+
 
   void O_1026_generate_source_function(const Real &nOexo,
   				       const Real &Texo,
@@ -0,0 +1,243 @@
+#include "observation_fit_driver.hpp"
+#include "constants.hpp"
+#include "observation_fit.hpp"
+#include <sstream>
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+using std::vector;
+using std::string;
+
+bool observation_set::load(const string &fname) {
+  std::ifstream file(fname.c_str());
+  if (!file.is_open())
+    return false;
+
+  name = fname;
+  locations.clear();
+  directions.clear();
+  g_factor.clear();
+  mars_ecliptic_pos.clear();
+  ra.clear();
+  dec.clear();
+
+  string line;
+  while (std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream tokens(line);
+    string first;
+    if (!(tokens >> first))
+      continue;
+
+    vector<Real> values;
+    Real value;
+    if (first == "g_factor" || first == "mars_ecliptic_pos") {
+      while (tokens >> value)
+	values.push_back(value);
+      if (first == "g_factor") {
+	if (values.size() < 2)
+	  return false;
+	g_factor = values;
+      } else {
+	if (values.size() != 3)
+	  return false;
+	mars_ecliptic_pos = values;
+      }
+      continue;
+    }
+
+    std::istringstream all_tokens(line);
+    while (all_tokens >> value)
+      values.push_back(value);
+    if (values.size() != 6 && values.size() != 8)
+      return false;
+    locations.push_back({values[0], values[1], values[2]});
+    directions.push_back({values[3], values[4], values[5]});
+    if (values.size() == 8) {
+      ra.push_back(values[6]);
+      dec.push_back(values[7]);
+    }
+  }
+
+  if (mars_ecliptic_pos.size() != 0 && ra.size() != locations.size())
+    return false;
+  return locations.size() > 0;
+}
+
+int observation_set::size() const {
+  return locations.size();
+}
+
+bool observation_set::simulate_iph() const {
+  return mars_ecliptic_pos.size() != 0;
+}
+
+
+observation_fit_driver::observation_fit_driver(const string &iph_sfn_fnamee,
+					       const int n_workerss,
+					       const int threads_per_workerr/* = 1*/)
+  : iph_sfn_fname(iph_sfn_fnamee),
+    n_workers(std::max(n_workerss, 1)),
+    threads_per_worker(std::max(threads_per_workerr, 1))
+{ }
+
+bool observation_fit_driver::load_parameters(const string &fname, vector<model_parameters> &parameters) {
+  std::ifstream file(fname.c_str());
+  if (!file.is_open())
+    return false;
+
+  string line;
+  while (std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream tokens(line);
+    model_parameters params;
+    if (tokens >> params.nHexo >> params.Texo)
+      parameters.push_back(params);
+  }
+  return true;
+}
+
+bool observation_fit_driver::load_observation_sets(const string &fname, vector<observation_set> &sets) {
+  std::ifstream file(fname.c_str());
+  if (!file.is_open())
+    return false;
+
+  string line;
+  while (std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream tokens(line);
+    string set_fname;
+    if (!(tokens >> set_fname))
+      continue;
+    observation_set set;
+    if (!set.load(set_fname)) {
+      std::cerr << "could not read observation set " << set_fname << std::endl;
+      return false;
+    }
+    sets.push_back(set);
+  }
+  return true;
+}
+
+void observation_fit_driver::write_result(const observation_set &set,
+					  const model_parameters &params,
+					  const vector<vector<Real>> &brightness) {
+  std::lock_guard<std::mutex> output_lock(output_mutex);
+  for (unsigned int i_emission=0;i_emission<brightness.size();i_emission++) {
+    output << set.name << " " << params.nHexo << " " << params.Texo << " " << i_emission;
+    for (auto &b : brightness[i_emission])
+      output << " " << b;
+    output << "\n";
+  }
+  output.flush();
+}
+
+void observation_fit_driver::run_worker(const vector<model_parameters> &parameters,
+					const vector<observation_set> &sets,
+					const vector<task> &tasks,
+					int &next_task,
+					std::mutex &task_mutex) {
+#ifdef _OPENMP
+  omp_set_num_threads(threads_per_worker);
+#endif
+
+  observation_fit fit(iph_sfn_fname);
+  // remember the last solution, so consecutive tasks with the same
+  // parameters and g factor do not solve again
+  fit.set_forward_model_cache_size(/*n_source_functions = */1, /*n_brightnesses = */0);
+
+  const vector<Real> default_g_factor = {lyman_alpha_typical_g_factor, lyman_beta_typical_g_factor};
+  vector<Real> current_g_factor;
+
+  while (true) {
+    int i_task;
+    {
+      std::lock_guard<std::mutex> task_lock(task_mutex);
+      i_task = next_task++;
+    }
+    if (i_task >= (int) tasks.size())
+      return;
+    const task &this_task = tasks[i_task];
+    const model_parameters &params = parameters[this_task.i_parameters];
+
+    // all sets in a task share a g factor
+    const observation_set &first_set = sets[this_task.i_sets[0]];
+    vector<Real> g_factor = first_set.g_factor.size() == 0 ? default_g_factor : first_set.g_factor;
+    if (g_factor != current_g_factor) {
+      fit.set_g_factor(g_factor);
+      current_g_factor = g_factor;
+    }
+
+    fit.generate_source_function(params.nHexo, params.Texo);
+
+    for (int i_set : this_task.i_sets) {
+      const observation_set &set = sets[i_set];
+      fit.add_observation(set.locations, set.directions);
+      if (set.simulate_iph())
+	fit.add_observation_ra_dec(set.mars_ecliptic_pos, set.ra, set.dec);
+      else
+	fit.simulate_iph(false);
+
+      write_result(set, params, fit.brightness());
+    }
+  }
+}
+
+bool observation_fit_driver::run(const vector<model_parameters> &parameters,
+				 const vector<observation_set> &sets,
+				 const string &output_fname) {
+  output.open(output_fname.c_str());
+  if (!output.is_open())
+    return false;
+  output.precision(8);
+  output << "# observation set, nHexo [cm-3], Texo [K], emission index, brightness [kR] for each line of sight\n";
+
+  // sets that share a g factor can share a source function solution
+  vector<vector<int>> g_factor_groups;
+  for (unsigned int i_set=0;i_set<sets.size();i_set++) {
+    bool found = false;
+    for (auto &group : g_factor_groups)
+      if (sets[group[0]].g_factor == sets[i_set].g_factor) {
+	group.push_back(i_set);
+	found = true;
+	break;
+      }
+    if (!found)
+      g_factor_groups.push_back({(int) i_set});
+  }
+
+  // if there are fewer solutions than workers, split each group so all
+  // workers have something to do, at the cost of some repeated solves
+  const int n_solutions = parameters.size()*g_factor_groups.size();
+  const int n_chunks = n_solutions == 0 ? 1 : (n_workers + n_solutions - 1)/n_solutions;
+
+  vector<task> tasks;
+  for (unsigned int i_parameters=0;i_parameters<parameters.size();i_parameters++)
+    for (auto &group : g_factor_groups) {
+      const int n_group_chunks = std::min(n_chunks, (int) group.size());
+      for (int i_chunk=0;i_chunk<n_group_chunks;i_chunk++) {
+	task chunk_task;
+	chunk_task.i_parameters = i_parameters;
+	for (unsigned int i=i_chunk;i<group.size();i+=n_group_chunks)
+	  chunk_task.i_sets.push_back(group[i]);
+	tasks.push_back(chunk_task);
+      }
+    }
+
+  int next_task = 0;
+  std::mutex task_mutex;
+  vector<std::thread> workers;
+  const int n_threads = std::min(n_workers, (int) tasks.size());
+  for (int i_worker=0;i_worker<n_threads;i_worker++)
+    workers.emplace_back(&observation_fit_driver::run_worker, this,
+			 std::cref(parameters), std::cref(sets), std::cref(tasks),
+			 std::ref(next_task), std::ref(task_mutex));
+  for (auto &worker : workers)
+    worker.join();
+
+  output.close();
+  return true;
+}
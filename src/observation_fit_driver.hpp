@@ -0,0 +1,83 @@
+//observation_fit_driver.hpp -- evaluate forward models for many observation sets in parallel
+
+#ifndef __OBSERVATION_FIT_DRIVER_H
+#define __OBSERVATION_FIT_DRIVER_H
+
+#include "Real.hpp"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+
+// One set of lines of sight, usually one orbit segment, read from a
+// text file:
+//
+//   # comment
+//   g_factor <Ly alpha> <Ly beta>           (optional)
+//   mars_ecliptic_pos <x> <y> <z>           (optional, AU; enables IPH)
+//   <x> <y> <z> <dir x> <dir y> <dir z> [<RA> <Dec>]
+//
+// with one line per line of sight, MSO positions in cm. RA and Dec (in
+// degrees) are required on every line if mars_ecliptic_pos is given.
+struct observation_set {
+  std::string name;
+  std::vector<std::vector<Real>> locations, directions;
+  std::vector<Real> g_factor;
+  std::vector<Real> mars_ecliptic_pos;
+  std::vector<Real> ra, dec;
+
+  bool load(const std::string &fname);
+  int size() const;
+  bool simulate_iph() const;
+};
+
+// exobase density and temperature passed to generate_source_function
+struct model_parameters {
+  Real nHexo, Texo;
+};
+
+// Runs every parameter point against every observation set on a pool of
+// worker threads. Each worker owns one observation_fit, and tasks are
+// grouped so that a worker solves the source function once for a given
+// parameter point and g factor and then reuses it for the brightness of
+// every set that shares them. Results are appended to the output file
+// as each set finishes.
+class observation_fit_driver {
+  std::string iph_sfn_fname;
+  int n_workers;
+  int threads_per_worker;
+
+  struct task {
+    int i_parameters;
+    std::vector<int> i_sets;
+  };
+
+  std::mutex output_mutex;
+  std::ofstream output;
+
+  void run_worker(const std::vector<model_parameters> &parameters,
+		  const std::vector<observation_set> &sets,
+		  const std::vector<task> &tasks,
+		  int &next_task,
+		  std::mutex &task_mutex);
+  void write_result(const observation_set &set,
+		    const model_parameters &params,
+		    const std::vector<std::vector<Real>> &brightness);
+
+public:
+  // threads_per_worker sets the OpenMP thread count inside each worker;
+  // n_workers*threads_per_worker should not exceed the number of cores
+  observation_fit_driver(const std::string &iph_sfn_fnamee,
+			 const int n_workerss,
+			 const int threads_per_workerr = 1);
+
+  static bool load_parameters(const std::string &fname, std::vector<model_parameters> &parameters);
+  // fname lists one observation set file per line
+  static bool load_observation_sets(const std::string &fname, std::vector<observation_set> &sets);
+
+  bool run(const std::vector<model_parameters> &parameters,
+	   const std::vector<observation_set> &sets,
+	   const std::string &output_fname);
+};
+
+#endif
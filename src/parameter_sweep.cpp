@@ -0,0 +1,281 @@
+#include "parameter_sweep.hpp"
+#include "constants.hpp"
+#include "observation_fit.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+using std::vector;
+using std::string;
+using std::uint32_t;
+using std::uint64_t;
+
+constexpr char sweep_output_file::magic[9];
+const uint32_t sweep_output_file::version;
+const std::size_t sweep_output_file::header_size;
+const uint64_t sweep_output_file::status_done;
+
+namespace {
+  const uint64_t record_alignment = 64;
+
+  template <typename T>
+  void put(vector<char> &buffer, const uint64_t offset, const T &value) {
+    std::memcpy(buffer.data() + offset, &value, sizeof(T));
+  }
+  template <typename T>
+  T get(const vector<char> &buffer, const uint64_t offset) {
+    T value;
+    std::memcpy(&value, buffer.data() + offset, sizeof(T));
+    return value;
+  }
+
+  bool pwrite_all(const int fd, const void *data, const std::size_t n, const uint64_t offset) {
+    return pwrite(fd, data, n, offset) == (ssize_t) n;
+  }
+  bool pread_all(const int fd, void *data, const std::size_t n, const uint64_t offset) {
+    return pread(fd, data, n, offset) == (ssize_t) n;
+  }
+}
+
+
+sweep_output_file::sweep_output_file()
+  : fd(-1), n_points(0), n_emissions(0), n_obs(0), records_offset(0), record_size(0)
+{ }
+
+sweep_output_file::~sweep_output_file() {
+  close();
+}
+
+void sweep_output_file::close() {
+  if (fd >= 0)
+    ::close(fd);
+  fd = -1;
+}
+
+bool sweep_output_file::open(const string &fname,
+			     const vector<model_parameters> &parameters,
+			     const int n_emissionss, const int n_obss) {
+  close();
+
+  n_points = parameters.size();
+  n_emissions = n_emissionss;
+  n_obs = n_obss;
+  const uint64_t params_size = 2*n_points*sizeof(Real);
+  records_offset = (header_size + params_size + record_alignment - 1) / record_alignment * record_alignment;
+  record_size = sizeof(uint64_t) + n_emissions*n_obs*sizeof(Real);
+
+  fd = ::open(fname.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return false;
+
+  // the first process to get the lock writes the header, the others
+  // check that they are running the same sweep
+  flock(fd, LOCK_EX);
+  struct stat file_stat;
+  bool success = fstat(fd, &file_stat) == 0;
+  if (success)
+    success = file_stat.st_size == 0 ? create(parameters) : validate(parameters);
+  flock(fd, LOCK_UN);
+
+  if (!success)
+    close();
+  return success;
+}
+
+bool sweep_output_file::create(const vector<model_parameters> &parameters) {
+  vector<char> buffer(records_offset, 0);
+  std::memcpy(buffer.data(), magic, 8);
+  put<uint32_t>(buffer,  8, version);
+  put<uint32_t>(buffer, 12, sizeof(Real));
+  put<uint64_t>(buffer, 16, n_points);
+  put<uint32_t>(buffer, 24, n_emissions);
+  put<uint32_t>(buffer, 28, n_obs);
+  put<uint64_t>(buffer, 32, header_size);
+  put<uint64_t>(buffer, 40, records_offset);
+  put<uint64_t>(buffer, 48, record_size);
+  for (uint64_t i=0;i<n_points;i++) {
+    put<Real>(buffer, header_size + (2*i  )*sizeof(Real), parameters[i].nHexo);
+    put<Real>(buffer, header_size + (2*i+1)*sizeof(Real), parameters[i].Texo);
+  }
+
+  // records start out zeroed, which marks them pending
+  return (ftruncate(fd, records_offset + n_points*record_size) == 0
+	  && pwrite_all(fd, buffer.data(), buffer.size(), 0));
+}
+
+bool sweep_output_file::validate(const vector<model_parameters> &parameters) {
+  vector<char> buffer(records_offset, 0);
+  if (!pread_all(fd, buffer.data(), buffer.size(), 0))
+    return false;
+
+  if (std::memcmp(buffer.data(), magic, 8) != 0
+      || get<uint32_t>(buffer,  8) != version
+      || get<uint32_t>(buffer, 12) != sizeof(Real)
+      || get<uint64_t>(buffer, 16) != n_points
+      || get<uint32_t>(buffer, 24) != n_emissions
+      || get<uint32_t>(buffer, 28) != n_obs
+      || get<uint64_t>(buffer, 40) != records_offset
+      || get<uint64_t>(buffer, 48) != record_size)
+    return false;
+
+  for (uint64_t i=0;i<n_points;i++)
+    if (get<Real>(buffer, header_size + (2*i  )*sizeof(Real)) != parameters[i].nHexo
+	|| get<Real>(buffer, header_size + (2*i+1)*sizeof(Real)) != parameters[i].Texo)
+      return false;
+
+  return true;
+}
+
+bool sweep_output_file::done(const int i_point) const {
+  assert(fd >= 0 && i_point >= 0 && i_point < (int) n_points);
+  uint64_t status = 0;
+  if (!pread_all(fd, &status, sizeof(status), records_offset + i_point*record_size))
+    return false;
+  return status == status_done;
+}
+
+bool sweep_output_file::write(const int i_point, const vector<vector<Real>> &brightness) {
+  assert(fd >= 0 && i_point >= 0 && i_point < (int) n_points);
+  assert(brightness.size() == n_emissions && "brightness does not match the output file");
+
+  vector<Real> values;
+  for (auto &b : brightness) {
+    assert(b.size() == n_obs && "brightness does not match the output file");
+    values.insert(values.end(), b.begin(), b.end());
+  }
+
+  // the values must be on disk before the status says they are, so an
+  // interrupted write is redone when the sweep resumes
+  const uint64_t offset = records_offset + i_point*record_size;
+  if (!pwrite_all(fd, values.data(), values.size()*sizeof(Real), offset + sizeof(uint64_t))
+      || fdatasync(fd) != 0)
+    return false;
+  return pwrite_all(fd, &status_done, sizeof(status_done), offset);
+}
+
+
+namespace {
+  bool run_sweep_worker(observation_fit &fit,
+			const vector<model_parameters> &parameters,
+			const vector<int> &pending,
+			std::atomic<int> &next_point,
+			sweep_output_file &output,
+			const int threads_per_worker) {
+#ifdef _OPENMP
+    omp_set_num_threads(threads_per_worker);
+#endif
+    int i;
+    while ((i = next_point++) < (int) pending.size()) {
+      const model_parameters &params = parameters[pending[i]];
+      fit.generate_source_function(params.nHexo, params.Texo);
+      if (!output.write(pending[i], fit.brightness())) {
+	std::cerr << "could not write result for point " << pending[i] << std::endl;
+	return false;
+      }
+    }
+    return true;
+  }
+}
+
+parameter_sweep::parameter_sweep(const string &iph_sfn_fnamee,
+				 const int n_local_workerss,
+				 const int threads_per_workerr/* = 1*/,
+				 const int rankk/* = 0*/,
+				 const int n_rankss/* = 1*/)
+  : iph_sfn_fname(iph_sfn_fnamee),
+    n_local_workers(std::max(n_local_workerss, 1)),
+    threads_per_worker(std::max(threads_per_workerr, 1)),
+    rank(rankk),
+    n_ranks(std::max(n_rankss, 1))
+{
+  assert(rank >= 0 && rank < n_ranks && "rank must be in [0, n_ranks)");
+}
+
+bool parameter_sweep::run(const vector<model_parameters> &parameters,
+			  const observation_set &set,
+			  const string &output_fname) {
+  sweep_output_file output;
+  if (!output.open(output_fname, parameters,
+		   observation_fit::get_n_hydrogen_emissions(), set.size())) {
+    std::cerr << "could not open " << output_fname
+	      << ", or it belongs to a sweep with different parameters" << std::endl;
+    return false;
+  }
+
+  // this rank's share of the points, minus any finished in an earlier run
+  vector<int> pending;
+  for (int i_point=rank;i_point<(int) parameters.size();i_point+=n_ranks)
+    if (!output.done(i_point))
+      pending.push_back(i_point);
+
+  std::cout << "rank " << rank << " of " << n_ranks << ": "
+	    << pending.size() << " parameter points to compute." << std::endl;
+  if (pending.size() == 0)
+    return true;
+
+  // The OpenMP runtime does not survive fork once it has started
+  // threads, so everything before the fork runs on one thread.
+#ifdef _OPENMP
+  omp_set_num_threads(1);
+#endif
+
+  // set up everything that does not depend on the parameters once, so
+  // forked workers share it
+  observation_fit fit(iph_sfn_fname);
+  vector<Real> g_factor = set.g_factor;
+  if (g_factor.size() == 0)
+    g_factor = {lyman_alpha_typical_g_factor, lyman_beta_typical_g_factor};
+  fit.set_g_factor(g_factor);
+  fit.add_observation(set.locations, set.directions);
+  if (set.simulate_iph())
+    fit.add_observation_ra_dec(set.mars_ecliptic_pos, set.ra, set.dec);
+  else
+    fit.simulate_iph(false);
+
+  // work queue shared between the forked workers
+  void *shared = mmap(NULL, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED)
+    return false;
+  std::atomic<int> *next_point = new (shared) std::atomic<int>(0);
+
+  bool success = true;
+  const int n_workers = std::min(n_local_workers, (int) pending.size());
+  if (n_workers == 1) {
+    success = run_sweep_worker(fit, parameters, pending, *next_point, output, threads_per_worker);
+  } else {
+    std::cout.flush();
+    std::cerr.flush();
+    vector<pid_t> workers;
+    for (int i_worker=0;i_worker<n_workers;i_worker++) {
+      pid_t pid = fork();
+      if (pid == 0)
+	_exit(run_sweep_worker(fit, parameters, pending, *next_point, output, threads_per_worker) ? 0 : 1);
+      if (pid < 0) {
+	std::cerr << "could not start worker process " << i_worker << std::endl;
+	success = false;
+	break;
+      }
+      workers.push_back(pid);
+    }
+    for (pid_t pid : workers) {
+      int status;
+      if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	success = false;
+    }
+  }
+
+  munmap(shared, sizeof(std::atomic<int>));
+  return success;
+}
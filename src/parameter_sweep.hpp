@@ -0,0 +1,95 @@
+//parameter_sweep.hpp -- long-running parameter sweeps split across processes and nodes
+
+#ifndef __PARAMETER_SWEEP_H
+#define __PARAMETER_SWEEP_H
+
+#include "Real.hpp"
+#include "observation_fit_driver.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Indexed binary output shared by every process in a sweep, in native
+// byte order. Each parameter point has a fixed-size record, so
+// processes write their own records in place without coordinating,
+// and a record only counts as done once its status word is set after
+// the values are written. Rerunning a sweep with the same output file
+// skips finished points.
+//
+//   header, 64 bytes
+//     char     magic[8]         "CRNSWEEP"
+//     uint32   version
+//     uint32   real_size        bytes per value, 4 or 8
+//     uint64   n_points
+//     uint32   n_emissions
+//     uint32   n_obs
+//     uint64   params_offset    n_points x (nHexo, Texo)
+//     uint64   records_offset
+//     uint64   record_size
+//     uint64   reserved
+//   records, n_points entries of record_size bytes
+//     uint64   status           0 pending, 1 done
+//     Real     brightness[n_emissions][n_obs]
+class sweep_output_file {
+  int fd;
+  std::uint64_t n_points;
+  std::uint32_t n_emissions, n_obs;
+  std::uint64_t records_offset;
+  std::uint64_t record_size;
+
+  bool create(const std::vector<model_parameters> &parameters);
+  bool validate(const std::vector<model_parameters> &parameters);
+
+public:
+  static constexpr char magic[9] = "CRNSWEEP";
+  static const std::uint32_t version = 1;
+  static const std::size_t header_size = 64;
+  static const std::uint64_t status_done = 1;
+
+  sweep_output_file();
+  ~sweep_output_file();
+  sweep_output_file(const sweep_output_file &copy) = delete;
+  sweep_output_file& operator=(const sweep_output_file &rhs) = delete;
+
+  // Creates the file, or checks that an existing file was made for the
+  // same parameters and observation size. Safe to call from several
+  // processes at once.
+  bool open(const std::string &fname,
+	    const std::vector<model_parameters> &parameters,
+	    const int n_emissionss, const int n_obss);
+  void close();
+
+  bool done(const int i_point) const;
+  // brightness[i_emission][i_obs], as returned by observation_fit::brightness
+  bool write(const int i_point, const std::vector<std::vector<Real>> &brightness);
+};
+
+// Runs one observation set against a list of parameter points. The
+// points are split between ranks (MPI processes or independently
+// launched jobs that share the output file), and each rank forks
+// n_local_workers processes that pull points from a queue in shared
+// memory. The observation geometry, grid rays and IPH brightness are
+// computed once before forking, so workers share those tables
+// read-only instead of each building its own.
+class parameter_sweep {
+  std::string iph_sfn_fname;
+  int n_local_workers;
+  int threads_per_worker;
+  int rank, n_ranks;
+
+public:
+  parameter_sweep(const std::string &iph_sfn_fnamee,
+		  const int n_local_workerss,
+		  const int threads_per_workerr = 1,
+		  const int rankk = 0,
+		  const int n_rankss = 1);
+
+  // returns false if the output could not be opened or a worker failed;
+  // running again with the same arguments resumes the sweep
+  bool run(const std::vector<model_parameters> &parameters,
+	   const observation_set &set,
+	   const std::string &output_fname);
+};
+
+#endif
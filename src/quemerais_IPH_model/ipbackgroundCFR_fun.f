@@ -88,6 +88,10 @@ c     DATA VPOS/1993.,6.31,45.19,22.42,1998.,4.62,
 c     &  61.49,31.16,2003.,2.97,77.25,39.61/  
       integer unit
       REAL*4 DONNE(12)
+c     name of the input file currently held in the COMMON blocks, so
+c     it is only read and rescaled on the first call
+      CHARACTER(len=1024), SAVE :: LOADED_FNAME = ' '
+      LOGICAL :: NEW_FNAME
 c--------------------------------------------------------------------------
       DATA DONNE/1.    ,1.21566E-05,0.4162,0.2,
      1     0.8816,1.02500E-05,0.0790,0.1,
@@ -104,6 +108,8 @@ c$$$  &"fsm99td12v20t80"
          SFN_FNAME (I_STR:I_STR) = sfname (I_STR)
       end do
 c      PRINT *, 'FORTRAN SFN_FNAME = ', SFN_FNAME
+      NEW_FNAME = (LOADED_FNAME .NE. SFN_FNAME)
+      IF (NEW_FNAME) THEN
       OPEN(UNIT=3,FILE=SFN_FNAME, 
      1     FORM='FORMATTED',STATUS='OLD')
       READ(3,*) KMAX,LMAX,INF
@@ -162,6 +168,7 @@ c      print 2020,VO,VLON,VDEC,TEMP,AMU,TDUR,AN,DINF(1)
          READ(3,*) (ZALT(K),(SN(K,L,ii),L=16,19),K=1,KMAX)
  1212 continue
       CLOSE(UNIT=3)
+      ENDIF
  2000 FORMAT(2F8.2,F7.2,F6.0,F6.2,G10.3,F4.1,F10.3)
  2020 FORMAT(2F8.0,F7.2,F6.0,F6.2,G10.3,F4.1,F10.3)
  6001 FORMAT(7X,5(2X,F4.0,3X))
@@ -174,6 +181,7 @@ C     KMAX = NB. DE VALEURS DE DISTANCES RADIALES DE LA TRAME DE CALCUL
 C     (TABLEAUX ZALT-SO-SN ...)
 c----------------------------------------------------------------------------
       UA=1.4959E+11
+      IF (NEW_FNAME) THEN
       do ii=1,INF
          dinf(ii)=dinf(ii)*1.E6
       enddo
@@ -181,6 +189,8 @@ c----------------------------------------------------------------------------
          zalt(ii)=alt(ii)*ua
          alt(ii)=alt(ii)*ua
       enddo
+      LOADED_FNAME = SFN_FNAME
+      ENDIF
 C---  CALCUL DE SIGMAN Section efficace pour la transition LYMAN-ALPHA
 c      print *,DINF
 C---  integree en frequence (cm2*hertz)
@@ -292,6 +302,8 @@ c     u1 = cos(ra1*dpi)*cos(de1*dpi)
 c     v1 = sin(ra1*dpi)*cos(de1*dpi)
 c     w1 = sin(de1*dpi)
 
+c     lines of sight are independent and only read the COMMON blocks
+!$OMP PARALLEL DO PRIVATE(u2,v2,w2,xot,xsn) SCHEDULE(DYNAMIC)
       DO I_LOS = 1, n_los
       
       u2=a11*u1(I_LOS)+a12*v1(I_LOS)
@@ -302,9 +314,10 @@ c     Y axe du vent
 
       call intensm_ph(x2,y2,z2,u2,v2,w2,xot,xsn,idb,idf)
 
-      IF (MODULO(I_LOS,1000) == 0) THEN
-      print *, 'IPH sim done for I_LOS = ', I_LOS, ' OF ', n_los
-      END IF
+c     no progress message: threads would print it out of order
+c      IF (MODULO(I_LOS,1000) == 0) THEN
+c      print *, 'IPH sim done for I_LOS = ', I_LOS, ' OF ', n_los
+c      END IF
 c     c val = 1,5 -> D = 0.05, 0.25
       
 c 6784 format(8f8.2)
@@ -318,6 +331,7 @@ c      print *, xot(2), xsn(2)
       fln(I_LOS)=xsn(2)
 
       END DO
+!$OMP END PARALLEL DO
 
 c     close(16)
 
@@ -1,6 +1,8 @@
 #include "constants.hpp"
 #include "iph_model_interface.hpp"
+#include "forward_model_cache.hpp"
 #include <cmath>
+#include <mutex>
 
 using std::vector;
 using std::cos;
@@ -16,6 +18,24 @@ extern "C" {
 		  float *iph_b);
 }
 
+// the Fortran model keeps its state in COMMON blocks and reads its
+// input file through a fixed unit number, so only one call may run at
+// a time, even from independent observation_fit objects
+static std::mutex background_mutex;
+
+// brightness of each line of sight already computed, keyed by the
+// exact single precision inputs passed to the Fortran code. Shared by
+// all callers and guarded by background_mutex. Each line of sight
+// costs ~400 bytes of keys and bookkeeping, so the default of 10000
+// (~4 MB) keeps the footprint small; raise it for large observation
+// sets with set_quemerais_iph_cache_size.
+static forward_model_lru_cache<float> iph_los_cache(10000);
+
+void set_quemerais_iph_cache_size(const std::size_t n_los) {
+  std::lock_guard<std::mutex> background_lock(background_mutex);
+  iph_los_cache.set_capacity(n_los);
+}
+
 vector<Real> quemerais_iph_model(const string sfn_fname, // fully-qualified filename of Quemerais code input file
 				 const Real &g_lya, //Lyman alpha g factor at Mars
 				 const std::vector<Real> &marspos, //position of Mars in ecliptic coordinates [AU]
@@ -37,10 +57,10 @@ vector<Real> quemerais_iph_model(const string sfn_fname, // fully-qualified file
   float x_pos_=marspos[0];
   float y_pos_=marspos[1];
   float z_pos_=marspos[2];
-  float *x_look_ = new float[n_los];
-  float *y_look_ = new float[n_los];
-  float *z_look_ = new float[n_los];
-  float *iphb_ = new float[n_los];
+  vector<float> x_look_(n_los);
+  vector<float> y_look_(n_los);
+  vector<float> z_look_(n_los);
+  vector<float> iphb_(n_los);
 
   for (int i_los=0; i_los<n_los; i_los++) {
     Real thisdec = M_PI/180*dec[i_los];
@@ -60,23 +80,50 @@ vector<Real> quemerais_iph_model(const string sfn_fname, // fully-qualified file
     z_look_[i_los]=j2000vec[2]*cos(-eob)+j2000vec[1]*sin(-eob);
   }
 
+  std::unique_lock<std::mutex> background_lock(background_mutex);
+
+  // only send lines of sight we have not seen before to the fortran code
+  vector<forward_model_key> los_keys(n_los, forward_model_key(sfn_fname));
+  vector<int> new_los;
+  vector<float> x_look_new, y_look_new, z_look_new;
+  for (int i_los=0; i_los<n_los; i_los++) {
+    forward_model_key &key = los_keys[i_los];
+    for (float val : {lc_, x_pos_, y_pos_, z_pos_, x_look_[i_los], y_look_[i_los], z_look_[i_los]})
+      key.add(val);
+
+    const float *cached = iph_los_cache.find(key);
+    if (cached != NULL) {
+      iphb_[i_los] = *cached;
+    } else {
+      new_los.push_back(i_los);
+      x_look_new.push_back(x_look_[i_los]);
+      y_look_new.push_back(y_look_[i_los]);
+      z_look_new.push_back(z_look_[i_los]);
+    }
+  }
+
   // call the fortran code
-  int sfn_fname_length_ = sfn_fname.length();
-  background(sfn_fname.c_str(), &sfn_fname_length_,
-	     &lc_,
-	     &x_pos_,&y_pos_,&z_pos_,
-	     &n_los,
-	     &x_look_[0], &y_look_[0], &z_look_[0],
-	     &iphb_[0]);
+  int n_los_new = new_los.size();
+  if (n_los_new > 0) {
+    vector<float> iphb_new(n_los_new);
+    int sfn_fname_length_ = sfn_fname.length();
+    background(sfn_fname.c_str(), &sfn_fname_length_,
+	       &lc_,
+	       &x_pos_,&y_pos_,&z_pos_,
+	       &n_los_new,
+	       x_look_new.data(), y_look_new.data(), z_look_new.data(),
+	       iphb_new.data());
+
+    for (int i_new=0; i_new<n_los_new; i_new++) {
+      iphb_[new_los[i_new]] = iphb_new[i_new];
+      iph_los_cache.insert(los_keys[new_los[i_new]], iphb_new[i_new]);
+    }
+  }
+  background_lock.unlock();
 
   for (int i_los=0; i_los<n_los; i_los++) {
     iph_brightness[i_los] = iphb_[i_los]/1000.; //iphb is in R, convert to kR
   }
 
-  delete [] x_look_;
-  delete [] y_look_;
-  delete [] z_look_;
-  delete [] iphb_;
-  
   return iph_brightness;
 }
@@ -3,6 +3,7 @@
 #include "Real.hpp"
 #include <vector>
 #include <string>
+#include <cstddef>
 
 using std::vector;
 using std::string;
@@ -12,3 +13,9 @@ vector<Real> quemerais_iph_model(const string sfn_fname,
 				 const std::vector<Real> &marspos, //position of Mars in ecliptic coordinates [AU]
 				 const vector<Real> &ra, const vector<Real> &dec);
 
+// Results are remembered per line of sight, so repeated calls for the
+// same Mars position, look direction, and g factor skip the Fortran
+// model. This sets how many lines of sight are kept (default 10000,
+// zero disables the cache).
+void set_quemerais_iph_cache_size(const std::size_t n_los);
+
@@ -10,6 +10,9 @@
 
 #include "Real.hpp"
 #include "cuda_compatibility.hpp"
+#include <vector>
+#include <cmath>
+#include <algorithm>
 
 template<int N_VOXELS, int N_STATES_PER_VOXEL>
 struct voxel_array {
@@ -58,6 +61,64 @@ struct voxel_array {
   }
 };
 
+template <int N_VOXELS>
+struct voxel_index_list {
+  //voxels written in a set of voxel_arrays since the arrays were last
+  // zeroed, so that a tracker's influence arrays can be read and
+  // zeroed along the ray path instead of in full. A voxel entered on
+  // consecutive steps is listed once; a voxel re-entered later is
+  // listed again. Past N_VOXELS entries the list is marked full and
+  // users fall back to the whole array.
+  int voxels[N_VOXELS];
+  int n_listed;
+  bool full;
+
+  CUDA_CALLABLE_MEMBER
+  void clear() {
+    n_listed = 0;
+    full = false;
+  }
+
+  CUDA_CALLABLE_MEMBER
+  void add(const int i_voxel) {
+    if (n_listed > 0 && voxels[n_listed-1] == i_voxel)
+      return;
+    if (n_listed < N_VOXELS)
+      voxels[n_listed++] = i_voxel;
+    else
+      full = true;
+  }
+
+  // zero the listed voxels in each array and clear the list
+  template <int N_STATES_PER_VOXEL, int N_ARRAYS>
+  CUDA_CALLABLE_MEMBER
+  void zero_listed(voxel_array<N_VOXELS, N_STATES_PER_VOXEL> (&arrays)[N_ARRAYS]) {
+    for (int i_array=0;i_array<N_ARRAYS;i_array++) {
+      if (full)
+	arrays[i_array] = 0.0;
+      else
+	for (int i_listed=0;i_listed<n_listed;i_listed++)
+	  for (int i_state=0;i_state<N_STATES_PER_VOXEL;i_state++)
+	    arrays[i_array](voxels[i_listed], i_state) = 0.0;
+    }
+    clear();
+  }
+};
+
+struct empty_voxel_index_list {
+  //stand-in for brightness trackers, which carry a single value in
+  // place of each voxel_array
+  CUDA_CALLABLE_MEMBER
+  void clear() { }
+
+  template <int N_ARRAYS>
+  CUDA_CALLABLE_MEMBER
+  void zero_listed(Real (&values)[N_ARRAYS]) {
+    for (int i_array=0;i_array<N_ARRAYS;i_array++)
+      values[i_array] = 0.0;
+  }
+};
+
 template <int N_VOXELS, int N_STATES_PER_VOXEL>
 class voxel_vector {
   //host-side array storage with device mirror,
@@ -95,15 +156,48 @@ public:
   voxel_vector(const voxel_vector &copy) 
   {
     assert(n_elements == copy.eigen_vec->size());
-    *eigen_vec = *copy.eigen_vec;
+    eigen_vec = new VectorX(*copy.eigen_vec);
+    vec = eigen_vec->data();
+  }
+  // moves exchange the storage (host and device) instead of copying
+  // it; a vector moved from by construction has no storage left and
+  // may only be destroyed
+  voxel_vector(voxel_vector &&moved) noexcept
+    : eigen_vec(moved.eigen_vec), vec(moved.vec), d_vec(moved.d_vec)
+  {
+    moved.eigen_vec = NULL;
+    moved.vec = NULL;
+    moved.d_vec = NULL;
+  }
+  voxel_vector& operator=(voxel_vector &&moved) noexcept {
+    std::swap(eigen_vec, moved.eigen_vec);
+    std::swap(vec, moved.vec);
+    std::swap(d_vec, moved.d_vec);
+    return *this;
+  }
+  voxel_vector& operator=(VectorX &&rhs) {
+    assert(n_elements == rhs.size());
+    eigen_vec->swap(rhs);
     vec = eigen_vec->data();
+    return *this;
   }
-  voxel_vector& operator=(const VectorX &rhs) {
+  // Eigen expressions (e.g. coefficientwise products of other
+  // voxel_vectors) are evaluated straight into the existing storage,
+  // without a temporary VectorX
+  template <typename Derived>
+  voxel_vector& operator=(const Eigen::MatrixBase<Derived> &rhs) {
     assert(n_elements == rhs.size());
     *eigen_vec = rhs;
     vec = eigen_vec->data();
     return *this;
   }
+  template <typename Derived>
+  voxel_vector& operator=(const Eigen::ArrayBase<Derived> &rhs) {
+    assert(n_elements == rhs.size());
+    eigen_vec->array() = rhs;
+    vec = eigen_vec->data();
+    return *this;
+  }
   voxel_vector& operator=(const voxel_vector<N_VOXELS, N_STATES_PER_VOXEL> &rhs) {
 #ifdef __CUDA_ARCH__
     for (int i=0;i<n_elements;i++)
@@ -114,7 +208,7 @@ public:
 #endif
     return *this;
   }
-  operator VectorX() const {
+  operator const VectorX &() const {
     return eigen();
   }
 
@@ -126,7 +220,7 @@ public:
   VectorX & eigen() {
     return *eigen_vec;
   }
-  const VectorX eigen() const {
+  const VectorX & eigen() const {
     return *eigen_vec;
   }
 
@@ -196,19 +290,24 @@ public:
 
 template<int N_VOXELS, int N_STATES_PER_VOXEL>
 class voxel_matrix {
+  //host-side influence matrix with device mirror. Stored row-major
+  // (see RowMatrixX): compute_influence writes a row per start voxel,
+  // and each OpenMP thread zeroes and then fills a contiguous block
+  // of rows, so the pages of a block are first touched by, and on
+  // NUMA systems placed with, the thread that writes them.
 public:
   static const int n_voxels = N_VOXELS;
   static const int n_states = N_STATES_PER_VOXEL;
   static const int n_elements = N_VOXELS*N_STATES_PER_VOXEL;
 
-  MatrixX *eigen_mat;
+  RowMatrixX *eigen_mat;
   Real* mat;
   Real* d_mat = NULL;//pointer to device memory for CUDA
 
   CUDA_CALLABLE_MEMBER
   voxel_matrix() {
 #ifndef __CUDA_ARCH__
-    eigen_mat = new MatrixX;
+    eigen_mat = new RowMatrixX;
     resize();
 #endif
   }
@@ -223,12 +322,27 @@ public:
   
   
   voxel_matrix(const voxel_matrix &copy) {
-    *eigen_mat = *copy.eigen_mat;
+    eigen_mat = new RowMatrixX(*copy.eigen_mat);
     mat = eigen_mat->data();
   }
+  // moves exchange storage, as for voxel_vector
+  voxel_matrix(voxel_matrix &&moved) noexcept
+    : eigen_mat(moved.eigen_mat), mat(moved.mat), d_mat(moved.d_mat)
+  {
+    moved.eigen_mat = NULL;
+    moved.mat = NULL;
+    moved.d_mat = NULL;
+  }
+  voxel_matrix& operator=(voxel_matrix &&moved) noexcept {
+    std::swap(eigen_mat, moved.eigen_mat);
+    std::swap(mat, moved.mat);
+    std::swap(d_mat, moved.d_mat);
+    return *this;
+  }
 
-  voxel_matrix& operator=(const MatrixX &rhs) {
-    assert(n_elements == rhs.size());
+  template <typename Derived>
+  voxel_matrix& operator=(const Eigen::MatrixBase<Derived> &rhs) {
+    assert(n_elements == rhs.rows() && n_elements == rhs.cols());
     *eigen_mat = rhs;
     mat = eigen_mat->data();
     return *this;
@@ -244,7 +358,7 @@ public:
 #endif
     return *this;
   }
-  operator MatrixX() const {
+  operator const RowMatrixX &() const {
     return eigen();
   }
 
@@ -254,13 +368,18 @@ public:
     mat = eigen_mat->data();
   }
 
-  MatrixX & eigen() {
+  RowMatrixX & eigen() {
     return *eigen_mat;
   }
-  const MatrixX eigen() const {
+  const RowMatrixX & eigen() const {
     return *eigen_mat;
   }
 
+  // zero the rows of voxel i_voxel, one per state
+  void zero_voxel_rows(const int i_voxel) {
+    eigen_mat->middleRows(get_element_num(i_voxel, 0), n_states).setZero();
+  }
+
   // element fetch
   CUDA_CALLABLE_MEMBER
   int get_element_num(const int n_voxel, const int n_state) const {
@@ -284,20 +403,12 @@ public:
   //overload () to access coefficients of mat directly
   CUDA_CALLABLE_MEMBER
   Real & operator()(const int n, const int m) {
-#ifdef EIGEN_ROWMAJOR
     const int i = n*n_elements + m;//row major
-#else
-    const int i = m*n_elements + n;//column major
-#endif
     return mat[i];
   }
   CUDA_CALLABLE_MEMBER
   const Real & operator()(const int n, const int m) const {
-#ifdef EIGEN_ROWMAJOR
     const int i = n*n_elements + m;//row major
-#else
-    const int i = m*n_elements + n;//column major
-#endif
     return mat[i];
   }
 
@@ -338,4 +449,189 @@ public:
 #endif
 };
 
+
+template<int N_VOXELS, int N_STATES_PER_VOXEL>
+class voxel_sparse_matrix {
+  //host-side influence matrix for grids too large to store densely,
+  // used in place of voxel_matrix by emission_voxels. Rows are
+  // accumulated independently (each by a single thread) as sorted
+  // lists of their nonzero elements, then packed into a row-major
+  // Eigen sparse matrix by compress() for the solve.
+public:
+  static const int n_voxels = N_VOXELS;
+  static const int n_states = N_STATES_PER_VOXEL;
+  static const int n_elements = N_VOXELS*N_STATES_PER_VOXEL;
+
+  SparseMatrixX *eigen_mat;
+
+protected:
+  std::vector<std::vector<int>> row_cols;
+  std::vector<std::vector<Real>> row_vals;
+  bool rows_pending;
+
+public:
+  voxel_sparse_matrix()
+    : row_cols(n_elements), row_vals(n_elements), rows_pending(false)
+  {
+    eigen_mat = new SparseMatrixX(n_elements, n_elements);
+  }
+
+  ~voxel_sparse_matrix() {
+    delete eigen_mat;
+  }
+
+  voxel_sparse_matrix(const voxel_sparse_matrix &copy)
+    : row_cols(copy.row_cols), row_vals(copy.row_vals), rows_pending(copy.rows_pending)
+  {
+    eigen_mat = new SparseMatrixX(*copy.eigen_mat);
+  }
+  voxel_sparse_matrix& operator=(const voxel_sparse_matrix &rhs) {
+    if(this == &rhs) return *this;
+    *eigen_mat = *rhs.eigen_mat;
+    row_cols = rhs.row_cols;
+    row_vals = rhs.row_vals;
+    rows_pending = rhs.rows_pending;
+    return *this;
+  }
+
+  SparseMatrixX & eigen() {
+    return *eigen_mat;
+  }
+  const SparseMatrixX & eigen() const {
+    return *eigen_mat;
+  }
+
+  int get_element_num(const int n_voxel, const int n_state) const {
+    return voxel_array<N_VOXELS, N_STATES_PER_VOXEL>::get_element_num(n_voxel, n_state);
+  }
+
+  // number of stored elements, once compressed
+  long nonzeros() const {
+    return eigen_mat->nonZeros();
+  }
+
+  void reset() {
+    eigen_mat->setZero();
+    for (int i_row=0;i_row<n_elements;i_row++) {
+      std::vector<int>().swap(row_cols[i_row]);
+      std::vector<Real>().swap(row_vals[i_row]);
+    }
+    rows_pending = false;
+  }
+
+  // add a dense row of n_elements values to row i_row. Different rows
+  // may be added from different threads at the same time.
+  void add_to_row(const int i_row, const Real *row_values) {
+    std::vector<int> add_cols;
+    std::vector<Real> add_vals;
+    for (int j=0;j<n_elements;j++) {
+      if (row_values[j] == 0)
+	continue;
+      add_cols.push_back(j);
+      add_vals.push_back(row_values[j]);
+    }
+    add_sorted_to_row(i_row, add_cols, add_vals);
+  }
+
+  // as above, reading only the elements of the listed voxels, which
+  // may be in any order and repeated (each voxel is added once)
+  void add_to_row(const int i_row, const Real *row_values,
+		  const int *voxels, const int n_listed) {
+    std::vector<int> listed(voxels, voxels + n_listed);
+    std::sort(listed.begin(), listed.end());
+    listed.erase(std::unique(listed.begin(), listed.end()), listed.end());
+
+    std::vector<int> add_cols;
+    std::vector<Real> add_vals;
+    for (const int &j_voxel : listed) {
+      for (int j_state=0;j_state<n_states;j_state++) {
+	const int j = get_element_num(j_voxel, j_state);
+	if (row_values[j] == 0)
+	  continue;
+	add_cols.push_back(j);
+	add_vals.push_back(row_values[j]);
+      }
+    }
+    add_sorted_to_row(i_row, add_cols, add_vals);
+  }
+
+protected:
+  // add elements with increasing column numbers to row i_row
+  void add_sorted_to_row(const int i_row,
+			 const std::vector<int> &add_cols,
+			 const std::vector<Real> &add_vals) {
+    std::vector<int> &cols = row_cols[i_row];
+    std::vector<Real> &vals = row_vals[i_row];
+
+    // most elements reached by a ray are already in the row from
+    // earlier rays: add to those in place and merge in only the rest
+    std::vector<int> new_cols;
+    std::vector<Real> new_vals;
+    unsigned int k = 0;
+    for (unsigned int i_add=0;i_add<add_cols.size();i_add++) {
+      const int j = add_cols[i_add];
+      while (k < cols.size() && cols[k] < j)
+	k++;
+      if (k < cols.size() && cols[k] == j) {
+	vals[k] += add_vals[i_add];
+      } else {
+	new_cols.push_back(j);
+	new_vals.push_back(add_vals[i_add]);
+      }
+    }
+    if (new_cols.size() == 0)
+      return;
+    rows_pending = true;
+
+    std::vector<int> merged_cols;
+    std::vector<Real> merged_vals;
+    merged_cols.reserve(cols.size() + new_cols.size());
+    merged_vals.reserve(cols.size() + new_cols.size());
+    unsigned int i_old = 0, i_new = 0;
+    while (i_old < cols.size() || i_new < new_cols.size()) {
+      if (i_new == new_cols.size() || (i_old < cols.size() && cols[i_old] < new_cols[i_new])) {
+	merged_cols.push_back(cols[i_old]);
+	merged_vals.push_back(vals[i_old]);
+	i_old++;
+      } else {
+	merged_cols.push_back(new_cols[i_new]);
+	merged_vals.push_back(new_vals[i_new]);
+	i_new++;
+      }
+    }
+    cols.swap(merged_cols);
+    vals.swap(merged_vals);
+  }
+
+public:
+  // pack the accumulated rows into eigen_mat, keeping only elements
+  // larger in magnitude than drop_tolerance, and free the row lists
+  void compress(const Real drop_tolerance = 0) {
+    if (!rows_pending)
+      return;
+
+    Eigen::VectorXi row_nonzeros(n_elements);
+    for (int i_row=0;i_row<n_elements;i_row++) {
+      row_nonzeros(i_row) = 0;
+      for (unsigned int k=0;k<row_vals[i_row].size();k++)
+	if (std::abs(row_vals[i_row][k]) > drop_tolerance)
+	  row_nonzeros(i_row)++;
+    }
+
+    eigen_mat->setZero();
+    eigen_mat->reserve(row_nonzeros);
+    for (int i_row=0;i_row<n_elements;i_row++) {
+      for (unsigned int k=0;k<row_vals[i_row].size();k++)
+	if (std::abs(row_vals[i_row][k]) > drop_tolerance)
+	  eigen_mat->insert(i_row, row_cols[i_row][k]) = row_vals[i_row][k];
+      std::vector<int>().swap(row_cols[i_row]);
+      std::vector<Real>().swap(row_vals[i_row]);
+    }
+    eigen_mat->makeCompressed();
+    rows_pending = false;
+  }
+
+  void free_d_mat() { } // not supported on the GPU
+};
+
 #endif
@@ -0,0 +1,67 @@
+//sweep_parameters.cpp -- program to run a resumable parameter sweep
+//for one observation set, split across processes and optionally nodes
+
+#include "Real.hpp"
+#include "parameter_sweep.hpp"
+#include <iostream>
+#include <cstdlib>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+int main(int argc, char* argv[]) {
+  int rank = 0, n_ranks = 1;
+#ifdef USE_MPI
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &n_ranks);
+#endif
+
+  if (argc < 4) {
+    if (rank == 0)
+      std::cerr << "usage: " << argv[0]
+		<< " parameter_file observation_set_file output_file"
+		<< " [n_local_workers] [threads_per_worker] [rank] [n_ranks] [iph_sourcefn_file]\n"
+		<< "  parameter_file: one 'nHexo Texo' pair per line\n"
+		<< "  rank and n_ranks split the sweep between jobs that share output_file;\n"
+		<< "  they are taken from MPI when compiled with USE_MPI\n"
+		<< "  rerun with the same arguments to resume an interrupted sweep\n";
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+    return 1;
+  }
+
+  const std::string parameter_fname = argv[1];
+  const std::string set_fname = argv[2];
+  const std::string output_fname = argv[3];
+  const int n_local_workers = argc > 4 ? atoi(argv[4]) : 1;
+  const int threads_per_worker = argc > 5 ? atoi(argv[5]) : 1;
+#ifndef USE_MPI
+  rank = argc > 6 ? atoi(argv[6]) : 0;
+  n_ranks = argc > 7 ? atoi(argv[7]) : 1;
+#endif
+  const std::string iph_sfn_fname = argc > 8 ? argv[8] : "src/quemerais_IPH_model/fsm99td12v20t80";
+
+  bool success = true;
+  std::vector<model_parameters> parameters;
+  observation_set set;
+  if (!observation_fit_driver::load_parameters(parameter_fname, parameters)) {
+    std::cerr << "could not read parameter file " << parameter_fname << std::endl;
+    success = false;
+  } else if (!set.load(set_fname)) {
+    std::cerr << "could not read observation set " << set_fname << std::endl;
+    success = false;
+  } else if (rank < 0 || rank >= n_ranks) {
+    std::cerr << "rank must be between 0 and n_ranks-1" << std::endl;
+    success = false;
+  } else {
+    parameter_sweep sweep(iph_sfn_fname, n_local_workers, threads_per_worker, rank, n_ranks);
+    success = sweep.run(parameters, set, output_fname);
+  }
+
+#ifdef USE_MPI
+  MPI_Finalize();
+#endif
+  return success ? 0 : 1;
+}